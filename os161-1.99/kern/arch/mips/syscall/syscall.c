@@ -34,7 +34,10 @@
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <syscall.h>
+#include <copyinout.h>
+#include <tracepoint.h>
 
 
 /*
@@ -80,6 +83,8 @@ syscall(struct trapframe *tf)
 {
 	int callno;
 	int32_t retval;
+	off_t retval64;
+	bool is64 = false;
 	int err;
 
 	KASSERT(curthread != NULL);
@@ -87,6 +92,7 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	TRACEPOINT(TP_SYSCALL_ENTER, callno, tf->tf_a0);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -108,13 +114,98 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_clock_gettime:
+		err = sys_clock_gettime((int)tf->tf_a0,
+					(userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
 #ifdef UW
+	case SYS_open:
+	  err = sys_open((userptr_t)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (mode_t)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_read:
+	  err = sys_read((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
 			  (userptr_t)tf->tf_a1,
 			  (int)tf->tf_a2,
 			  (int *)(&retval));
 	  break;
+	case SYS_pread:
+	case SYS_pwrite:
+	  {
+	    /* the 64-bit offset is the aligned pair after a3, on the user stack */
+	    off_t pos;
+	    err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos, sizeof(off_t));
+	    if (err) {
+	      break;
+	    }
+	    if (callno == SYS_pread) {
+	      err = sys_pread((int)tf->tf_a0,
+			      (userptr_t)tf->tf_a1,
+			      (int)tf->tf_a2,
+			      pos,
+			      (int *)(&retval));
+	    }
+	    else {
+	      err = sys_pwrite((int)tf->tf_a0,
+			       (userptr_t)tf->tf_a1,
+			       (int)tf->tf_a2,
+			       pos,
+			       (int *)(&retval));
+	    }
+	  }
+	  break;
+	case SYS_readv:
+	  err = sys_readwritev((int)tf->tf_a0,
+			       (userptr_t)tf->tf_a1,
+			       (int)tf->tf_a2,
+			       UIO_READ,
+			       (int *)(&retval));
+	  break;
+	case SYS_writev:
+	  err = sys_readwritev((int)tf->tf_a0,
+			       (userptr_t)tf->tf_a1,
+			       (int)tf->tf_a2,
+			       UIO_WRITE,
+			       (int *)(&retval));
+	  break;
+	case SYS_lseek:
+	  {
+	    /* the 64-bit offset is in the aligned pair a2/a3 (high word first),
+	       so whence is the fourth argument word, on the user stack */
+	    int whence;
+	    err = copyin((const_userptr_t)(tf->tf_sp + 16), &whence, sizeof(int));
+	    if (err) {
+	      break;
+	    }
+	    err = sys_lseek((int)tf->tf_a0,
+			    ((off_t)tf->tf_a2 << 32) | (off_t)tf->tf_a3,
+			    whence,
+			    &retval64);
+	    is64 = true;
+	  }
+	  break;
+	case SYS_close:
+	  err = sys_close((int)tf->tf_a0);
+	  break;
+	case SYS_dup2:
+	  err = sys_dup2((int)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (int *)(&retval));
+	  break;
 	case SYS__exit:
 	  sys__exit((int)tf->tf_a0);
 	  /* sys__exit does not return, execution should not get here */
@@ -137,6 +228,10 @@ syscall(struct trapframe *tf)
 	  err = sys_fork(tf, (pid_t *) &retval);
 	  break;
 
+	case SYS_vfork: 
+	  err = sys_vfork(tf, (pid_t *) &retval);
+	  break;
+
 	case SYS_execv:
 	  err = sys_execv((userptr_t) tf->tf_a0,
 			  (userptr_t)  tf->tf_a1);
@@ -148,6 +243,7 @@ syscall(struct trapframe *tf)
 	  break;
 	}
 
+	TRACEPOINT(TP_SYSCALL_EXIT, callno, err);
 
 	if (err) {
 		/*
@@ -158,6 +254,12 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+	else if (is64) {
+		/* Success, with a 64-bit return value in v0 (high) and v1 (low). */
+		tf->tf_v0 = (uint32_t)((uint64_t)retval64 >> 32);
+		tf->tf_v1 = (uint32_t)retval64;
+		tf->tf_a3 = 0;      /* signal no error */
+	}
 	else {
 		/* Success. */
 		tf->tf_v0 = retval;
@@ -191,19 +293,20 @@ syscall(struct trapframe *tf)
 //	(void)tf;
 //}
 
-// @param: 
+// @param: tf points at the child's p_forktf, a copy of the parent's trapframe
 void 
 enter_forked_process(void *tf, unsigned long what_is_this_used_for)
 {
 	(void) what_is_this_used_for;
+	/* mips_usermode wants the trapframe on our own kernel stack */
 	struct trapframe new_tf = *((struct trapframe*) tf); 
 	
 	new_tf.tf_v0 = 0; // return value from fork 
 	new_tf.tf_a3 = 0; // fork returned successfully in child 
 	
 	new_tf.tf_epc += 4; 
+
+	procstats_record(PROCSTAT_FORK_CHILD, curproc->p_fork_secs, curproc->p_fork_nsecs);
 	mips_usermode(&new_tf);
-	
-	kfree(tf); // free copy_tf ?????? 
+	/* mips_usermode does not return */
 }
-
@@ -37,6 +37,8 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <tracepoint.h>
+#include <pagecache.h>
 
 #include <syscall.h>
 #include <kern/wait.h>
@@ -56,6 +58,7 @@
 static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 static volatile struct pageitem * coremap; 
 static volatile unsigned long totalpages; 
+static volatile unsigned long freepages;	/* pages not occupied */
 static volatile bool memory_for_bootstrap = true;
 
 static paddr_t paddrlow; 
@@ -81,6 +84,7 @@ vm_bootstrap(void)
 	coremap = (struct pageitem *) PADDR_TO_KVADDR(paddrlow); 
 
 	totalpages -= 1; // for safe measure lmao
+	freepages = totalpages - coremappages;
 
 	for (unsigned long i = 0; i < totalpages; i++)
 	{
@@ -107,7 +111,10 @@ static
 bool 
 is_adequate_block(unsigned long i, unsigned long npages)
 {
-	for (unsigned long k = i; k < i + npages; k++)
+	// (a run that would go off the end of memory doesn't count)
+	if (i + npages > totalpages)
+		return false;
+	for (unsigned long k = 0; k < npages; k++)
 	{
 		if (coremap[i + k].occupied)
 			return false;
@@ -125,6 +132,7 @@ occupy_pages(unsigned long i, unsigned long npages)
 		{
 			coremap[i + k].occupied = true;
 			coremap[i + k].blocksize = npages - k;
+			freepages--;
 		}
 		else 
 		{
@@ -148,9 +156,8 @@ ram_borrowmem(unsigned long npages)
 		}
 		
 	}
-	panic("WE RAN OUT OF MEMORY ????? ");
-	// it should not return 
-	return 1;
+	// Out of memory: let the caller decide what to do about it
+	return 0;
 }
 
 //static 
@@ -179,6 +186,17 @@ getppages(unsigned long npages)
 	else 
 		addr = ram_borrowmem(npages);
 	spinlock_release(&stealmem_lock);
+
+	/*
+	 * Out of memory: get the exec page cache to give some back and
+	 * try again. If that doesn't help, fail, and alloc_kpages and
+	 * as_prepare_load pass it on as 0 or ENOMEM.
+	 */
+	if (addr == 0 && !memory_for_bootstrap && pagecache_shrink() > 0) {
+		spinlock_acquire(&stealmem_lock);
+		addr = ram_borrowmem(npages);
+		spinlock_release(&stealmem_lock);
+	}
 	return addr;
 }
 
@@ -192,6 +210,7 @@ free_corepages(paddr_t addr)
 	//kprintf("FREE CORE PAGES AT %lu , %lu\n", index, (unsigned long) addr); // DEBUGGING
 
 	coremap[index].occupied = 0; 
+	freepages += coremap[index].blocksize;
 	for (unsigned long i = 1; i < coremap[index].blocksize; i++)
 	{
 		coremap[index + i].occupied = 0; 
@@ -202,6 +221,21 @@ free_corepages(paddr_t addr)
 	spinlock_release(&stealmem_lock);
 }
 
+/*
+ * Number of physical pages not in use, for caches that want to know
+ * whether memory is getting tight. Zero until the coremap exists.
+ */
+unsigned long
+vm_freepages(void)
+{
+	unsigned long n;
+
+	spinlock_acquire(&stealmem_lock);
+	n = memory_for_bootstrap ? 0 : freepages;
+	spinlock_release(&stealmem_lock);
+	return n;
+}
+
 /* Allocate/free some kernel-space virtual pages */
 vaddr_t 
 alloc_kpages(int npages)
@@ -263,6 +297,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
+	TRACEPOINT(TP_VM_FAULT, faulttype, faultaddress);
 
 	switch (faulttype) {
 		case VM_FAULT_READONLY:
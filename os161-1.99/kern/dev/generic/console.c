@@ -46,8 +46,15 @@
  * and (2) if the system crashes before we find a console, no output
  * at all may appear.
  *
- * Note that we have no input buffering; characters typed too rapidly
- * will be lost.
+ * Output is buffered: a thread printing puts its characters in a ring
+ * buffer and goes on its way, sleeping only if the ring is full, and
+ * the device's write-done interrupt sends the next character. Printing
+ * by polling first sends whatever is still in the ring, so output
+ * stays in order, and a panic message comes out after everything
+ * printed before it.
+ *
+ * Input buffering is minimal (CONSOLE_INPUT_BUFFER_SIZE characters);
+ * characters typed too rapidly will be lost.
  */
 
 #include <types.h>
@@ -111,14 +118,57 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+/*
+ * Take the next character to send off the output ring. Returns false
+ * if the ring is empty. Called with cs_outlock held.
+ */
+static
+bool
+con_outbuf_take(struct con_softc *cs, int *ch)
+{
+	unsigned tail;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_outbuf_count == 0) {
+		return false;
+	}
+	tail = (cs->cs_outbuf_head + CONSOLE_OUTPUT_BUFFER_SIZE
+		- cs->cs_outbuf_count) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	*ch = cs->cs_outbuf[tail];
+	cs->cs_outbuf_count--;
+	return true;
+}
+
+//////////////////////////////////////////////////
+
 /*
  * Print a character, using polling instead of interrupts to wait for
  * I/O completion.
+ *
+ * Anything still waiting in the output ring goes first. (Unless we
+ * got here from inside the ring code itself, e.g. a panic while
+ * holding cs_outlock; then the ring is abandoned.)
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	unsigned freed = 0;
+	int qch;
+
+	if (!spinlock_do_i_hold(&cs->cs_outlock)) {
+		spinlock_acquire(&cs->cs_outlock);
+		while (con_outbuf_take(cs, &qch)) {
+			cs->cs_sendpolled(cs->cs_devdata, qch);
+			freed++;
+		}
+		spinlock_release(&cs->cs_outlock);
+		while (freed-- > 0) {
+			V(cs->cs_wsem);
+		}
+	}
+
 	cs->cs_sendpolled(cs->cs_devdata, ch);
 }
 
@@ -143,14 +193,36 @@ putch_complete_polled(struct con_softc *cs)
 //////////////////////////////////////////////////
 
 /*
- * Print a character, using interrupts to wait for I/O completion.
+ * Print a character, using interrupts to wait for I/O completion:
+ * put it in the output ring, and if the device is idle, start it.
  */
 static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
+	bool freed = false;
+	int next;
+
+	/* Wait for room */
 	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+
+	spinlock_acquire(&cs->cs_outlock);
+	KASSERT(cs->cs_outbuf_count < CONSOLE_OUTPUT_BUFFER_SIZE);
+	cs->cs_outbuf[cs->cs_outbuf_head] = ch;
+	cs->cs_outbuf_head =
+		(cs->cs_outbuf_head + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	cs->cs_outbuf_count++;
+
+	if (!cs->cs_sending && con_outbuf_take(cs, &next)) {
+		cs->cs_sending = true;
+		cs->cs_send(cs->cs_devdata, next);
+		freed = true;
+	}
+	spinlock_release(&cs->cs_outlock);
+
+	if (freed) {
+		V(cs->cs_wsem);
+	}
 }
 
 /*
@@ -198,13 +270,28 @@ con_input(void *vcs, int ch)
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next character from the output ring, if there is one.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
+	bool freed = false;
+	int ch;
+
+	spinlock_acquire(&cs->cs_outlock);
+	if (con_outbuf_take(cs, &ch)) {
+		cs->cs_send(cs->cs_devdata, ch);
+		freed = true;
+	}
+	else {
+		cs->cs_sending = false;
+	}
+	spinlock_release(&cs->cs_outlock);
 
-	V(cs->cs_wsem);
+	if (freed) {
+		V(cs->cs_wsem);
+	}
 }
 
 //////////////////////////////////////////////////
@@ -298,12 +385,19 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/*
+ * Writes are copied in from the caller this many bytes at a time.
+ */
+#define CON_WRITECHUNK 128
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
 	int result;
 	char ch;
+	char buf[CON_WRITECHUNK];
+	size_t len, i;
 	struct lock *lk;
 
 	(void)dev;  // unused
@@ -334,15 +428,21 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			len = uio->uio_resid;
+			if (len > sizeof(buf)) {
+				len = sizeof(buf);
+			}
+			result = uiomove(buf, len, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			for (i=0; i<len; i++) {
+				if (buf[i]=='\n') {
+					putch('\r');
+				}
+				putch(buf[i]);
 			}
-			putch(ch);
 		}
 	}
 	lock_release(lk);
@@ -378,6 +478,7 @@ attach_console_to_vfs(struct con_softc *cs)
 	dev->d_ioctl = con_ioctl;
 	dev->d_blocks = 0;
 	dev->d_blocksize = 1;
+	dev->d_bioq = NULL;
 	dev->d_data = cs;
 
 	result = vfs_adddev("con", dev, 0);
@@ -418,7 +519,7 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
+	wsem = sem_create("console write", CONSOLE_OUTPUT_BUFFER_SIZE);
 	if (wsem == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
@@ -441,6 +542,10 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outbuf_head = 0;
+	cs->cs_outbuf_count = 0;
+	cs->cs_sending = false;
 
 	the_console = cs;
 	con_userlock_read = rlk;
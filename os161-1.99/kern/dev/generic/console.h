@@ -35,9 +35,16 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output goes through a ring buffer: writers put characters in and
+ * return, and the write-done interrupt sends the next one. cs_wsem
+ * counts the free slots in the ring.
  */
 
+#include <spinlock.h>
+
 #define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -53,6 +60,12 @@ struct con_softc {
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	struct spinlock cs_outlock;	/* protects the rest of these */
+	unsigned char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outbuf_head;	/* next slot to put a char in */
+	unsigned cs_outbuf_count;	/* chars waiting to be sent */
+	bool cs_sending;		/* device is busy with a char */
 };
 
 /*
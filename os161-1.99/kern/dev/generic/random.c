@@ -131,6 +131,7 @@ config_random(struct random_softc *rs, int unit)
 	rs->rs_dev.d_ioctl = randioctl;
 	rs->rs_dev.d_blocks = 0;
 	rs->rs_dev.d_blocksize = 1;
+	rs->rs_dev.d_bioq = NULL;
 	rs->rs_dev.d_data = rs;
 
 	/* Add the VFS device structure to the VFS device list. */
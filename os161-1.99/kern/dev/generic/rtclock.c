@@ -38,6 +38,10 @@
  * of the available clocks to use, if more than one is available.
  *
  * The system will panic if gettime() is called and there is no clock.
+ *
+ * We also note the time when the clock is attached, so getuptime() can
+ * give the time since then. Nothing ever sets the clock, so that
+ * always goes forward, which makes it suitable for CLOCK_MONOTONIC.
  */
 
 #include <types.h>
@@ -48,6 +52,8 @@
 #include "autoconf.h"
 
 static struct rtclock_softc *the_clock = NULL;
+static time_t boot_secs;
+static uint32_t boot_nsecs;
 
 int
 config_rtclock(struct rtclock_softc *rtc, int unit)
@@ -59,6 +65,7 @@ config_rtclock(struct rtclock_softc *rtc, int unit)
 
 	KASSERT(the_clock==NULL);
 	the_clock = rtc;
+	gettime(&boot_secs, &boot_nsecs);
 	return 0;
 }
 
@@ -68,3 +75,13 @@ gettime(time_t *secs, uint32_t *nsecs)
 	KASSERT(the_clock!=NULL);
 	the_clock->rtc_gettime(the_clock->rtc_devdata, secs, nsecs);
 }
+
+void
+getuptime(time_t *secs, uint32_t *nsecs)
+{
+	time_t nowsecs;
+	uint32_t nownsecs;
+
+	gettime(&nowsecs, &nownsecs);
+	getinterval(boot_secs, boot_nsecs, nowsecs, nownsecs, secs, nsecs);
+}
@@ -48,6 +48,7 @@
 #include <array.h>
 #include <uio.h>
 #include <synch.h>
+#include <vm.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
@@ -170,6 +171,145 @@ emu_waitdone(struct emu_softc *sc)
 	return translate_err(sc, sc->e_result);
 }
 
+/*
+ * Read cache.
+ *
+ * Every trip to the emulator costs the same register writes, interrupt
+ * and context switch whatever its size, so small reads (the ELF and
+ * program headers when loading a program, stdio-sized reads from user
+ * programs) are expensive. Reads that don't cover whole pages go
+ * through a small cache of page-sized chunks instead. A miss fetches
+ * one page, or, if the read carries on from where the last one on the
+ * vnode ended, as much as the device hands over in one trip
+ * (EMU_MAXIO), which reads ahead into the pages after it.
+ *
+ * Another handle may have the same host file open, so any write or
+ * truncate empties the whole cache. Closing a handle forgets its
+ * chunks, since the emulator reuses handle numbers.
+ */
+
+static
+struct emu_rachunk *
+emu_ra_find(struct emu_softc *sc, uint32_t handle, uint32_t offset)
+{
+	struct emu_rachunk *rc;
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(sc->e_lock));
+
+	for (i=0; i<EMU_RACHUNKS; i++) {
+		rc = &sc->e_ra[i];
+		if (rc->rc_valid && rc->rc_handle == handle &&
+		    rc->rc_offset == offset) {
+			rc->rc_stamp = ++sc->e_rastamp;
+			return rc;
+		}
+	}
+	return NULL;
+}
+
+/* Pick a chunk to reuse: an empty one, or the least recently used. */
+static
+struct emu_rachunk *
+emu_ra_victim(struct emu_softc *sc)
+{
+	struct emu_rachunk *rc, *best = NULL;
+	unsigned i;
+
+	for (i=0; i<EMU_RACHUNKS; i++) {
+		rc = &sc->e_ra[i];
+		if (!rc->rc_valid) {
+			return rc;
+		}
+		if (best == NULL || (int)(rc->rc_stamp - best->rc_stamp) < 0) {
+			best = rc;
+		}
+	}
+	return best;
+}
+
+/* Forget everything cached for HANDLE. */
+static
+void
+emu_ra_forget(struct emu_softc *sc, uint32_t handle)
+{
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(sc->e_lock));
+
+	for (i=0; i<EMU_RACHUNKS; i++) {
+		if (sc->e_ra[i].rc_handle == handle) {
+			sc->e_ra[i].rc_valid = false;
+		}
+	}
+}
+
+/* Forget everything. */
+static
+void
+emu_ra_flush(struct emu_softc *sc)
+{
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(sc->e_lock));
+
+	for (i=0; i<EMU_RACHUNKS; i++) {
+		sc->e_ra[i].rc_valid = false;
+	}
+}
+
+/*
+ * Read LEN bytes (at least a page) of HANDLE at the page-aligned
+ * OFFSET into the cache, in one trip to the device.
+ */
+static
+int
+emu_ra_fill(struct emu_softc *sc, uint32_t handle, uint32_t offset,
+	    uint32_t len)
+{
+	struct emu_rachunk *rc;
+	uint32_t got, pos, n;
+	int result;
+
+	KASSERT(lock_do_i_hold(sc->e_lock));
+	KASSERT(offset % PAGE_SIZE == 0);
+	KASSERT(len >= PAGE_SIZE && len <= EMU_MAXIO);
+
+	emu_wreg(sc, REG_HANDLE, handle);
+	emu_wreg(sc, REG_IOLEN, len);
+	emu_wreg(sc, REG_OFFSET, offset);
+	emu_wreg(sc, REG_OPER, EMU_OP_READ);
+	result = emu_waitdone(sc);
+	if (result) {
+		return result;
+	}
+	got = emu_rreg(sc, REG_IOLEN);
+
+	/* Always keep the first page, even if it's empty (EOF) */
+	for (pos = 0; pos == 0 || pos < got; pos += PAGE_SIZE) {
+		n = got - pos;
+		if (n > PAGE_SIZE) {
+			n = PAGE_SIZE;
+		}
+
+		rc = emu_ra_find(sc, handle, offset + pos);
+		if (rc == NULL) {
+			rc = emu_ra_victim(sc);
+		}
+		memcpy(rc->rc_data, (char *)sc->e_iobuf + pos, n);
+		rc->rc_valid = true;
+		rc->rc_handle = handle;
+		rc->rc_offset = offset + pos;
+		rc->rc_len = n;
+		rc->rc_stamp = ++sc->e_rastamp;
+
+		if (n < PAGE_SIZE) {
+			break;
+		}
+	}
+	return 0;
+}
+
 /*
  * Common file open routine (for both VOP_LOOKUP and VOP_CREATE).  Not
  * for VOP_OPEN. At the hardware level, we need to "open" files in
@@ -237,6 +377,8 @@ emu_close(struct emu_softc *sc, uint32_t handle)
 		lock_acquire(sc->e_lock);
 	}
 
+	emu_ra_forget(sc, handle);
+
 	while (1) {
 		/* Retry operation up to 10 times */
 
@@ -302,6 +444,51 @@ emu_read(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	return emu_doread(sc, handle, len, EMU_OP_READ, uio);
 }
 
+/*
+ * Read from a hardware-level file handle through the read cache, up
+ * to the end of the page the uio's offset is in. On a miss, fetch LEN
+ * bytes starting at that page.
+ */
+static
+int
+emu_read_cached(struct emu_softc *sc, uint32_t handle, uint32_t len,
+		struct uio *uio)
+{
+	struct emu_rachunk *rc;
+	uint32_t base, delta, amt;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	base = uio->uio_offset - uio->uio_offset % PAGE_SIZE;
+	delta = uio->uio_offset - base;
+
+	lock_acquire(sc->e_lock);
+
+	rc = emu_ra_find(sc, handle, base);
+	if (rc == NULL) {
+		result = emu_ra_fill(sc, handle, base, len);
+		if (result) {
+			goto out;
+		}
+		rc = emu_ra_find(sc, handle, base);
+		KASSERT(rc != NULL);
+	}
+
+	/* Past the end of the chunk means past EOF; read nothing */
+	if (delta < rc->rc_len) {
+		amt = rc->rc_len - delta;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(rc->rc_data + delta, amt, uio);
+	}
+
+ out:
+	lock_release(sc->e_lock);
+	return result;
+}
+
 /*
  * Read a directory entry from a hardware-level file handle.
  */
@@ -327,6 +514,8 @@ emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 
 	lock_acquire(sc->e_lock);
 
+	emu_ra_flush(sc);
+
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
 	emu_wreg(sc, REG_OFFSET, uio->uio_offset);
@@ -377,6 +566,8 @@ emu_trunc(struct emu_softc *sc, uint32_t handle, off_t len)
 
 	lock_acquire(sc->e_lock);
 
+	emu_ra_flush(sc);
+
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
 	emu_wreg(sc, REG_OPER, EMU_OP_TRUNC);
@@ -408,17 +599,14 @@ emufs_open(struct vnode *v, int openflags)
 {
 	/*
 	 * At this level we do not need to handle O_CREAT, O_EXCL, or O_TRUNC.
-	 * We *would* need to handle O_APPEND, but we don't support it.
+	 * Nor O_APPEND: the file syscalls move to EOF before each write.
 	 *
 	 * Any of O_RDONLY, O_WRONLY, and O_RDWR are valid, so we don't need
 	 * to check that either.
 	 */
 
-	if (openflags & O_APPEND) {
-		return EUNIMP;
-	}
-
 	(void)v;
+	(void)openflags;
 
 	return 0;
 }
@@ -472,24 +660,28 @@ emufs_reclaim(struct vnode *v)
 	int result;
 
 	/*
-	 * Need both of these locks, e_lock to protect the device
-	 * and vfs_biglock to protect the fs-related material.
+	 * e_lock protects both the device and the table of vnodes;
+	 * emufs_loadvnode holds it too, so nobody can pick up a new
+	 * reference while we're here.
 	 */
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
-	if (ev->ev_v.vn_refcount != 1) {
+	spinlock_acquire(&v->vn_countlock);
+	if (v->vn_refcount != 1) {
+		/* consume the reference VOP_DECREF gave us */
+		KASSERT(v->vn_refcount>1);
+		v->vn_refcount--;
+		spinlock_release(&v->vn_countlock);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
 
 	/* emu_close retries on I/O error */
 	result = emu_close(ev->ev_emu, ev->ev_handle);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -513,7 +705,6 @@ emufs_reclaim(struct vnode *v)
 	VOP_CLEANUP(&ev->ev_v);
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	kfree(ev);
 	return 0;
@@ -534,17 +725,32 @@ emufs_read(struct vnode *v, struct uio *uio)
 	KASSERT(uio->uio_rw==UIO_READ);
 
 	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
-		}
-
 		oldresid = uio->uio_resid;
 
-		result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
+		if (uio->uio_offset % PAGE_SIZE == 0 &&
+		    uio->uio_resid >= PAGE_SIZE) {
+			/*
+			 * Whole pages: copy straight from the device's
+			 * buffer to the caller's, skipping the cache.
+			 */
+			amt = uio->uio_resid - uio->uio_resid % PAGE_SIZE;
+			if (amt > EMU_MAXIO) {
+				amt = EMU_MAXIO;
+			}
+			result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
+		}
+		else {
+			/* Read ahead if this follows on from the last read */
+			amt = uio->uio_offset == ev->ev_ranext ?
+				EMU_MAXIO : PAGE_SIZE;
+			result = emu_read_cached(ev->ev_emu, ev->ev_handle,
+						 amt, uio);
+		}
 		if (result) {
 			return result;
 		}
+
+		ev->ev_ranext = uio->uio_offset;
 		
 		if (uio->uio_resid == oldresid) {
 			/* nothing read - EOF */
@@ -1153,7 +1359,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
 	num = vnodearray_num(ef->ef_vnodes);
@@ -1166,7 +1371,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			VOP_INCREF(&ev->ev_v);
 
 			lock_release(ef->ef_emu->e_lock);
-			vfs_biglock_release();
 			*ret = ev;
 			return 0;
 		}
@@ -1182,12 +1386,12 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_ranext = 0;
 
 	result = VOP_INIT(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			   &ef->ef_fs, ev);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
@@ -1197,13 +1401,11 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 		/* note: VOP_CLEANUP undoes VOP_INIT - it does not kfree */
 		VOP_CLEANUP(&ev->ev_v);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	*ret = ev;
 	return 0;
@@ -1333,6 +1535,7 @@ int
 config_emu(struct emu_softc *sc, int emuno)
 {
 	char name[32];
+	unsigned i;
 
 	sc->e_lock = lock_create("emufs-lock");
 	if (sc->e_lock == NULL) {
@@ -1346,6 +1549,26 @@ config_emu(struct emu_softc *sc, int emuno)
 	}
 	sc->e_iobuf = bus_map_area(sc->e_busdata, sc->e_buspos, EMU_BUFFER);
 
+	for (i=0; i<EMU_RACHUNKS; i++) {
+		sc->e_ra[i].rc_valid = false;
+		sc->e_ra[i].rc_handle = 0;
+		sc->e_ra[i].rc_offset = 0;
+		sc->e_ra[i].rc_len = 0;
+		sc->e_ra[i].rc_stamp = 0;
+		sc->e_ra[i].rc_data = kmalloc(PAGE_SIZE);
+		if (sc->e_ra[i].rc_data == NULL) {
+			while (i-- > 0) {
+				kfree(sc->e_ra[i].rc_data);
+			}
+			sem_destroy(sc->e_sem);
+			sc->e_sem = NULL;
+			lock_destroy(sc->e_lock);
+			sc->e_lock = NULL;
+			return ENOMEM;
+		}
+	}
+	sc->e_rastamp = 0;
+
 	snprintf(name, sizeof(name), "emu%d", emuno);
 
 	return emufs_addtovfs(sc, name);
@@ -34,6 +34,22 @@
 #define EMU_MAXIO       16384
 #define EMU_ROOTHANDLE  0
 
+/* Number of page-sized chunks in the read cache */
+#define EMU_RACHUNKS    8
+
+/*
+ * A page-sized piece of a file, kept from an earlier read. RC_LEN is
+ * less than a page if the file ended there.
+ */
+struct emu_rachunk {
+	bool rc_valid;
+	uint32_t rc_handle;
+	uint32_t rc_offset;		/* page-aligned */
+	uint32_t rc_len;
+	unsigned rc_stamp;		/* for LRU replacement */
+	char *rc_data;
+};
+
 /*
  * The per-device data used by the emufs device driver.
  * (Note that this is only a small portion of its actual data;
@@ -51,6 +67,10 @@ struct emu_softc {
 	struct semaphore *e_sem;
 	void *e_iobuf;
 
+	/* Read cache; protected by e_lock */
+	struct emu_rachunk e_ra[EMU_RACHUNKS];
+	unsigned e_rastamp;
+
 	/* Written by the interrupt handler */
 	uint32_t e_result;
 };
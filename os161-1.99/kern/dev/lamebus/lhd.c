@@ -38,6 +38,8 @@
 #include <synch.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <bioq.h>
+#include <tracepoint.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -194,11 +196,21 @@ lhd_reset(struct lhd_softc *lh)
 #endif
 
 /*
- * I/O function (for both reads and writes)
+ * Raw I/O function (for both reads and writes); called by the request
+ * queue's worker thread, or directly for user-space transfers.
+ *
+ * The hardware transfers one sector per operation, through the
+ * sector-sized buffer at LHD_BUFFER, so a request for several sectors
+ * is still done a sector at a time. But we keep the device for the
+ * whole request, so that a multi-sector request (which the buffer
+ * cache makes out of runs of consecutive blocks) goes to the disk as
+ * one uninterrupted stream, each sector started as soon as the
+ * previous one finishes, instead of interleaved with other threads'
+ * I/O and paying a seek or a rotation between sectors.
  */
 static
 int
-lhd_io(struct device *d, struct uio *uio)
+lhd_rawio(struct device *d, struct uio *uio)
 {
 	struct lhd_softc *lh = d->d_data;
 
@@ -225,12 +237,16 @@ lhd_io(struct device *d, struct uio *uio)
 		statval |= LHD_ISWRITE;
 	}
 
+	/* Wait until nobody else is using the device. */
+	P(lh->lh_clear);
+
+	TRACEPOINT(TP_DISK_START, sector,
+		   (statval & LHD_ISWRITE) ? (len | TRACE_DISK_WRITE) : len);
+
 	/* Loop over all the sectors we were asked to do. */
+	result = 0;
 	for (i=0; i<len; i++) {
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
-
 		/*
 		 * Are we writing? If so, transfer the data to the
 		 * on-card buffer.
@@ -238,8 +254,7 @@ lhd_io(struct device *d, struct uio *uio)
 		if (uio->uio_rw == UIO_WRITE) {
 			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
 			if (result) {
-				V(lh->lh_clear);
-				return result;
+				break;
 			}
 		}
 
@@ -263,16 +278,37 @@ lhd_io(struct device *d, struct uio *uio)
 			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
 		}
 
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
-
-		/* If we failed, return the error. */
+		/* If we failed, stop and return the error. */
 		if (result) {
-			return result;
+			break;
 		}
 	}
 
-	return 0;
+	TRACEPOINT(TP_DISK_DONE, sector, result);
+
+	/* Tell another thread it's cleared to go ahead. */
+	V(lh->lh_clear);
+
+	return result;
+}
+
+/*
+ * I/O function (for both reads and writes)
+ *
+ * Kernel transfers go through the request queue, to be scheduled
+ * along with everyone else's. The queue's worker thread can't reach a
+ * user address space, so user transfers (reads and writes of lhdNraw)
+ * are done directly; lh_clear keeps them from colliding with the
+ * worker.
+ */
+static
+int
+lhd_io(struct device *d, struct uio *uio)
+{
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		return bioq_io(d->d_bioq, uio);
+	}
+	return lhd_rawio(d, uio);
 }
 
 /*
@@ -311,6 +347,17 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	lh->lh_dev.d_blocksize = LHD_SECTSIZE;
 	lh->lh_dev.d_data = lh;
 
+	/* Create the request queue (and its worker thread). */
+	lh->lh_dev.d_bioq = bioq_create(name, &lh->lh_dev, lhd_rawio);
+	if (lh->lh_dev.d_bioq == NULL) {
+		sem_destroy(lh->lh_done);
+		sem_destroy(lh->lh_clear);
+		lh->lh_done = lh->lh_clear = NULL;
+		return ENOMEM;
+	}
+	kprintf("%s: %u sectors, %u rpm\n", name,
+		(unsigned)lh->lh_dev.d_blocks, lhd_rdreg(lh, LHD_REG_RPM));
+
 	/* Add the VFS device structure to the VFS device list. */
 	return vfs_adddev(name, &lh->lh_dev, 1);
 }
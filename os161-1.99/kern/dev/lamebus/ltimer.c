@@ -88,8 +88,9 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 		havetimerclock = true;
 		lt->lt_timerclock = 1;
 
-		/* Wire it to go off once every 10 ms */
+		/* Wire it to go off once every LT_GRANULARITY usec */
 		/* KMS: reduced this from 1s to 10ms */
+		/* Now 1ms, for the resolution of the timer wheel */
 		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
 		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
 				   LT_GRANULARITY);
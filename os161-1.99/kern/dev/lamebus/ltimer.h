@@ -46,7 +46,7 @@ struct ltimer_softc {
 
 /* Granularity of countdown timer (usec) */
 /* Should be less than 1000000 */
-#define LT_GRANULARITY   10000
+#define LT_GRANULARITY   1000
 
 /* Functions called by lower-level drivers */
 void ltimer_irq(/*struct ltimer_softc*/ void *lt);  // interrupt handler
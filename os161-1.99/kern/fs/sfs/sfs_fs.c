@@ -39,8 +39,10 @@
 #include <array.h>
 #include <bitmap.h>
 #include <uio.h>
+#include <synch.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 
 /* Shortcuts for the size macros in kern/sfs.h */
@@ -111,11 +113,10 @@ int
 sfs_sync(struct fs *fs)
 {
 	struct sfs_fs *sfs; 
+	struct vnode **vns;
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
 	 *
@@ -148,18 +149,45 @@ sfs_sync(struct fs *fs)
 
 	sfs = fs->fs_data;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
+	/*
+	 * Go over the array of loaded vnodes, writing their inodes to
+	 * the buffer cache. (Not VOP_FSYNC, which would write each
+	 * file's blocks separately; the cache is written out once, at
+	 * the end.) That takes the vnode's lock, which comes before
+	 * sfs_vnlock, so first take a reference to each one (so they
+	 * stay put) and let go of the table.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
 	num = vnodearray_num(sfs->sfs_vnodes);
+	vns = NULL;
+	if (num > 0) {
+		vns = kmalloc(num * sizeof(struct vnode *));
+		if (vns == NULL) {
+			lock_release(sfs->sfs_vnlock);
+			return ENOMEM;
+		}
+	}
 	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		vns[i] = vnodearray_get(sfs->sfs_vnodes, i);
+		VOP_INCREF(vns[i]);
+	}
+	lock_release(sfs->sfs_vnlock);
+
+	for (i=0; i<num; i++) {
+		sfs_syncinode(vns[i]);
+		VOP_DECREF(vns[i]);
+	}
+	if (vns != NULL) {
+		kfree(vns);
 	}
 
+	lock_acquire(sfs->sfs_freemaplock);
+
 	/* If the free block map needs to be written, write it. */
 	if (sfs->sfs_freemapdirty) {
 		result = sfs_mapio(sfs, UIO_WRITE);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_freemapdirty = false;
@@ -169,14 +197,16 @@ sfs_sync(struct fs *fs)
 	if (sfs->sfs_superdirty) {
 		result = sfs_wblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_superdirty = false;
 	}
 
-	vfs_biglock_release();
-	return 0;
+	lock_release(sfs->sfs_freemaplock);
+
+	/* Finally, write out everything the above left in the buffer cache. */
+	return buffer_sync(sfs->sfs_device);
 }
 
 /*
@@ -189,13 +219,9 @@ const char *
 sfs_getvolname(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
-	const char *ret;
-
-	vfs_biglock_acquire();
-	ret = sfs->sfs_super.sp_volname;
-	vfs_biglock_release();
 
-	return ret;
+	/* The volume name never changes while mounted; no lock needed */
+	return sfs->sfs_super.sp_volname;
 }
 
 /*
@@ -209,13 +235,17 @@ sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
 
-	vfs_biglock_acquire();
-	
-	/* Do we have any files open? If so, can't unmount. */
+	/*
+	 * Do we have any files open? If so, can't unmount. (vfs_unmount
+	 * holds vfs_listlock, so no new ones can be opened: the only
+	 * way in is through vfs_getroot or a vnode we'd see here.)
+	 */
+	lock_acquire(sfs->sfs_vnlock);
 	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
+	lock_release(sfs->sfs_vnlock);
 
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
@@ -224,6 +254,11 @@ sfs_unmount(struct fs *fs)
 	/* Once we start nuking stuff we can't fail. */
 	vnodearray_destroy(sfs->sfs_vnodes);
 	bitmap_destroy(sfs->sfs_freemap);
+	lock_destroy(sfs->sfs_freemaplock);
+	lock_destroy(sfs->sfs_vnlock);
+
+	/* Drop our (clean, after sfs_sync) blocks from the buffer cache */
+	buffer_invalidate(sfs->sfs_device);
 	
 	/* The vfs layer takes care of the device for us */
 	(void)sfs->sfs_device;
@@ -232,7 +267,6 @@ sfs_unmount(struct fs *fs)
 	kfree(sfs);
 
 	/* nothing else to do */
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -255,9 +289,13 @@ int
 sfs_domount(void *options, struct device *dev, struct fs **ret)
 {
 	int result;
+	unsigned i;
 	struct sfs_fs *sfs;
 
-	vfs_biglock_acquire();
+	/*
+	 * vfs_mount holds vfs_listlock, so nobody else can be mounting
+	 * this device, and nobody can see the new fs until we're done.
+	 */
 
 	/* We don't pass any options through mount */
 	(void)options;
@@ -278,14 +316,12 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	 * don't do that in sfs.)
 	 */
 	if (dev->d_blocksize != SFS_BLOCKSIZE) {
-		vfs_biglock_release();
 		return ENXIO;
 	}
 
 	/* Allocate object */
 	sfs = kmalloc(sizeof(struct sfs_fs));
 	if (sfs==NULL) {
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
@@ -293,7 +329,24 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	sfs->sfs_vnodes = vnodearray_create();
 	if (sfs->sfs_vnodes == NULL) {
 		kfree(sfs);
-		vfs_biglock_release();
+		return ENOMEM;
+	}
+	for (i=0; i<SFS_VHASHSIZE; i++) {
+		sfs->sfs_vhash[i] = NULL;
+	}
+
+	/* Allocate locks */
+	sfs->sfs_vnlock = lock_create("sfs_vnlock");
+	if (sfs->sfs_vnlock == NULL) {
+		vnodearray_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
+		return ENOMEM;
+	}
+	sfs->sfs_freemaplock = lock_create("sfs_freemaplock");
+	if (sfs->sfs_freemaplock == NULL) {
+		lock_destroy(sfs->sfs_vnlock);
+		vnodearray_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
 		return ENOMEM;
 	}
 
@@ -303,9 +356,10 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load superblock */
 	result = sfs_rblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 	if (result) {
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -316,9 +370,22 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			"(0x%x, should be 0x%x)\n", 
 			sfs->sfs_super.sp_magic,
 			SFS_MAGIC);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
+		vnodearray_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
+		return EINVAL;
+	}
+
+	if (sfs->sfs_super.sp_version != SFS_VERSION) {
+		/* Volumes from before there was a version number have 0 */
+		kprintf("sfs: Volume has format version %u, not %u "
+			"(remake it with mksfs)\n",
+			sfs->sfs_super.sp_version, SFS_VERSION);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return EINVAL;
 	}
 	
@@ -333,17 +400,19 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load free space bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_BITMAPSIZE(sfs));
 	if (sfs->sfs_freemap == NULL) {
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 	result = sfs_mapio(sfs, UIO_READ);
 	if (result) {
 		bitmap_destroy(sfs->sfs_freemap);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		vnodearray_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -361,7 +430,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -43,24 +43,70 @@
 #include <synch.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 			 struct sfs_vnode **ret);
 
+/* In the space allocation section */
+static void sfs_unprealloc(struct sfs_vnode *sv);
+
 ////////////////////////////////////////////////////////////
 //
 // Simple stuff
 
+/* Bucket of sfs_vhash for inode INO */
+static
+unsigned
+sfs_vhashfunc(uint32_t ino)
+{
+	return ino % SFS_VHASHSIZE;
+}
+
+/*
+ * Lock and unlock a vnode. The assertions check the lock order in
+ * design/fslocking.txt as far as can be checked here: vnode locks
+ * come before sfs_freemaplock, and after sfs_vnlock only for a vnode
+ * being reclaimed, which nobody else can get at.
+ */
+static
+void
+sfs_lock(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+
+	KASSERT(!lock_do_i_hold(sfs->sfs_freemaplock));
+	KASSERT(!lock_do_i_hold(sfs->sfs_vnlock) ||
+		sv->sv_v.vn_refcount == 1);
+	lock_acquire(sv->sv_lock);
+}
+
+static
+void
+sfs_unlock(struct sfs_vnode *sv)
+{
+	lock_release(sv->sv_lock);
+}
+
 /* Zero out a disk block. */
 static
 int
 sfs_clearblock(struct sfs_fs *sfs, uint32_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
-	return sfs_wblock(sfs, zeros, block);
+	struct buf *b;
+	int result;
+
+	/* No need to read it first; we're overwriting all of it. */
+	result = buffer_get(sfs->sfs_device, block, &b);
+	if (result) {
+		return result;
+	}
+	bzero(buffer_map(b), SFS_BLOCKSIZE);
+	buffer_mark_dirty(b);
+	buffer_release(b);
+	return 0;
 }
 
 /* Write an on-disk inode structure back out to disk. */
@@ -68,6 +114,9 @@ static
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	sfs_unprealloc(sv);
 	if (sv->sv_dirty) {
 		struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 		int result = sfs_wblock(sfs, &sv->sv_i, sv->sv_ino);
@@ -84,19 +133,23 @@ sfs_sync_inode(struct sfs_vnode *sv)
 // Space allocation
 
 /*
- * Allocate a block.
+ * Allocate a block, as close after GOAL as possible. (Pass a goal past
+ * the end of the disk for "anywhere".)
  */
 static
 int
-sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, uint32_t goal, uint32_t *diskblock)
 {
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
+		lock_release(sfs->sfs_freemaplock);
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 
 	if (*diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: balloc: invalid block %u\n", *diskblock);
@@ -106,6 +159,86 @@ sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
 	return sfs_clearblock(sfs, *diskblock);
 }
 
+/*
+ * Give back the blocks reserved for a file that it didn't use. This
+ * happens whenever the inode is synced, so the freemap written to
+ * disk never has blocks marked in use that no file owns.
+ */
+static
+void
+sfs_unprealloc(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+
+	if (sv->sv_npreallocs == 0) {
+		return;
+	}
+
+	lock_acquire(sfs->sfs_freemaplock);
+	while (sv->sv_npreallocs > 0) {
+		bitmap_unmark(sfs->sfs_freemap, sv->sv_prealloc);
+		sv->sv_prealloc++;
+		sv->sv_npreallocs--;
+	}
+	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
+}
+
+/*
+ * Allocate a block for file SV: the next block after the last one it
+ * got, if that's free, so that files written in order are laid out in
+ * order. If the file is being appended to (APPENDING), also reserve
+ * the free blocks that follow, up to SFS_PREALLOC of them, so that
+ * other files being written at the same time don't get interleaved
+ * with this one and the next few allocations are free.
+ */
+static
+int
+sfs_balloc_file(struct sfs_vnode *sv, bool appending, uint32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t goal, block;
+	int result;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	if (sv->sv_npreallocs > 0) {
+		*diskblock = sv->sv_prealloc;
+		sv->sv_prealloc++;
+		sv->sv_npreallocs--;
+		result = sfs_clearblock(sfs, *diskblock);
+		if (result) {
+			return result;
+		}
+		sv->sv_bgoal = *diskblock + 1;
+		return 0;
+	}
+
+	/* With nothing to go on yet, start next to the inode */
+	goal = sv->sv_bgoal != 0 ? sv->sv_bgoal : sv->sv_ino + 1;
+
+	result = sfs_balloc(sfs, goal, diskblock);
+	if (result) {
+		return result;
+	}
+	sv->sv_bgoal = *diskblock + 1;
+
+	if (appending) {
+		lock_acquire(sfs->sfs_freemaplock);
+		sv->sv_prealloc = *diskblock + 1;
+		for (block = sv->sv_prealloc;
+		     block < sfs->sfs_super.sp_nblocks &&
+			     sv->sv_npreallocs < SFS_PREALLOC &&
+			     !bitmap_isset(sfs->sfs_freemap, block);
+		     block++) {
+			bitmap_mark(sfs->sfs_freemap, block);
+			sv->sv_npreallocs++;
+		}
+		lock_release(sfs->sfs_freemaplock);
+	}
+	return 0;
+}
+
 /*
  * Free a block.
  */
@@ -113,8 +246,17 @@ static
 void
 sfs_bfree(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	/*
+	 * Its contents no longer matter; don't write them back. Do this
+	 * first, while the block is still ours: once it's marked free,
+	 * someone else may allocate it and start filling its buffer.
+	 */
+	buffer_drop(sfs->sfs_device, diskblock);
+
+	lock_acquire(sfs->sfs_freemaplock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 }
 
 /*
@@ -124,11 +266,16 @@ static
 int
 sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	int ret;
+
 	if (diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: sfs_bused called on out of range block %u\n", 
 		      diskblock);
 	}
-	return bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	ret = bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_release(sfs->sfs_freemaplock);
+	return ret;
 }
 
 ////////////////////////////////////////////////////////////
@@ -136,150 +283,253 @@ sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 // Block mapping/inode maintenance
 
 /*
- * Look up the disk block number (from 0 up to the number of blocks on
- * the disk) given a file and the logical block number within that
- * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * Find the extent of the file that maps FILEBLOCK. Returns its index,
+ * or, if no extent maps FILEBLOCK, the index of the first extent past
+ * it (which is sfi_nextents if there is none). Because the extents are
+ * kept in order, this is the first extent that ends past FILEBLOCK.
  */
 static
-int
-sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
-	 uint32_t *diskblock)
+unsigned
+sfs_extent_find(const struct sfs_inode *sfi, uint32_t fileblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
-	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-	uint32_t block;
-	uint32_t idblock;
-	uint32_t idnum, idoff;
-	int result;
-
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
-	/*
-	 * If the block we want is one of the direct blocks...
-	 */
-	if (fileblock < SFS_NDIRECT) {
-		/*
-		 * Get the block number
-		 */
-		block = sv->sv_i.sfi_direct[fileblock];
-
-		/*
-		 * Do we need to allocate?
-		 */
-		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
-			if (result) {
-				return result;
-			}
+	const struct sfs_extent *se;
+	unsigned i;
 
-			/* Remember what we allocated; mark inode dirty */
-			sv->sv_i.sfi_direct[fileblock] = block;
-			sv->sv_dirty = true;
+	for (i=0; i<sfi->sfi_nextents; i++) {
+		se = &sfi->sfi_extents[i];
+		if (fileblock < se->se_fileblock + se->se_nblocks) {
+			break;
 		}
+	}
+	return i;
+}
 
-		/*
-		 * Hand back the block
-		 */
-		if (block != 0 && !sfs_bused(sfs, block)) {
-			panic("sfs: Data block %u (block %u of file %u) "
-			      "marked free\n", block, fileblock, sv->sv_ino);
+/*
+ * Record that FILEBLOCK, which nothing maps yet, is now at DISKBLOCK,
+ * in the extent table. If the block continues the extent before it
+ * (or comes just ahead of the one after it) on disk as well as in the
+ * file, that extent just gets longer; otherwise it needs an extent of
+ * its own. Returns false if there's no room for one.
+ */
+static
+bool
+sfs_extent_add(struct sfs_vnode *sv, uint32_t fileblock, uint32_t diskblock)
+{
+	struct sfs_inode *sfi = &sv->sv_i;
+	struct sfs_extent *prev, *next;
+	unsigned i, n;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	n = sfi->sfi_nextents;
+	i = sfs_extent_find(sfi, fileblock);
+	prev = i > 0 ? &sfi->sfi_extents[i-1] : NULL;
+	next = i < n ? &sfi->sfi_extents[i] : NULL;
+	KASSERT(next == NULL || next->se_fileblock > fileblock);
+
+	if (prev != NULL &&
+	    prev->se_fileblock + prev->se_nblocks == fileblock &&
+	    prev->se_diskblock + prev->se_nblocks == diskblock) {
+		prev->se_nblocks++;
+
+		/* If that closed the gap to the next one, merge them */
+		if (next != NULL &&
+		    next->se_fileblock == fileblock + 1 &&
+		    next->se_diskblock == diskblock + 1) {
+			prev->se_nblocks += next->se_nblocks;
+			memmove(next, next + 1, (n - i - 1) * sizeof(*next));
+			bzero(&sfi->sfi_extents[n-1], sizeof(*next));
+			sfi->sfi_nextents--;
 		}
-		*diskblock = block;
-		return 0;
+	}
+	else if (next != NULL &&
+		 next->se_fileblock == fileblock + 1 &&
+		 next->se_diskblock == diskblock + 1) {
+		next->se_fileblock--;
+		next->se_diskblock--;
+		next->se_nblocks++;
+	}
+	else if (n < SFS_NEXTENTS) {
+		memmove(&sfi->sfi_extents[i+1], &sfi->sfi_extents[i],
+			(n - i) * sizeof(sfi->sfi_extents[0]));
+		sfi->sfi_extents[i].se_fileblock = fileblock;
+		sfi->sfi_extents[i].se_diskblock = diskblock;
+		sfi->sfi_extents[i].se_nblocks = 1;
+		sfi->sfi_nextents++;
+	}
+	else {
+		return false;
 	}
 
-	/*
-	 * It's not a direct block; it must be in the indirect block.
-	 * Subtract off the number of direct blocks, so FILEBLOCK is
-	 * now the offset into the indirect block space.
-	 */
+	sv->sv_dirty = true;
+	return true;
+}
 
-	fileblock -= SFS_NDIRECT;
+/*
+ * Look up FILEBLOCK in the indirect trees. If it isn't there and
+ * NEWBLOCK isn't 0, put NEWBLOCK there, allocating indirect blocks
+ * on the way down as needed.
+ */
+static
+int
+sfs_itree(struct sfs_vnode *sv, uint32_t fileblock, uint32_t newblock,
+	  uint32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *idbuf;
+	uint32_t *iddata, *rootp;
+	uint32_t offset, span, index, block;
+	int result;
 
-	/* Get the indirect block number and offset w/i that indirect block */
-	idnum = fileblock / SFS_DBPERIDB;
-	idoff = fileblock % SFS_DBPERIDB;
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+	KASSERT(fileblock < SFS_MAXFILEBLOCKS);
 
 	/*
-	 * We only have one indirect block. If the offset we were asked for
-	 * is too large, we can't handle it, so fail.
+	 * Pick the tree. OFFSET is the block's position within it, and
+	 * SPAN the number of file blocks each entry of its top block
+	 * covers.
 	 */
-	if (idnum > 0) {
-		return EFBIG;
+	if (fileblock < SFS_DIDBASE) {
+		rootp = &sv->sv_i.sfi_indirect;
+		offset = fileblock;
+		span = 1;
 	}
-
-	/* Get the disk block number of the indirect block. */
-	idblock = sv->sv_i.sfi_indirect;
-
-	if (idblock==0 && !doalloc) {
-		/*
-		 * There's no indirect block allocated. We weren't
-		 * asked to allocate anything, so pretend the indirect
-		 * block was filled with all zeros.
-		 */
-		*diskblock = 0;
-		return 0;
+	else if (fileblock < SFS_TIDBASE) {
+		rootp = &sv->sv_i.sfi_dindirect;
+		offset = fileblock - SFS_DIDBASE;
+		span = SFS_DBPERIDB;
 	}
-	else if (idblock==0) {
-		/*
-		 * There's no indirect block allocated, but we need to
-		 * allocate a block whose number needs to be stored in
-		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
-		 */
-		result = sfs_balloc(sfs, &idblock);
+	else {
+		rootp = &sv->sv_i.sfi_tindirect;
+		offset = fileblock - SFS_TIDBASE;
+		span = SFS_DBPERIDB * SFS_DBPERIDB;
+	}
+
+	block = *rootp;
+	if (block == 0) {
+		if (newblock == 0) {
+			/* No tree at all; it's a hole */
+			*diskblock = 0;
+			return 0;
+		}
+		/* (sfs_balloc_file clears it for us.) */
+		result = sfs_balloc_file(sv, false, &block);
 		if (result) {
 			return result;
 		}
-
-		/* Remember the block we just allocated */
-		sv->sv_i.sfi_indirect = idblock;
-
-		/* Mark the inode dirty */
+		*rootp = block;
 		sv->sv_dirty = true;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
+
+	/* Walk down, one indirect block per level. */
+	while (1) {
+		result = buffer_read(sfs->sfs_device, block, &idbuf);
 		if (result) {
 			return result;
 		}
+		iddata = buffer_map(idbuf);
+
+		index = offset / span;
+		offset %= span;
+		block = iddata[index];
+
+		if (block == 0 && newblock != 0) {
+			if (span == 1) {
+				block = newblock;
+			}
+			else {
+				result = sfs_balloc_file(sv, false, &block);
+				if (result) {
+					buffer_release(idbuf);
+					return result;
+				}
+			}
+			iddata[index] = block;
+			buffer_mark_dirty(idbuf);
+		}
+		buffer_release(idbuf);
+
+		if (span == 1 || block == 0) {
+			break;
+		}
+		span /= SFS_DBPERIDB;
 	}
 
-	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	KASSERT(newblock == 0 || block == newblock);
+	*diskblock = block;
+	return 0;
+}
 
-	/* If there's no block there, allocate one */
-	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
-		if (result) {
-			return result;
+/*
+ * Look up the disk block number (from 0 up to the number of blocks on
+ * the disk) given a file and the logical block number within that
+ * file. If DOALLOC is set, and no such block exists, one will be
+ * allocated.
+ *
+ * The extents are checked first and then the indirect trees; see
+ * <kern/sfs.h>. A new block goes in the extent table if it can.
+ */
+static
+int
+sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
+	 uint32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	const struct sfs_extent *se;
+	uint32_t block;
+	unsigned i;
+	bool appending;
+	int result;
+
+	KASSERT(SFS_DBPERIDB*sizeof(uint32_t)==SFS_BLOCKSIZE);
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	if (fileblock >= SFS_MAXFILEBLOCKS) {
+		if (doalloc) {
+			return EFBIG;
 		}
+		/* Nothing can be there */
+		*diskblock = 0;
+		return 0;
+	}
 
-		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+	/* Is it in an extent? */
+	i = sfs_extent_find(&sv->sv_i, fileblock);
+	se = &sv->sv_i.sfi_extents[i];
+	if (i < sv->sv_i.sfi_nextents && se->se_fileblock <= fileblock) {
+		block = se->se_diskblock + (fileblock - se->se_fileblock);
+		goto found;
+	}
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
+	/* No; is it in a tree? */
+	result = sfs_itree(sv, fileblock, 0, &block);
+	if (result) {
+		return result;
+	}
+	if (block != 0 || !doalloc) {
+		goto found;
+	}
+
+	/*
+	 * It's a hole, and we need to fill it. Allocating at or past
+	 * EOF means the file is being extended.
+	 */
+	appending = fileblock >= DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	result = sfs_balloc_file(sv, appending, &block);
+	if (result) {
+		return result;
+	}
+	if (!sfs_extent_add(sv, fileblock, block)) {
+		/* The extent table is full */
+		result = sfs_itree(sv, fileblock, block, &block);
 		if (result) {
+			sfs_bfree(sfs, block);
 			return result;
 		}
 	}
 
+ found:
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
 		panic("sfs: Data block %u (block %u of file %u) marked free\n",
@@ -308,16 +558,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *iobuf;
 	uint32_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -339,40 +581,32 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block from the buffer cache.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = buffer_read(sfs->sfs_device, diskblock, &iobuf);
 	if (result) {
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * If it was a write, the buffer is now dirty; mark it so even
+	 * if uiomove failed partway, as part of it may have changed.
 	 */
+	result = uiomove((char *)buffer_map(iobuf)+skipstart, len, uio);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		buffer_mark_dirty(iobuf);
 	}
+	buffer_release(iobuf);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -387,10 +621,7 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	uint32_t fileblock;
 	int result;
 	int doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
+	struct buf *iobuf;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -413,33 +644,89 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	}
 
 	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
+	 * Go through the buffer cache. When writing, we overwrite the
+	 * whole block, so there is no need to read it in first.
 	 */
 	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
-	
-	result = sfs_rwblock(sfs, uio);
+	if (uio->uio_rw == UIO_READ) {
+		result = buffer_read(sfs->sfs_device, diskblock, &iobuf);
+	}
+	else {
+		result = buffer_get(sfs->sfs_device, diskblock, &iobuf);
+	}
+	if (result) {
+		return result;
+	}
 
-	/*
-	 * Now, restore the original uio_offset and uio_resid and update 
-	 * them by the amount of I/O done.
-	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
+	result = uiomove(buffer_map(iobuf), SFS_BLOCKSIZE, uio);
+	if (uio->uio_rw == UIO_WRITE) {
+		buffer_mark_dirty(iobuf);
+	}
+	buffer_release(iobuf);
 
 	return result;
 }
 
+/*
+ * Sequential readahead. Called after a read of file blocks FIRST
+ * through LAST, with RA the reader's readahead state. If the read picks
+ * up where the reader's last one left off, ask the buffer cache to
+ * prefetch the next ra_window blocks, doubling the window each time we
+ * move on to a new block; a read anywhere else turns readahead off
+ * until the reads become sequential again.
+ */
+static
+void
+sfs_readahead(struct sfs_vnode *sv, struct readahead *ra,
+	      uint32_t first, uint32_t last)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t fileblock, diskblock, limit;
+
+	if (first == ra->ra_next) {
+		/* Sequential, into a new block: open the window further */
+		if (ra->ra_window == 0) {
+			ra->ra_window = SFS_RAMIN;
+		}
+		else if (ra->ra_window < SFS_RAMAX) {
+			ra->ra_window *= 2;
+		}
+	}
+	else if (first + 1 != ra->ra_next) {
+		/* Not sequential (nor more of the last block read) */
+		ra->ra_window = 0;
+		ra->ra_end = 0;
+	}
+	ra->ra_next = last + 1;
+
+	if (ra->ra_window == 0) {
+		return;
+	}
+
+	/* Don't go past EOF, or ask again for blocks already requested */
+	limit = last + 1 + ra->ra_window;
+	if (limit > DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE)) {
+		limit = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	}
+	fileblock = last + 1;
+	if (fileblock < ra->ra_end) {
+		fileblock = ra->ra_end;
+	}
+
+	for (; fileblock < limit; fileblock++) {
+		if (sfs_bmap(sv, fileblock, 0, &diskblock)) {
+			break;
+		}
+		/* Holes read as zeros without any I/O */
+		if (diskblock != 0) {
+			buffer_prefetch(sfs->sfs_device, diskblock);
+		}
+	}
+	if (fileblock > ra->ra_end) {
+		ra->ra_end = fileblock;
+	}
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -451,6 +738,9 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	uint32_t nblocks, i;
 	int result = 0;
 	uint32_t extraresid = 0;
+	off_t startpos = uio->uio_offset;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/*
 	 * If reading, check for EOF. If we can read a partial area,
@@ -527,6 +817,14 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 
  out:
 
+	/* If reading sequentially, start reading ahead */
+	if (uio->uio_rw == UIO_READ && result == 0 &&
+	    uio->uio_offset > startpos) {
+		sfs_readahead(sv, uio->uio_ra ? uio->uio_ra : &sv->sv_ra,
+			      startpos / SFS_BLOCKSIZE,
+			      (uio->uio_offset - 1) / SFS_BLOCKSIZE);
+	}
+
 	/* If writing, adjust file length */
 	if (uio->uio_rw == UIO_WRITE && 
 	    uio->uio_offset > (off_t)sv->sv_i.sfi_size) {
@@ -599,53 +897,297 @@ sfs_writedir(struct sfs_vnode *sv, struct sfs_dir *sd, int slot)
 	/* Set up a uio to do the write */ 
 	uio_kinit(&iov, &ku, sd, sizeof(struct sfs_dir), actualpos, UIO_WRITE);
 
-	/* do it */
-	result = sfs_io(sv, &ku);
-	if (result) {
-		return result;
+	/* do it */
+	result = sfs_io(sv, &ku);
+	if (result) {
+		return result;
+	}
+
+	/* Should not end up with a partial entry! */
+	if (ku.uio_resid > 0) {
+		panic("sfs: writedir: Short write (ino %u)\n", sv->sv_ino);
+	}
+
+	/* Done */
+	return 0;
+}
+
+/*
+ * Compute the number of entries in a directory.
+ * This actually computes the number of existing slots, and does not
+ * account for empty slots.
+ */
+static
+int
+sfs_dir_nentries(struct sfs_vnode *sv)
+{
+	off_t size;
+
+	KASSERT(sv->sv_i.sfi_type == SFS_TYPE_DIR);
+
+	size = sv->sv_i.sfi_size;
+	if (size % sizeof(struct sfs_dir) != 0) {
+		panic("sfs: directory %u: Invalid size %llu\n",
+		      sv->sv_ino, size);
+	}
+
+	return size / sizeof(struct sfs_dir);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Directory index
+
+/*
+ * Searching a directory by reading every slot costs a read per slot
+ * and gets slow for big directories. So the first time a directory is
+ * searched, it is read once and indexed in memory: a hash table from
+ * the hash of each name to its slot, and a list of the empty slots.
+ * After that a search reads only the slots whose names hash the same
+ * as the one wanted (normally the one, or none), and there is always
+ * an empty slot at hand.
+ *
+ * sfs_dir_link and sfs_dir_unlink keep the index up to date. If that
+ * can't be done for lack of memory, the index is thrown away and built
+ * again next time; if it can't be built, directories are searched the
+ * slow way.
+ */
+
+struct sfs_dirslot {
+	uint32_t ds_hash;		/* hash of the name; unused if free */
+	int ds_slot;
+	struct sfs_dirslot *ds_next;	/* next in hash chain or free list */
+};
+
+struct sfs_dirindex {
+	struct sfs_dirslot **di_buckets;
+	unsigned di_nbuckets;
+	unsigned di_nnames;		/* entries in the hash table */
+	struct sfs_dirslot *di_free;	/* empty slots */
+};
+
+static
+uint32_t
+sfs_dirhash(const char *name)
+{
+	uint32_t hash = 5381;
+
+	while (*name) {
+		hash = hash*33 + (unsigned char)*name++;
+	}
+	return hash;
+}
+
+static
+void
+sfs_dirindex_destroy(struct sfs_vnode *sv)
+{
+	struct sfs_dirindex *di = sv->sv_dirindex;
+	struct sfs_dirslot *ds;
+	unsigned i;
+
+	if (di == NULL) {
+		return;
+	}
+	for (i=0; i<di->di_nbuckets; i++) {
+		while ((ds = di->di_buckets[i]) != NULL) {
+			di->di_buckets[i] = ds->ds_next;
+			kfree(ds);
+		}
+	}
+	while ((ds = di->di_free) != NULL) {
+		di->di_free = ds->ds_next;
+		kfree(ds);
+	}
+	kfree(di->di_buckets);
+	kfree(di);
+	sv->sv_dirindex = NULL;
+}
+
+/* Put DS in the hash table under its ds_hash. */
+static
+void
+sfs_dirindex_insert(struct sfs_dirindex *di, struct sfs_dirslot *ds)
+{
+	struct sfs_dirslot **newbuckets, *ds2;
+	unsigned i, n, b;
+
+	b = ds->ds_hash % di->di_nbuckets;
+	ds->ds_next = di->di_buckets[b];
+	di->di_buckets[b] = ds;
+	di->di_nnames++;
+
+	if (di->di_nnames <= 2*di->di_nbuckets) {
+		return;
+	}
+
+	/*
+	 * Chains are getting long; double the table. If there's no
+	 * memory for it, carry on with the old one, which still works.
+	 */
+	n = di->di_nbuckets * 2;
+	newbuckets = kmalloc(n * sizeof(struct sfs_dirslot *));
+	if (newbuckets == NULL) {
+		return;
+	}
+	for (i=0; i<n; i++) {
+		newbuckets[i] = NULL;
+	}
+	for (i=0; i<di->di_nbuckets; i++) {
+		while ((ds2 = di->di_buckets[i]) != NULL) {
+			di->di_buckets[i] = ds2->ds_next;
+			b = ds2->ds_hash % n;
+			ds2->ds_next = newbuckets[b];
+			newbuckets[b] = ds2;
+		}
+	}
+	kfree(di->di_buckets);
+	di->di_buckets = newbuckets;
+	di->di_nbuckets = n;
+}
+
+/*
+ * Build the index of a directory, if it doesn't have one already.
+ */
+static
+int
+sfs_dirindex_build(struct sfs_vnode *sv)
+{
+	struct sfs_dirindex *di;
+	struct sfs_dirslot *ds;
+	struct sfs_dir tsd;
+	int nentries, i, result;
+	unsigned j;
+
+	if (sv->sv_dirindex != NULL) {
+		return 0;
+	}
+
+	di = kmalloc(sizeof(struct sfs_dirindex));
+	if (di == NULL) {
+		return ENOMEM;
+	}
+	di->di_buckets = kmalloc(SFS_DIRHASH_MIN*sizeof(struct sfs_dirslot *));
+	if (di->di_buckets == NULL) {
+		kfree(di);
+		return ENOMEM;
+	}
+	for (j=0; j<SFS_DIRHASH_MIN; j++) {
+		di->di_buckets[j] = NULL;
+	}
+	di->di_nbuckets = SFS_DIRHASH_MIN;
+	di->di_nnames = 0;
+	di->di_free = NULL;
+	sv->sv_dirindex = di;
+
+	nentries = sfs_dir_nentries(sv);
+	for (i=0; i<nentries; i++) {
+		result = sfs_readdir(sv, &tsd, i);
+		if (result) {
+			sfs_dirindex_destroy(sv);
+			return result;
+		}
+		ds = kmalloc(sizeof(struct sfs_dirslot));
+		if (ds == NULL) {
+			sfs_dirindex_destroy(sv);
+			return ENOMEM;
+		}
+		ds->ds_slot = i;
+		if (tsd.sfd_ino == SFS_NOINO) {
+			ds->ds_hash = 0;
+			ds->ds_next = di->di_free;
+			di->di_free = ds;
+		}
+		else {
+			tsd.sfd_name[sizeof(tsd.sfd_name)-1] = 0;
+			ds->ds_hash = sfs_dirhash(tsd.sfd_name);
+			sfs_dirindex_insert(di, ds);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Update the index (if any) for NAME having been written into SLOT.
+ */
+static
+void
+sfs_dirindex_link(struct sfs_vnode *sv, const char *name, int slot)
+{
+	struct sfs_dirindex *di = sv->sv_dirindex;
+	struct sfs_dirslot *ds, **pp;
+
+	if (di == NULL) {
+		return;
 	}
 
-	/* Should not end up with a partial entry! */
-	if (ku.uio_resid > 0) {
-		panic("sfs: writedir: Short write (ino %u)\n", sv->sv_ino);
+	/* If it was an empty slot (normally the first), take it off the list */
+	for (pp = &di->di_free; *pp != NULL; pp = &(*pp)->ds_next) {
+		if ((*pp)->ds_slot == slot) {
+			break;
+		}
 	}
-
-	/* Done */
-	return 0;
+	if (*pp != NULL) {
+		ds = *pp;
+		*pp = ds->ds_next;
+	}
+	else {
+		/* A new slot at the end */
+		ds = kmalloc(sizeof(struct sfs_dirslot));
+		if (ds == NULL) {
+			sfs_dirindex_destroy(sv);
+			return;
+		}
+		ds->ds_slot = slot;
+	}
+	ds->ds_hash = sfs_dirhash(name);
+	sfs_dirindex_insert(di, ds);
 }
 
 /*
- * Compute the number of entries in a directory.
- * This actually computes the number of existing slots, and does not
- * account for empty slots.
+ * Update the index (if any) for the name hashing to HASH having been
+ * removed from SLOT.
  */
 static
-int
-sfs_dir_nentries(struct sfs_vnode *sv)
+void
+sfs_dirindex_unlink(struct sfs_vnode *sv, uint32_t hash, int slot)
 {
-	off_t size;
-
-	KASSERT(sv->sv_i.sfi_type == SFS_TYPE_DIR);
+	struct sfs_dirindex *di = sv->sv_dirindex;
+	struct sfs_dirslot *ds, **pp;
 
-	size = sv->sv_i.sfi_size;
-	if (size % sizeof(struct sfs_dir) != 0) {
-		panic("sfs: directory %u: Invalid size %llu\n",
-		      sv->sv_ino, size);
+	if (di == NULL) {
+		return;
+	}
+	for (pp = &di->di_buckets[hash % di->di_nbuckets]; *pp != NULL;
+	     pp = &(*pp)->ds_next) {
+		if ((*pp)->ds_slot == slot) {
+			break;
+		}
 	}
+	KASSERT(*pp != NULL);
+	ds = *pp;
+	*pp = ds->ds_next;
+	di->di_nnames--;
 
-	return size / sizeof(struct sfs_dir);
+	ds->ds_hash = 0;
+	ds->ds_next = di->di_free;
+	di->di_free = ds;
 }
 
+////////////////////////////////////////////////////////////
+//
+// Directory operations
+
 /*
- * Search a directory for a particular filename in a directory, and
- * return its inode number, its slot, and/or the slot number of an
- * empty directory slot if one is found.
+ * Search a directory for a particular filename the slow way, reading
+ * every slot, and return its inode number, its slot, and/or the slot
+ * number of an empty directory slot if one is found. For when the
+ * directory can't be indexed.
  */
-
 static
 int
-sfs_dir_findname(struct sfs_vnode *sv, const char *name,
-		    uint32_t *ino, int *slot, int *emptyslot)
+sfs_dir_scan(struct sfs_vnode *sv, const char *name,
+	     uint32_t *ino, int *slot, int *emptyslot)
 {
 	struct sfs_dir tsd;
 	int found = 0;
@@ -688,6 +1230,63 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+/*
+ * Search a directory for a particular filename in a directory, and
+ * return its inode number, its slot, and/or the slot number of an
+ * empty directory slot if one is found.
+ */
+static
+int
+sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+		    uint32_t *ino, int *slot, int *emptyslot)
+{
+	struct sfs_dirindex *di;
+	struct sfs_dirslot *ds;
+	struct sfs_dir tsd;
+	uint32_t hash;
+	int result;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	result = sfs_dirindex_build(sv);
+	if (result == ENOMEM) {
+		return sfs_dir_scan(sv, name, ino, slot, emptyslot);
+	}
+	if (result) {
+		return result;
+	}
+	di = sv->sv_dirindex;
+
+	if (emptyslot != NULL && di->di_free != NULL) {
+		*emptyslot = di->di_free->ds_slot;
+	}
+
+	/* Check each slot whose name hashes the same */
+	hash = sfs_dirhash(name);
+	for (ds = di->di_buckets[hash % di->di_nbuckets]; ds != NULL;
+	     ds = ds->ds_next) {
+		if (ds->ds_hash != hash) {
+			continue;
+		}
+		result = sfs_readdir(sv, &tsd, ds->ds_slot);
+		if (result) {
+			return result;
+		}
+		KASSERT(tsd.sfd_ino != SFS_NOINO);
+		tsd.sfd_name[sizeof(tsd.sfd_name)-1] = 0;
+		if (!strcmp(tsd.sfd_name, name)) {
+			if (slot != NULL) {
+				*slot = ds->ds_slot;
+			}
+			if (ino != NULL) {
+				*ino = tsd.sfd_ino;
+			}
+			return 0;
+		}
+	}
+	return ENOENT;
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
@@ -700,6 +1299,8 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 	int result;
 	struct sfs_dir sd;
 
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
 	/* Look up the name. We want to make sure it *doesn't* exist. */
 	result = sfs_dir_findname(sv, name, NULL, NULL, &emptyslot);
 	if (result!=0 && result!=ENOENT) {
@@ -729,8 +1330,13 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 	}
 
 	/* Write the entry. */
-	return sfs_writedir(sv, &sd, emptyslot);
-	
+	result = sfs_writedir(sv, &sd, emptyslot);
+	if (result) {
+		return result;
+	}
+
+	sfs_dirindex_link(sv, name, emptyslot);
+	return 0;
 }
 
 /*
@@ -741,13 +1347,33 @@ int
 sfs_dir_unlink(struct sfs_vnode *sv, int slot)
 {
 	struct sfs_dir sd;
+	uint32_t hash = 0;
+	int result;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
+	/* The index files the slot under its name, so get the name */
+	if (sv->sv_dirindex != NULL) {
+		result = sfs_readdir(sv, &sd, slot);
+		if (result) {
+			return result;
+		}
+		sd.sfd_name[sizeof(sd.sfd_name)-1] = 0;
+		hash = sfs_dirhash(sd.sfd_name);
+	}
 
 	/* Initialize a suitable directory entry... */ 
 	bzero(&sd, sizeof(sd));
 	sd.sfd_ino = SFS_NOINO;
 
 	/* ... and write it */
-	return sfs_writedir(sv, &sd, slot);
+	result = sfs_writedir(sv, &sd, slot);
+	if (result) {
+		return result;
+	}
+
+	sfs_dirindex_unlink(sv, hash, slot);
+	return 0;
 }
 
 /*
@@ -798,10 +1424,11 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 
 	/*
 	 * First, get an inode. (Each inode is a block, and the inode 
-	 * number is the block number, so just get a block.)
+	 * number is the block number, so just get a block. Anywhere will
+	 * do; the file's data will then go in the blocks after it.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, sfs->sfs_super.sp_nblocks, &ino);
 	if (result) {
 		return result;
 	}
@@ -826,17 +1453,14 @@ sfs_open(struct vnode *v, int openflags)
 {
 	/*
 	 * At this level we do not need to handle O_CREAT, O_EXCL, or O_TRUNC.
-	 * We *would* need to handle O_APPEND, but we don't support it.
+	 * Nor O_APPEND: the file syscalls move to EOF before each write.
 	 *
 	 * Any of O_RDONLY, O_WRONLY, and O_RDWR are valid, so we don't need
 	 * to check that either.
 	 */
 
-	if (openflags & O_APPEND) {
-		return EUNIMP;
-	}
-
 	(void)v;
+	(void)openflags;
 
 	return 0;
 }
@@ -875,8 +1499,13 @@ static
 int
 sfs_close(struct vnode *v)
 {
-	/* Sync it. */
-	return VOP_FSYNC(v);
+	/*
+	 * Nothing to do. Dirty blocks are written back by the syncer,
+	 * or by fsync if the caller wants them on disk now, and the
+	 * inode when the vnode is reclaimed.
+	 */
+	(void)v;
+	return 0;
 }
 
 /*
@@ -890,39 +1519,55 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
+	struct sfs_vnode **pp;
+	unsigned ix, num;
 	int result;
 
-	vfs_biglock_acquire();
+	/*
+	 * New references are only handed out by sfs_loadvnode, under
+	 * sfs_vnlock, so hold that while deciding.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
 
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it.
 	 */
+	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
 		/* consume the reference VOP_DECREF gave us */
 		KASSERT(v->vn_refcount>1);
 		v->vn_refcount--;
 
-		vfs_biglock_release();
+		spinlock_release(&v->vn_countlock);
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
+
+	/*
+	 * Ours is the only reference now, and no more can be made until
+	 * we let go of sfs_vnlock. Keep holding it until the vnode is
+	 * out of the tables, so nobody loads the inode from disk while
+	 * we're still writing it back.
+	 */
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount==0) {
 		result = VOP_TRUNCATE(&sv->sv_v, 0);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_vnlock);
 			return result;
 		}
 	}
 
 	/* Sync the inode to disk */
+	sfs_lock(sv);
 	result = sfs_sync_inode(sv);
+	sfs_unlock(sv);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -931,26 +1576,41 @@ sfs_reclaim(struct vnode *v)
 		sfs_bfree(sfs, sv->sv_ino);
 	}
 
-	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
+	/* Remove the vnode structure from the hash table... */
+	for (pp = &sfs->sfs_vhash[sfs_vhashfunc(sv->sv_ino)]; *pp != sv;
+	     pp = &(*pp)->sv_hashnext) {
+		if (*pp == NULL) {
+			panic("sfs: reclaim vnode %u not in vnode pool\n",
+			      sv->sv_ino);
 		}
 	}
-	if (ix == num) {
-		panic("sfs: reclaim vnode %u not in vnode pool\n",
-		      sv->sv_ino);
+	*pp = sv->sv_hashnext;
+
+	/*
+	 * ...and from the table in the struct sfs_fs. Move the last
+	 * entry into its place rather than sliding them all down.
+	 */
+	num = vnodearray_num(sfs->sfs_vnodes);
+	ix = sv->sv_vnix;
+	KASSERT(ix < num);
+	KASSERT(vnodearray_get(sfs->sfs_vnodes, ix) == &sv->sv_v);
+	if (ix != num-1) {
+		struct vnode *last = vnodearray_get(sfs->sfs_vnodes, num-1);
+		struct sfs_vnode *lastsv = last->vn_data;
+
+		vnodearray_set(sfs->sfs_vnodes, ix, last);
+		lastsv->sv_vnix = ix;
 	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
+	result = vnodearray_setsize(sfs->sfs_vnodes, num-1);
+	/* Shrinking an array can't fail */
+	KASSERT(result == 0);
+
+	lock_release(sfs->sfs_vnlock);
 
 	VOP_CLEANUP(&sv->sv_v);
 
-	vfs_biglock_release();
+	sfs_dirindex_destroy(sv);
+	lock_destroy(sv->sv_lock);
 
 	/* Release the storage for the vnode structure itself. */
 	kfree(sv);
@@ -971,9 +1631,9 @@ sfs_read(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	vfs_biglock_acquire();
+	sfs_lock(sv);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	sfs_unlock(sv);
 
 	return result;
 }
@@ -990,9 +1650,9 @@ sfs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
-	vfs_biglock_acquire();
+	sfs_lock(sv);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	sfs_unlock(sv);
 
 	return result;
 }
@@ -1033,7 +1693,9 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 		return result;
 	}
 
+	sfs_lock(sv);
 	statbuf->st_size = sv->sv_i.sfi_size;
+	sfs_unlock(sv);
 
 	/* We don't support these yet; you get to implement them */
 	statbuf->st_nlink = 0;
@@ -1053,16 +1715,13 @@ sfs_gettype(struct vnode *v, uint32_t *ret)
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type is set when the vnode is loaded and never changes */
 	switch (sv->sv_i.sfi_type) {
 	case SFS_TYPE_FILE:
 		*ret = S_IFREG;
-		vfs_biglock_release();
 		return 0;
 	case SFS_TYPE_DIR:
 		*ret = S_IFDIR;
-		vfs_biglock_release();
 		return 0;
 	}
 	panic("sfs: gettype: Invalid inode type (inode %u, type %u)\n",
@@ -1092,20 +1751,100 @@ sfs_tryseek(struct vnode *v, off_t pos)
 }
 
 /*
- * Called for fsync(), and also on filesystem unmount, global sync(),
- * and some other cases.
+ * Write back the indirect block IDBLOCK, which is LEVELS levels above
+ * the file's data blocks, and everything under it.
+ */
+static
+int
+sfs_sync_tree(struct sfs_fs *sfs, uint32_t idblock, unsigned levels)
+{
+	struct buf *idbuf;
+	uint32_t *iddata;
+	unsigned i;
+	int result;
+
+	if (idblock == 0) {
+		return 0;
+	}
+
+	result = buffer_read(sfs->sfs_device, idblock, &idbuf);
+	if (result) {
+		return result;
+	}
+	iddata = buffer_map(idbuf);
+	for (i=0; i<SFS_DBPERIDB && result == 0; i++) {
+		if (iddata[i] == 0) {
+			continue;
+		}
+		if (levels > 1) {
+			result = sfs_sync_tree(sfs, iddata[i], levels - 1);
+		}
+		else {
+			result = buffer_sync_range(sfs->sfs_device,
+						   iddata[i], 1);
+		}
+	}
+	buffer_release(idbuf);
+	if (result) {
+		return result;
+	}
+
+	return buffer_sync_range(sfs->sfs_device, idblock, 1);
+}
+
+/*
+ * Called for fsync(). Write back the inode and the file's own blocks
+ * (data and indirect), found through its block map, and nothing else
+ * in the buffer cache.
  */
 static
 int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	const struct sfs_extent *se;
+	unsigned i;
 	int result;
 
-	vfs_biglock_acquire();
+	sfs_lock(sv);
 	result = sfs_sync_inode(sv);
-	vfs_biglock_release();
 
+	for (i=0; i<sv->sv_i.sfi_nextents && result == 0; i++) {
+		se = &sv->sv_i.sfi_extents[i];
+		result = buffer_sync_range(sfs->sfs_device, se->se_diskblock,
+					   se->se_nblocks);
+	}
+	if (result == 0) {
+		result = sfs_sync_tree(sfs, sv->sv_i.sfi_indirect, 1);
+	}
+	if (result == 0) {
+		result = sfs_sync_tree(sfs, sv->sv_i.sfi_dindirect, 2);
+	}
+	if (result == 0) {
+		result = sfs_sync_tree(sfs, sv->sv_i.sfi_tindirect, 3);
+	}
+	if (result == 0) {
+		result = buffer_sync_range(sfs->sfs_device, sv->sv_ino, 1);
+	}
+
+	sfs_unlock(sv);
+	return result;
+}
+
+/*
+ * Write a vnode's inode back to the buffer cache, if it has changed.
+ * For sfs_sync, which then writes back the whole cache at once.
+ */
+int
+sfs_syncinode(struct vnode *v)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	sfs_lock(sv);
+	result = sfs_sync_inode(sv);
+	sfs_unlock(sv);
 	return result;
 }
 
@@ -1120,6 +1859,83 @@ sfs_mmap(struct vnode *v   /* add stuff as needed */)
 	return EUNIMP;
 }
 
+/*
+ * Free the blocks at or past file block BLOCKLEN in the indirect tree
+ * whose top block is *IDBLOCKP. BASE is the first file block the tree
+ * maps, and SPAN the number of file blocks each entry of the top block
+ * covers. If that leaves the tree empty, free the top block too and
+ * set *IDBLOCKP to 0.
+ *
+ * This holds a buffer per level on the way down, so at most three.
+ */
+static
+int
+sfs_truncate_tree(struct sfs_fs *sfs, uint32_t *idblockp, uint32_t base,
+		  uint32_t span, uint32_t blocklen)
+{
+	struct buf *idbuf;
+	uint32_t *iddata;
+	uint32_t j, entrybase, oldentry;
+	bool hasnonzero, iddirty;
+	int result;
+
+	if (*idblockp == 0 || base + span * SFS_DBPERIDB <= blocklen) {
+		/* Nothing here, or all of it is before the new EOF */
+		return 0;
+	}
+
+	result = buffer_read(sfs->sfs_device, *idblockp, &idbuf);
+	if (result) {
+		return result;
+	}
+	iddata = buffer_map(idbuf);
+
+	hasnonzero = false;
+	iddirty = false;
+	for (j=0; j<SFS_DBPERIDB; j++) {
+		entrybase = base + j * span;
+		oldentry = iddata[j];
+
+		/* Discard anything past the new EOF */
+		if (oldentry != 0 && entrybase + span > blocklen) {
+			if (span == 1) {
+				sfs_bfree(sfs, oldentry);
+				iddata[j] = 0;
+			}
+			else {
+				result = sfs_truncate_tree(sfs, &iddata[j],
+							   entrybase,
+							   span / SFS_DBPERIDB,
+							   blocklen);
+				if (result) {
+					buffer_release(idbuf);
+					return result;
+				}
+			}
+			if (iddata[j] != oldentry) {
+				iddirty = true;
+			}
+		}
+
+		/* Remember if we see any nonzero blocks in here */
+		if (iddata[j] != 0) {
+			hasnonzero = true;
+		}
+	}
+
+	if (iddirty) {
+		buffer_mark_dirty(idbuf);
+	}
+	buffer_release(idbuf);
+
+	if (!hasnonzero) {
+		/* The whole indirect block is empty now; free it */
+		sfs_bfree(sfs, *idblockp);
+		*idblockp = 0;
+	}
+	return 0;
+}
+
 /*
  * Called for ftruncate() and from sfs_reclaim.
  */
@@ -1127,100 +1943,84 @@ static
 int
 sfs_truncate(struct vnode *v, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_inode *sfi = &sv->sv_i;
+	struct sfs_extent *se;
+	uint32_t oldroots[3];
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
-	uint32_t i, j, block;
-	uint32_t idblock, baseblock, highblock;
+	uint32_t keep, j;
 	int result;
-	int hasnonzero, iddirty;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	sfs_lock(sv);
 
-	vfs_biglock_acquire();
+	/* A directory's index may name slots that are going away */
+	sfs_dirindex_destroy(sv);
 
 	/*
-	 * Go through the direct blocks. Discard any that are
-	 * past the limit we're truncating to.
+	 * Go through the extents from the last one back. Discard any
+	 * that are past the limit we're truncating to, and cut short
+	 * the one it falls in, if any.
 	 */
-	for (i=0; i<SFS_NDIRECT; i++) {
-		block = sv->sv_i.sfi_direct[i];
-		if (i >= blocklen && block != 0) {
-			sfs_bfree(sfs, block);
-			sv->sv_i.sfi_direct[i] = 0;
+	while (sfi->sfi_nextents > 0) {
+		se = &sfi->sfi_extents[sfi->sfi_nextents - 1];
+		if (se->se_fileblock + se->se_nblocks <= blocklen) {
+			break;
+		}
+		keep = se->se_fileblock < blocklen ?
+			blocklen - se->se_fileblock : 0;
+		for (j=keep; j<se->se_nblocks; j++) {
+			sfs_bfree(sfs, se->se_diskblock + j);
+		}
+		if (keep > 0) {
+			se->se_nblocks = keep;
 			sv->sv_dirty = true;
+			break;
 		}
+		bzero(se, sizeof(*se));
+		sfi->sfi_nextents--;
+		sv->sv_dirty = true;
 	}
 
-	/* Indirect block number */
-	idblock = sv->sv_i.sfi_indirect;
+	/* Then the indirect trees. */
+	oldroots[0] = sfi->sfi_indirect;
+	oldroots[1] = sfi->sfi_dindirect;
+	oldroots[2] = sfi->sfi_tindirect;
 
-	/* The lowest block in the indirect block */
-	baseblock = SFS_NDIRECT;
-
-	/* The highest block in the indirect block */
-	highblock = baseblock + SFS_DBPERIDB - 1;
-
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
-		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
-		if (result) {
-			vfs_biglock_release();
-			return result;
-		}
-		
-		hasnonzero = 0;
-		iddirty = 0;
-		for (j=0; j<SFS_DBPERIDB; j++) {
-			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
-			}
-			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
-				hasnonzero=1;
-			}
-		}
+	result = sfs_truncate_tree(sfs, &sfi->sfi_indirect,
+				   0, 1, blocklen);
+	if (result == 0) {
+		result = sfs_truncate_tree(sfs, &sfi->sfi_dindirect,
+					   SFS_DIDBASE, SFS_DBPERIDB,
+					   blocklen);
+	}
+	if (result == 0) {
+		result = sfs_truncate_tree(sfs, &sfi->sfi_tindirect,
+					   SFS_TIDBASE,
+					   SFS_DBPERIDB * SFS_DBPERIDB,
+					   blocklen);
+	}
 
-		if (!hasnonzero) {
-			/* The whole indirect block is empty now; free it */
-			sfs_bfree(sfs, idblock);
-			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = true;
-		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
-			if (result) {
-				vfs_biglock_release();
-				return result;
-			}
-		}
+	if (sfi->sfi_indirect != oldroots[0] ||
+	    sfi->sfi_dindirect != oldroots[1] ||
+	    sfi->sfi_tindirect != oldroots[2]) {
+		sv->sv_dirty = true;
+	}
+	if (result) {
+		sfs_unlock(sv);
+		return result;
 	}
 
 	/* Set the file size */
-	sv->sv_i.sfi_size = len;
+	sfi->sfi_size = len;
 
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
-	vfs_biglock_release();
+	sfs_unlock(sv);
 	return 0;
 }
 
@@ -1259,37 +2059,36 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	uint32_t ino;
 	int result;
 
-	vfs_biglock_acquire();
+	sfs_lock(sv);
 
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
-		vfs_biglock_release();
+		sfs_unlock(sv);
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
-		vfs_biglock_release();
+		sfs_unlock(sv);
 		return EEXIST;
 	}
 
 	if (result==0) {
 		/* We got a file; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
+		sfs_unlock(sv);
 		if (result) {
-			vfs_biglock_release();
 			return result;
 		}
 		*ret = &newguy->sv_v;
-		vfs_biglock_release();
 		return 0;
 	}
 
 	/* Didn't exist - create it */
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
-		vfs_biglock_release();
+		sfs_unlock(sv);
 		return result;
 	}
 
@@ -1299,20 +2098,25 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		sfs_unlock(sv);
 		VOP_DECREF(&newguy->sv_v);
-		vfs_biglock_release();
 		return result;
 	}
 
-	/* Update the linkcount of the new file */
+	/*
+	 * Update the linkcount of the new file, and consequently mark
+	 * it dirty. Do it before letting go of the directory: once we
+	 * do, others can find the name, and must not find a file with
+	 * no links.
+	 */
+	sfs_lock(newguy);
 	newguy->sv_i.sfi_linkcount++;
-
-	/* and consequently mark it dirty. */
 	newguy->sv_dirty = true;
+	sfs_unlock(newguy);
+	sfs_unlock(sv);
 
 	*ret = &newguy->sv_v;
 	
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1331,12 +2135,23 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	KASSERT(file->vn_fs == dir->vn_fs);
 
-	vfs_biglock_acquire();
+	/*
+	 * No hard links to directories. (The only one is the root,
+	 * which would also be SV, and we'd deadlock on its lock.)
+	 */
+	if (f->sv_i.sfi_type == SFS_TYPE_DIR) {
+		return EPERM;
+	}
+
+	/* Directory first, then file */
+	sfs_lock(sv);
+	sfs_lock(f);
 
 	/* Just create a link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
-		vfs_biglock_release();
+		sfs_unlock(f);
+		sfs_unlock(sv);
 		return result;
 	}
 
@@ -1344,7 +2159,8 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
 
-	vfs_biglock_release();
+	sfs_unlock(f);
+	sfs_unlock(sv);
 	return 0;
 }
 
@@ -1360,12 +2176,12 @@ sfs_remove(struct vnode *dir, const char *name)
 	int slot;
 	int result;
 
-	vfs_biglock_acquire();
+	sfs_lock(sv);
 
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
-		vfs_biglock_release();
+		sfs_unlock(sv);
 		return result;
 	}
 
@@ -1373,15 +2189,21 @@ sfs_remove(struct vnode *dir, const char *name)
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
+		sfs_lock(victim);
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
 		victim->sv_dirty = true;
+		sfs_unlock(victim);
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	sfs_unlock(sv);
+
+	/*
+	 * Discard the reference that sfs_lookonce got us. If it was the
+	 * last one, this erases the file, so do it with no locks held.
+	 */
 	VOP_DECREF(&victim->sv_v);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1401,21 +2223,24 @@ sfs_rename(struct vnode *d1, const char *n1,
 	int slot1, slot2;
 	int result, result2;
 
-	vfs_biglock_acquire();
-
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOT_LOCATION);
 
+	sfs_lock(sv);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
-		vfs_biglock_release();
+		sfs_unlock(sv);
 		return result;
 	}
 
 	/* We don't support subdirectories */
 	KASSERT(g1->sv_i.sfi_type == SFS_TYPE_FILE);
 
+	/* Directory first, then file */
+	sfs_lock(g1);
+
 	/*
 	 * Link it under the new name.
 	 *
@@ -1447,10 +2272,12 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
 
+	sfs_unlock(g1);
+	sfs_unlock(sv);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 
-	vfs_biglock_release();
 	return 0;
 
  puke_harder:
@@ -1466,9 +2293,11 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 	g1->sv_i.sfi_linkcount--;
  puke:
+	sfs_unlock(g1);
+	sfs_unlock(sv);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1486,15 +2315,13 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
+	/* No lock needed: the type doesn't change, and PATH is ours */
 
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
 	if (strlen(path)+1 > buflen) {
-		vfs_biglock_release();
 		return ENAMETOOLONG;
 	}
 	strcpy(buf, path);
@@ -1502,7 +2329,6 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	VOP_INCREF(&sv->sv_v);
 	*ret = &sv->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1520,22 +2346,19 @@ sfs_lookup(struct vnode *v, char *path, struct vnode **ret)
 	struct sfs_vnode *final;
 	int result;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 	
+	sfs_lock(sv);
 	result = sfs_lookonce(sv, path, &final, NULL);
+	sfs_unlock(sv);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	*ret = &final->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1645,39 +2468,43 @@ static const struct vnode_ops sfs_dirops = {
 /*
  * Function to load a inode into memory as a vnode, or dig up one
  * that's already resident.
+ *
+ * Holds sfs_vnlock throughout, so that two threads can't both load the
+ * same inode, and so that sfs_reclaim can't throw away a vnode we're
+ * about to hand out.
  */
 static
 int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
 	struct sfs_vnode *sv;
 	const struct vnode_ops *ops = NULL;
-	unsigned i, num;
+	unsigned ix;
 	int result;
 
-	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
+	/* The freemap lock is below us in the lock order */
+	KASSERT(!lock_do_i_hold(sfs->sfs_freemaplock));
 
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
-
-		/* Every inode in memory must be in an allocated block */
-		if (!sfs_bused(sfs, sv->sv_ino)) {
-			panic("sfs: Found inode %u in unallocated block\n",
-			      sv->sv_ino);
-		}
+	lock_acquire(sfs->sfs_vnlock);
 
+	/* Look in the vnodes table */
+	for (sv = sfs->sfs_vhash[sfs_vhashfunc(ino)]; sv != NULL;
+	     sv = sv->sv_hashnext) {
 		if (sv->sv_ino==ino) {
 			/* Found */
 
+			/* Every inode in memory must be in an allocated block */
+			if (!sfs_bused(sfs, sv->sv_ino)) {
+				panic("sfs: Found inode %u in unallocated "
+				      "block\n", sv->sv_ino);
+			}
+
 			/* May only be set when creating new objects */
 			KASSERT(forcetype==SFS_TYPE_INVAL);
 
 			VOP_INCREF(&sv->sv_v);
+			lock_release(sfs->sfs_vnlock);
 			*ret = sv;
 			return 0;
 		}
@@ -1687,6 +2514,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(sfs->sfs_vnlock);
 		return ENOMEM;
 	}
 
@@ -1700,12 +2528,31 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = sfs_rblock(sfs, &sv->sv_i, ino);
 	if (result) {
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
+	sv->sv_lock = lock_create("sfs_vnode");
+	if (sv->sv_lock == NULL) {
+		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* No reads yet */
+	bzero(&sv->sv_ra, sizeof(sv->sv_ra));
+
+	/* Nothing allocated or reserved yet */
+	sv->sv_bgoal = 0;
+	sv->sv_prealloc = 0;
+	sv->sv_npreallocs = 0;
+
+	/* Directories get indexed when first searched */
+	sv->sv_dirindex = NULL;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out and thus the type
@@ -1732,11 +2579,18 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		      "(inode %u, type %u)\n",
 		      ino, sv->sv_i.sfi_type);
 	}
+	if (sv->sv_i.sfi_nextents > SFS_NEXTENTS) {
+		panic("sfs: loadvnode: Invalid extent count "
+		      "(inode %u, %u extents)\n",
+		      ino, sv->sv_i.sfi_nextents);
+	}
 
 	/* Call the common vnode initializer */
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -1744,12 +2598,21 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	sv->sv_ino = ino;
 
 	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, NULL);
+	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, &ix);
 	if (result) {
 		VOP_CLEANUP(&sv->sv_v);
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
+	sv->sv_vnix = ix;
+
+	/* And to the hash table */
+	sv->sv_hashnext = sfs->sfs_vhash[sfs_vhashfunc(ino)];
+	sfs->sfs_vhash[sfs_vhashfunc(ino)] = sv;
+
+	lock_release(sfs->sfs_vnlock);
 
 	/* Hand it back */
 	*ret = sv;
@@ -1767,14 +2630,10 @@ sfs_getroot(struct fs *fs)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOT_LOCATION, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		panic("sfs: getroot: Cannot load root vnode\n");
 	}
 
-	vfs_biglock_release();
-
 	return &sv->sv_v;
 }
@@ -0,0 +1,61 @@
+#ifndef _BIOQ_H_
+#define _BIOQ_H_
+
+/*
+ * Block I/O request queue.
+ *
+ * A block device driver that wants its requests scheduled creates a
+ * bioq and points its device's d_bioq at it. Requests are submitted
+ * with bioq_submit, which returns at once; a worker thread per queue
+ * hands them to the driver's raw I/O function one at a time, in
+ * elevator order, and calls each request's completion function when
+ * it is done. bioq_io is the synchronous version, for d_io.
+ *
+ * The elevator is C-SCAN: requests are served in increasing sector
+ * order from the position of the last one, wrapping around to the
+ * lowest pending sector at the end, so a stream of requests sweeps
+ * the disk in one direction. To bound how long a request far from the
+ * head can be passed over, each has a deadline, counted in requests
+ * served: once BIOQ_DEADLINE others have been served since it was
+ * submitted, it goes next.
+ *
+ * Because the worker is a different thread, the uio of a request must
+ * be in kernel space (UIO_SYSSPACE).
+ */
+
+struct device;	/* from <device.h> */
+struct uio;	/* from <uio.h> */
+struct bioq;	/* Opaque. */
+
+struct bioreq {
+	/* Set by the submitter */
+	struct uio *br_uio;	/* transfer; uio_offset says where */
+	void (*br_done)(struct bioreq *br, int result);
+	void *br_data;		/* for the submitter's use */
+
+	/* Private to the queue */
+	uint32_t br_sector;
+	unsigned br_deadline;
+	struct bioreq *br_next;
+};
+
+/* How many requests may be served ahead of one already waiting */
+#define BIOQ_DEADLINE 32
+
+/*
+ * Create a queue for DEV, whose requests are carried out by calling
+ * DOIO (which may sleep). Starts the worker thread.
+ */
+struct bioq *bioq_create(const char *name, struct device *dev,
+			 int (*doio)(struct device *, struct uio *));
+
+/*
+ * Queue a request. BR must stay valid until BR->br_done is called;
+ * br_done is called from the worker thread, with no locks held.
+ */
+void bioq_submit(struct bioq *q, struct bioreq *br);
+
+/* Queue a request for UIO and wait for it to finish. */
+int bioq_io(struct bioq *q, struct uio *uio);
+
+#endif /* _BIOQ_H_ */
@@ -0,0 +1,111 @@
+#ifndef _BUF_H_
+#define _BUF_H_
+
+/*
+ * Block buffer cache.
+ *
+ * One cache, shared by all block devices, holds recently used disk
+ * blocks in memory. Buffers are found by (device, block number) via a
+ * hash table and are replaced with the CLOCK algorithm.
+ *
+ * A buffer handed out by buffer_read or buffer_get is "pinned": it
+ * will not be evicted or reused until buffer_release is called. The
+ * caller may read and modify the data (via buffer_map) while it holds
+ * the buffer; if it modifies it, it must call buffer_mark_dirty before
+ * releasing it. Dirty buffers are written back when they are evicted,
+ * when buffer_sync is called, or by the syncer thread, which runs
+ * vfs_sync periodically. Callers are responsible for
+ * serializing access to the contents of a buffer (SFS does this with
+ * its per-vnode and freemap locks; see design/fslocking.txt).
+ *
+ * The cache is sized as a fraction of physical memory when the system
+ * boots; buffers are allocated as they are first needed.
+ */
+
+struct device;	/* from <device.h> */
+struct buf;	/* Opaque. */
+
+/* Size of a buffer; must match the device block size. */
+#define BUFFER_SIZE		512
+
+/* Fraction of physical memory used for the cache (1/BUFFER_RAMFRACTION) */
+#define BUFFER_RAMFRACTION	16
+
+/* Never use fewer buffers than this, however little memory there is */
+#define BUFFER_MIN		32
+
+/* Number of buckets in the (device, block) hash table */
+#define BUFFER_HASHSIZE		128
+
+/* The syncer flushes everything this often (in seconds)... */
+#define BUFFER_SYNCINTERVAL	5
+
+/* ...or as soon as more than 1/BUFFER_DIRTYFRACTION of buffers are dirty */
+#define BUFFER_DIRTYFRACTION	2
+
+/* Most blocks that can be waiting for the prefetcher at once */
+#define BUFFER_PREFETCHMAX	64
+
+/* Most consecutive blocks written back or prefetched in one request */
+#define BUFFER_CLUSTERMAX	16
+
+/* Set up the cache. Called from vfs_bootstrap. */
+void buffer_bootstrap(void);
+
+/*
+ * Start the syncer and prefetcher threads. Called from boot, once
+ * threads can run.
+ */
+void buffer_start_threads(void);
+
+/*
+ * Get a pinned buffer for BLOCK of DEV.
+ *
+ * buffer_read returns the block's current contents, reading it from
+ * the device if it is not cached. buffer_get does not read the
+ * device: it is for callers that are about to overwrite the whole
+ * block. If the block was not cached, its buffer comes back zeroed.
+ */
+int buffer_read(struct device *dev, uint32_t block, struct buf **ret);
+int buffer_get(struct device *dev, uint32_t block, struct buf **ret);
+
+/* Get the data area (BUFFER_SIZE bytes) of a pinned buffer. */
+void *buffer_map(struct buf *b);
+
+/* Note that the caller has modified a pinned buffer. */
+void buffer_mark_dirty(struct buf *b);
+
+/* Unpin a buffer. */
+void buffer_release(struct buf *b);
+
+/*
+ * Forget BLOCK of DEV, if it is cached, without writing it back. For
+ * blocks that have been freed; the block must not be pinned.
+ */
+void buffer_drop(struct device *dev, uint32_t block);
+
+/*
+ * Ask for BLOCK of DEV to be read into the cache in the background,
+ * because it will probably be wanted soon. Returns at once.
+ */
+void buffer_prefetch(struct device *dev, uint32_t block);
+
+/* Write back all dirty buffers of DEV (or of all devices, if NULL). */
+int buffer_sync(struct device *dev);
+
+/*
+ * Write back the dirty buffers of blocks FIRST to FIRST+N-1 of DEV.
+ * For fsync, which only wants one file's blocks written.
+ */
+int buffer_sync_range(struct device *dev, uint32_t first, uint32_t n);
+
+/*
+ * Forget all buffers of DEV, which must all be clean and unpinned.
+ * For unmount.
+ */
+void buffer_invalidate(struct device *dev);
+
+/* Print hit/miss/eviction counters. */
+void buffer_printstats(void);
+
+#endif /* _BUF_H_ */
@@ -38,10 +38,11 @@
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU every timer tick (LT_GRANULARITY
+ * usec) to drive the timer wheel; see below.
  *
  * gettime() may be used to fetch the current time of day.
+ * getuptime() fetches the time since the clock was attached at boot.
  * getinterval() computes the time from time1 to time2.
  *
  * XXX we have struct timespec now, let's use it.
@@ -62,16 +63,62 @@ void hardclock(void);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+void getuptime(time_t *seconds, uint32_t *nanoseconds);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
                  time_t *rsecs, uint32_t *rnsecs);
 
+/*
+ * Timer wheel.
+ *
+ * A callout is a function to be called once, from the timer interrupt,
+ * after a given delay. The caller provides the struct callout, which
+ * must stay valid until the callout has run or been cancelled; call
+ * callout_init on it once before first use.
+ *
+ * callout_schedule arranges for FUNC(ARG) to be called USEC
+ * microseconds from now, rounded up to the next timer tick. If the
+ * callout was already scheduled it is moved. callout_schedule_at is
+ * the same but takes the tick to run at (see clock_ticks below); a
+ * tick that has already come means the next one. callout_cancel
+ * unschedules it, and returns false if it was not scheduled (either
+ * it was never scheduled, or it has already run or is running now).
+ *
+ * Callout functions run in interrupt context with no locks held: they
+ * may not sleep, but may take spinlocks and wake threads. They should
+ * be short, since they hold up the rest of the tick.
+ *
+ * Pending callouts are kept in a hierarchical timing wheel, so that
+ * scheduling, cancelling, and each tick all take constant time no
+ * matter how many callouts are pending or how far off they are.
+ *
+ * clock_ticks() returns the number of timer ticks since boot (it wraps
+ * around, so compare tick counts by subtracting them).
+ * clock_usec_to_ticks() converts a delay to ticks, rounding up.
+ */
+
+struct callout {
+	struct callout *co_next;	/* in wheel slot; private */
+	struct callout **co_prevp;	/* NULL when not scheduled */
+	uint32_t co_expire;		/* tick to run at */
+	void (*co_func)(void *);
+	void *co_arg;
+};
+
+void callout_init(struct callout *co);
+void callout_schedule(struct callout *co, void (*func)(void *), void *arg,
+		      uint32_t usec);
+void callout_schedule_at(struct callout *co, void (*func)(void *),
+			 void *arg, uint32_t tick);
+bool callout_cancel(struct callout *co);
+
+uint32_t clock_ticks(void);
+uint32_t clock_usec_to_ticks(uint32_t usec);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
- *
- *  this will be more efficient than clocknap() for longer sleeps
  */
 void clocksleep(int seconds);
 
@@ -80,6 +127,7 @@ void clocksleep(int seconds);
  *
  * the timer ticks every LT_GRANULARITY usec (see kern/dev/ltimer.h)
  *
+ * Both of these are thread_sleep_until (see thread.h) underneath.
  */
 void clocknap(int ticks);
 
@@ -0,0 +1,67 @@
+#ifndef _DCACHE_H_
+#define _DCACHE_H_
+
+/*
+ * Directory name lookup cache.
+ *
+ * vfs_lookup remembers the results of VOP_LOOKUP, keyed by the vnode
+ * the lookup started from and the path it was given, so looking up
+ * the same name again doesn't have to go to the filesystem. Failed
+ * lookups (ENOENT) are remembered too, as negative entries.
+ *
+ * A positive entry holds a reference to the vnode it names, and every
+ * entry holds a reference to its directory, so neither can be
+ * reclaimed and reused while the entry exists. Entries are replaced
+ * with the CLOCK algorithm.
+ *
+ * The VFS layer calls dcache_invalidate after anything that changes
+ * the names in a directory (create, remove, rename, link and so on),
+ * and dcache_purgefs before unmounting. A filesystem whose lookups
+ * take whole multi-component paths (emufs) may have more than one
+ * vnode for the same directory, so dcache_invalidate also throws away
+ * every entry on the same filesystem that isn't keyed by the same
+ * directory and a single name.
+ */
+
+struct fs;	/* from <fs.h> */
+struct vnode;	/* from <vnode.h> */
+
+/* Number of entries */
+#define DCACHE_SIZE		128
+
+/* Number of hash buckets */
+#define DCACHE_HASHSIZE		64
+
+/* Longest path that gets cached */
+#define DCACHE_NAMEMAX		63
+
+/* Set up the cache. Called from vfs_bootstrap. */
+void dcache_bootstrap(void);
+
+/*
+ * Look up NAME in DIR. Returns true on a hit, with a new reference to
+ * the vnode in *RET, or NULL in *RET for a negative entry; false if
+ * the cache doesn't know.
+ */
+bool dcache_lookup(struct vnode *dir, const char *name, struct vnode **ret);
+
+/*
+ * Remember that NAME in DIR is VN (or, if VN is NULL, doesn't exist).
+ * GEN is what dcache_generation returned before the caller started
+ * the lookup; if anything has been invalidated since, the result may
+ * already be stale, and it's dropped.
+ */
+unsigned dcache_generation(void);
+void dcache_enter(struct vnode *dir, const char *name, struct vnode *vn,
+		  unsigned gen);
+
+/* Forget NAME in DIR, because it has changed. See above. */
+void dcache_invalidate(struct vnode *dir, const char *name);
+
+/* Forget everything on FS. */
+void dcache_purgefs(struct fs *fs);
+
+/* Print hit/miss counters. */
+void dcache_printstats(void);
+
+#endif /* _DCACHE_H_ */
@@ -36,6 +36,7 @@
 
 
 struct uio;  /* in <uio.h> */
+struct bioq; /* in <bioq.h> */
 
 /*
  * Filesystem-namespace-accessible device.
@@ -52,6 +53,8 @@ struct device {
 
 	dev_t d_devnumber;	/* serial number for this device */
 
+	struct bioq *d_bioq;	/* request queue, or NULL (see bioq.h) */
+
 	void *d_data;		/* device-specific data */
 };
 
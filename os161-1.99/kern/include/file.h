@@ -0,0 +1,78 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open files and per-process file descriptor tables.
+ *
+ * An openfile is what a file descriptor refers to: a vnode plus the
+ * seek offset and the mode it was opened with. Openfiles are
+ * refcounted, because dup2() and fork() make several descriptors (in
+ * one or several processes) share the same one, and with it the same
+ * offset.
+ */
+
+#include <limits.h>
+#include <uio.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;		/* the file */
+	int of_flags;			/* open flags (O_ACCMODE, O_APPEND) */
+	off_t of_offset;		/* seek position */
+	struct readahead of_ra;		/* how it's being read */
+	int of_refcount;		/* number of descriptors using this */
+	struct lock *of_lock;		/* protects the three above */
+};
+
+/*
+ * Open a file by name and wrap it in an openfile with one reference.
+ * Returns an error code. PATH may be modified (see vfs_open).
+ */
+int openfile_open(char *path, int flags, mode_t mode,
+		  struct openfile **ret);
+
+void openfile_incref(struct openfile *of);
+/* Drop a reference; the last one closes the file. */
+void openfile_decref(struct openfile *of);
+
+
+/*
+ * File descriptor table. There is one per user process, and since user
+ * processes are single-threaded only that process's thread ever looks
+ * at it, so it needs no lock of its own.
+ */
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+struct filetable *filetable_create(void);
+
+/* Make a copy of a table, sharing the openfiles (for fork). */
+int filetable_copy(struct filetable *ft, struct filetable **ret);
+
+/* Close everything and free the table. */
+void filetable_destroy(struct filetable *ft);
+
+/* Look up a descriptor; EBADF if it isn't open. */
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+
+/*
+ * Put an openfile in the lowest free slot and return the descriptor;
+ * EMFILE if there isn't one. Takes over the caller's reference.
+ */
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+
+/*
+ * Put an openfile in slot FD (which must be valid), taking over the
+ * caller's reference. Whatever was there before is closed.
+ */
+void filetable_setfd(struct filetable *ft, int fd, struct openfile *of);
+
+/*
+ * Set up stdin, stdout and stderr on the console, as for a new process.
+ */
+int filetable_openconsole(struct filetable *ft);
+
+#endif /* _FILE_H_ */
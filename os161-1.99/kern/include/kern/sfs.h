@@ -39,7 +39,8 @@
 #define SFS_MAGIC         0xabadf001    /* magic number identifying us */
 #define SFS_BLOCKSIZE     512           /* size of our blocks */
 #define SFS_VOLNAME_SIZE  32            /* max length of volume name */
-#define SFS_NDIRECT       15            /* # of direct blocks in inode */
+#define SFS_VERSION       2             /* on-disk format revision */
+#define SFS_NEXTENTS      40            /* # of extents in inode */
 #define SFS_DBPERIDB      128           /* # direct blks per indirect blk */
 #define SFS_NAMELEN       60            /* max length of filename */
 #define SFS_SB_LOCATION    0            /* block the superblock lives in */
@@ -59,6 +60,29 @@
 /* Size of bitmap (in blocks) */
 #define SFS_BITBLOCKS(nblocks)  (SFS_BITMAPSIZE(nblocks)/SFS_BLOCKBITS)
 
+/*
+ * Where the blocks of a file are.
+ *
+ * The inode has a table of extents, each mapping a run of consecutive
+ * file blocks to a run of consecutive disk blocks. The extents in use
+ * are kept sorted by file block and never overlap; file blocks that no
+ * extent (and no indirect tree, below) maps are holes, which read as
+ * zeros. A file written in order onto free space is one extent no
+ * matter how big it is.
+ *
+ * When a block can't be added to an extent and the table is full, it
+ * goes in one of three indirect trees instead, which map file blocks
+ * by position like the block lists of older filesystems: the single
+ * indirect block maps file blocks 0 to SFS_DIDBASE-1, the double
+ * indirect block the next SFS_DBPERIDB^2, and the triple indirect
+ * block the SFS_DBPERIDB^3 after that. A block is mapped by an extent
+ * or by a tree, never both.
+ */
+#define SFS_DIDBASE       SFS_DBPERIDB  /* 1st blk mapped by dbl indirect */
+#define SFS_TIDBASE       (SFS_DIDBASE + SFS_DBPERIDB*SFS_DBPERIDB)
+#define SFS_MAXFILEBLOCKS \
+	(SFS_TIDBASE + SFS_DBPERIDB*SFS_DBPERIDB*SFS_DBPERIDB)
+
 /* File types for sfi_type */
 #define SFS_TYPE_INVAL    0       /* Should not appear on disk */
 #define SFS_TYPE_FILE     1
@@ -71,7 +95,17 @@ struct sfs_super {
 	uint32_t sp_magic;		/* Magic number, should be SFS_MAGIC */
 	uint32_t sp_nblocks;			/* Number of blocks in fs */
 	char sp_volname[SFS_VOLNAME_SIZE];	/* Name of this volume */
-	uint32_t reserved[118];
+	uint32_t sp_version;			/* Should be SFS_VERSION */
+	uint32_t reserved[117];
+};
+
+/*
+ * On-disk extent
+ */
+struct sfs_extent {
+	uint32_t se_fileblock;			/* First file block mapped */
+	uint32_t se_diskblock;			/* Where that block is */
+	uint32_t se_nblocks;			/* Length of the run */
 };
 
 /*
@@ -81,9 +115,12 @@ struct sfs_inode {
 	uint32_t sfi_size;			/* Size of this file (bytes) */
 	uint16_t sfi_type;			/* One of SFS_TYPE_* above */
 	uint16_t sfi_linkcount;			/* # hard links to this file */
-	uint32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
+	uint32_t sfi_nextents;			/* # of extents in use */
+	struct sfs_extent sfi_extents[SFS_NEXTENTS]; /* Extents, in order */
 	uint32_t sfi_indirect;			/* Indirect block */
-	uint32_t sfi_waste[128-3-SFS_NDIRECT];	/* unused space, set to 0 */
+	uint32_t sfi_dindirect;			/* Double indirect block */
+	uint32_t sfi_tindirect;			/* Triple indirect block */
+	uint32_t sfi_waste[128-6-3*SFS_NEXTENTS]; /* unused space, set to 0 */
 };
 
 /*
@@ -51,6 +51,13 @@ struct timespec {
 };
 
 
+/*
+ * Clocks for clock_gettime.
+ */
+#define CLOCK_REALTIME	0	/* Time of day. */
+#define CLOCK_MONOTONIC	1	/* Time since boot; never goes backwards. */
+
+
 /*
  * Bits for interval timers. Obscure and not really that important.
  */
@@ -0,0 +1,61 @@
+#ifndef _KERN_TRACE_H_
+#define _KERN_TRACE_H_
+
+/*
+ * Kernel trace definitions visible to userspace: the event codes and
+ * the format of the trace files written by the kernel's "trdump" menu
+ * command, for tools that decode them, such as tracedecode.
+ *
+ * A trace file is a struct trace_header followed by th_nrecords
+ * struct trace_records, oldest first. Everything is in the kernel's
+ * byte order (big-endian, on System/161).
+ */
+
+#define TRACE_MAGIC	0x74726331	/* "trc1" */
+
+/*
+ * Events. Each record carries two arguments, whose meaning depends on
+ * the event.
+ */
+#define TP_SYSCALL_ENTER	1	/* call number, first argument */
+#define TP_SYSCALL_EXIT		2	/* call number, error (0 if none) */
+#define TP_VM_FAULT		3	/* fault type, faulting address */
+#define TP_THREAD_SWITCH	4	/* thread switched to, old state */
+#define TP_LOCK_ACQUIRE		5	/* lock, 1 if we had to wait */
+#define TP_DISK_START		6	/* sector, count (| TRACE_DISK_WRITE) */
+#define TP_DISK_DONE		7	/* sector, error (0 if none) */
+#define TP_NEVENTS		8
+
+/* Flag in the second argument of TP_DISK_START for writes */
+#define TRACE_DISK_WRITE	0x80000000
+
+/* Event mask bit for event E */
+#define TP_BIT(e)		(1U << (e))
+#define TP_ALL			(TP_BIT(TP_NEVENTS) - 2)
+
+struct trace_header {
+	uint32_t th_magic;		/* TRACE_MAGIC */
+	uint32_t th_nrecords;		/* number of records that follow */
+	uint32_t th_lost;		/* older records overwritten */
+	uint32_t th_mask;		/* events that were being traced */
+};
+
+struct trace_record {
+	uint32_t tr_secs;		/* time of the event */
+	uint32_t tr_nsecs;
+	uint32_t tr_thread;		/* thread (address of its struct) */
+	uint16_t tr_event;		/* TP_* */
+	uint16_t tr_cpu;		/* CPU number */
+	uint32_t tr_arg0;
+	uint32_t tr_arg1;
+};
+
+/*
+ * When records are also sent to trace161 through the ltrace device,
+ * each one goes as three debug codes: TRACE_LTRACE_WORD(event, cpu),
+ * then the two arguments.
+ */
+#define TRACE_LTRACE_TAG	0x7e000000
+#define TRACE_LTRACE_WORD(e, cpu) (TRACE_LTRACE_TAG | ((e) << 8) | (cpu))
+
+#endif /* _KERN_TRACE_H_ */
@@ -0,0 +1,56 @@
+#ifndef _KLOG_H_
+#define _KLOG_H_
+
+/*
+ * Kernel log.
+ *
+ * klog_printf (declared in lib.h, because DEBUG uses it) is a kprintf
+ * that does not wait for the console. It formats the message into a
+ * record in a ring belonging to the current CPU and returns; a drainer
+ * thread prints the records later. Each record carries the time it
+ * was logged, the CPU, and the name of the thread that logged it.
+ *
+ * Only the owning CPU ever adds to a ring, and it does so with
+ * interrupts off, so logging takes no locks and never sleeps: it is
+ * safe anywhere, including interrupt handlers and code holding
+ * spinlocks. The drainer is the only one that removes records. If a
+ * ring is full the new record is dropped and counted, and the drainer
+ * reports how many were lost; logging never waits for the drainer.
+ *
+ * Until klog_start_thread has been called, klog_printf just calls
+ * kprintf.
+ */
+
+struct cpu;	/* from <cpu.h> */
+
+/* Records per CPU ring */
+#define KLOG_NRECORDS	64
+
+/* Longest message kept per record (including the terminating null) */
+#define KLOG_MSGLEN	112
+
+/* Longest thread name kept per record (including the null) */
+#define KLOG_NAMELEN	16
+
+/* Most CPUs that can have rings */
+#define KLOG_MAXCPUS	32
+
+/* Allocate the ring for a new CPU. Called from cpu_create. */
+void klog_cpuinit(struct cpu *c);
+
+/*
+ * Start the drainer thread and switch klog_printf over to the rings.
+ * Called from boot, once the clock exists and threads can run.
+ */
+void klog_start_thread(void);
+
+/* Print everything logged so far, and wait until it has been printed. */
+void klog_flush(void);
+
+/*
+ * Print everything logged so far, without locking. For panic, after
+ * the other CPUs have been stopped.
+ */
+void klog_dump(void);
+
+#endif /* _KLOG_H_ */
@@ -103,12 +103,17 @@ extern uint32_t dbflags;
  * are printed or not at runtime by setting the value of dbflags with
  * the debugger.
  *
+ * The messages go through the kernel log (klog.h) rather than straight
+ * to the console, so that turning them on in busy code paths doesn't
+ * make every caller wait for the serial line. They show up shortly
+ * afterwards, stamped with the time, CPU, and thread.
+ *
  * Unfortunately, as of this writing, there are only a very few such
  * messages actually present in the system yet. Feel free to add more.
  *
  * DEBUG is a varargs macro. These were added to the language in C99.
  */
-#define DEBUG(d, ...) ((dbflags & (d)) ? kprintf(__VA_ARGS__) : 0)
+#define DEBUG(d, ...) ((dbflags & (d)) ? klog_printf(__VA_ARGS__) : 0)
 
 /*
  * Random number generator, using the random device.
@@ -172,12 +177,15 @@ void beep(void);
  * resets the system.
  * badassert calls panic in a way suitable for an assertion failure.
  * kgets is like gets, only with a buffer size argument.
+ * klog_printf is like kprintf, but puts the message in the kernel log
+ * instead of waiting for the console; see klog.h.
  *
  * kprintf_bootstrap sets up a lock for kprintf and should be called
  * during boot once malloc is available and before any additional
  * threads are created.
  */
 int kprintf(const char *format, ...) __PF(1,2);
+int klog_printf(const char *format, ...) __PF(1,2);
 void panic(const char *format, ...) __PF(1,2);
 void badassert(const char *expr, const char *file, int line, const char *func);
 
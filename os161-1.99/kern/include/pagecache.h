@@ -0,0 +1,63 @@
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+/*
+ * Page cache for executables.
+ *
+ * load_elf reads program files through this cache, which keeps their
+ * contents in memory a page at a time, indexed by vnode and page
+ * number, so exec'ing the same program again copies its segments out
+ * of memory instead of going back to the filesystem.
+ *
+ * Pages are allocated as they are first needed, up to a fraction of
+ * physical memory, and replaced with the CLOCK algorithm. The cache
+ * stops growing, and gives pages back as it replaces them, while
+ * free memory is below PAGECACHE_LOWFREE pages. If the page allocator
+ * runs out altogether, it calls pagecache_shrink to get back all the
+ * pages nobody is using.
+ *
+ * The cache doesn't hold references to vnodes. Instead, vnode_cleanup
+ * throws away a vnode's pages when the vnode is reclaimed, and the
+ * VFS layer calls pagecache_invalidate whenever a file is written or
+ * truncated.
+ */
+
+struct vnode;	/* from <vnode.h> */
+struct uio;	/* from <uio.h> */
+
+/* Most of physical memory used for the cache (1/PAGECACHE_RAMFRACTION) */
+#define PAGECACHE_RAMFRACTION	8
+
+/* Never have room for fewer pages than this */
+#define PAGECACHE_MIN		16
+
+/* Don't grow the cache once free memory drops below this many pages */
+#define PAGECACHE_LOWFREE	32
+
+/*
+ * Set up the cache. Called from vfs_bootstrap; no pages are allocated
+ * until the VM system is running.
+ */
+void pagecache_bootstrap(void);
+
+/*
+ * Like VOP_READ(V, UIO), but through the cache. UIO may be in user or
+ * kernel space.
+ */
+int pagecache_read(struct vnode *v, struct uio *uio);
+
+/* Throw away all cached pages of V, because it has changed or gone. */
+void pagecache_invalidate(struct vnode *v);
+
+/*
+ * Free every cached page not in use, and return how many were freed.
+ * For the page allocator, when it's out of memory. Never sleeps, so
+ * it may be called with spinlocks held; it gives up (returning 0) if
+ * the cache is locked, which it is while the cache itself allocates.
+ */
+unsigned pagecache_shrink(void);
+
+/* Print hit/miss counters and the bytes served from the cache. */
+void pagecache_printstats(void);
+
+#endif /* _PAGECACHE_H_ */
@@ -39,9 +39,11 @@
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
 #include <array.h> /* required for dynamic process arrays */
+#include <machine/trapframe.h> /* required for p_forktf */
 
 struct addrspace;
 struct vnode;
+struct filetable;
 #ifdef UW
 struct semaphore;
 #endif // UW
@@ -62,18 +64,22 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
-#ifdef UW
-  /* a vnode to refer to the console device */
-  /* this is a quick-and-dirty way to get console writes working */
-  /* you will probably need to change this when implementing file-related
-     system calls, since each process will need to keep track of all files
-     it has opened, not just the console. */
-  struct vnode *console;                /* a vnode for the console device */
-#endif
+	struct filetable *p_filetable;	/* open file descriptors (see file.h) */
 
 	/* add more material here as needed */
 	pid_t p_id; // pid implementation
 	struct proc * p_parent; // parent-child implementation 
+	struct skeleboi * p_skeleton; // our entry in the pid table (protected by master_lock)
+
+	// Fork support: the parent's trapframe lives here (instead of in a
+	// separate kmalloc) until the child copies it onto its own stack
+	struct trapframe p_forktf;
+	time_t p_fork_secs;    // when fork() was called, for procstats
+	uint32_t p_fork_nsecs;
+
+	// vfork support: non-NULL while we are running on our parent's address
+	// space; V'd (and cleared) once we exec or exit, to release the parent
+	struct semaphore * p_vfork_sem;
 	//struct array * p_children;
 	
 	// Additional synchronization components
@@ -86,22 +92,47 @@ struct proc {
 	int p_exitcode; 
 };
 
-/* proctable is a global array of process pointers*/
-struct array * proctable; 
+/* master_lock protects the pid table and every skeleton in it */
 struct lock * master_lock; 
-struct cv * master_condition;
 
 // New Idea: dont delete, just leave behind a SKELETON 
 struct skeleboi 
 {
 	// the process
 	struct proc * p_this; 
-	struct proc * p_parent;
+	struct skeleboi * p_parent; // NULL once the parent has exited
 	pid_t p_id;
 	bool terminated; 
 	int exitcode; 
+	// each skeleton has its own wait channel, so an exiting process only
+	// wakes up its own parent instead of every waiter in the system
+	struct cv * exit_cv; 
+
+	// parent->children list, so exit only has to look at our own children
+	struct skeleboi * s_children; // first child
+	struct skeleboi * s_sibling;  // next child of our parent
+
+	struct skeleboi * s_hashnext; // pid table hash chain
 };
 
+/*
+ * The pid table: skeletons hashed by pid, plus a bitmap of pids in use
+ * (bounded by PID_MIN/PID_MAX). Lookup, insert and remove are O(1).
+ * All of these must be called with master_lock held.
+ */
+#define PIDTABLE_SIZE 128 /* number of hash buckets, must be power of 2 */
+
+struct skeleboi *pidtable_lookup(pid_t pid);
+
+/* Make CHILD a child of PARENT. */
+void skeleton_adopt(struct skeleboi *parent, struct skeleboi *child);
+
+/* Remove CHILD from its parent's list of children. */
+void skeleton_disown(struct skeleboi *child);
+
+/* Remove a skeleton from the pid table, release its pid, and free it. */
+void skeleton_destroy(struct skeleboi *s);
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
@@ -116,6 +147,28 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
+/* Create a process for fork(), sharing the current process's open files and cwd. */
+struct proc *proc_create_fork(const char *name);
+
+/*
+ * Called by a vfork child once it no longer uses its parent's address space
+ * (that is, it has exec'd or is exiting). Does nothing for other processes.
+ */
+void proc_vfork_release(struct proc *proc);
+
+/*
+ * Fork/exec latency instrumentation. For fork, the parent records the time
+ * from entering sys_fork until it returns, the child the time from the
+ * parent entering sys_fork until the child is about to return to user mode.
+ * For execv, the time from entering sys_execv until entering the new program.
+ */
+#define PROCSTAT_FORK_PARENT 0
+#define PROCSTAT_FORK_CHILD  1
+#define PROCSTAT_EXEC        2
+#define PROCSTAT_COUNT       3
+void procstats_record(unsigned which, time_t startsecs, uint32_t startnsecs);
+void procstats_print(void);
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
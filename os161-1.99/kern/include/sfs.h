@@ -41,6 +41,7 @@
  */
 #include <fs.h>
 #include <vnode.h>
+#include <uio.h>
 
 /*
  * Get on-disk structures and constants that are made available to 
@@ -48,19 +49,57 @@
  */
 #include <kern/sfs.h>
 
+/*
+ * Locking (see design/fslocking.txt for the whole story):
+ *
+ * sv_lock covers the rest of a struct sfs_vnode (but sv_ino and the
+ * inode's type never change, and the last two fields belong to the
+ * vnode tables), and the file's data, indirect and (for directories)
+ * entry blocks. Take a directory's lock before the lock of a file in
+ * it.
+ *
+ * sfs_vnlock covers sfs_vnodes, sfs_vhash, sv_hashnext and sv_vnix,
+ * and so who can get at a vnode; it may be taken while holding vnode
+ * locks. sfs_freemaplock covers the freemap, the superblock and their
+ * dirty flags, and is taken last.
+ */
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
+	struct lock *sv_lock;           /* lock for the rest of this */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct readahead sv_ra;         /* readahead for reads with no file */
+	uint32_t sv_bgoal;              /* allocation: block to try next */
+	uint32_t sv_prealloc;           /* allocation: first reserved block */
+	uint32_t sv_npreallocs;         /* allocation: how many are reserved */
+	struct sfs_dirindex *sv_dirindex; /* directories: name index, or NULL */
+	struct sfs_vnode *sv_hashnext;  /* next in sfs_vhash chain */
+	unsigned sv_vnix;               /* index in sfs_vnodes */
 };
 
+/* Readahead window, in blocks: starts at SFS_RAMIN, doubles up to SFS_RAMAX */
+#define SFS_RAMIN 4
+#define SFS_RAMAX 32
+
+/* Blocks reserved past the end of a file being appended to */
+#define SFS_PREALLOC 8
+
+/* Hash buckets a directory index starts with; doubled as it fills */
+#define SFS_DIRHASH_MIN 16
+
+/* Buckets in the per-filesystem table of loaded vnodes, by inode number */
+#define SFS_VHASHSIZE 256
+
 struct sfs_fs {
 	struct fs sfs_absfs;            /* abstract filesystem structure */
 	struct sfs_super sfs_super;	/* on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
+	struct lock *sfs_vnlock;        /* lock for the vnode tables */
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct sfs_vnode *sfs_vhash[SFS_VHASHSIZE]; /* same, by inode number */
+	struct lock *sfs_freemaplock;   /* lock for freemap and superblock */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
 };
@@ -75,15 +114,13 @@ int sfs_mount(const char *device);
  * Internal functions
  */
 
-/* Initialize uio structure */
-#define SFSUIO(iov, uio, ptr, block, rw) \
-    uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
-
-/* Convenience functions for block I/O */
-int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
+/* Convenience functions for whole-block I/O through the buffer cache */
 int sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
 
+/* Write a vnode's inode to the buffer cache if it changed (for sync) */
+int sfs_syncinode(struct vnode *v);
+
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
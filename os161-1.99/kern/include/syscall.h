@@ -33,6 +33,7 @@
 #include <opt-A2.h>
 
 struct trapframe; /* from <machine/trapframe.h> */
+#include <uio.h> /* for enum uio_rw */
 
 /*
  * The system call dispatcher.
@@ -58,9 +59,19 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_clock_gettime(int clockid, userptr_t user_ts);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
 
 #ifdef UW
+int sys_open(userptr_t upath, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_pread(int fdesc,userptr_t ubuf,unsigned int nbytes,off_t pos,int *retval);
+int sys_pwrite(int fdesc,userptr_t ubuf,unsigned int nbytes,off_t pos,int *retval);
+int sys_readwritev(int fdesc,userptr_t uiov,int iovcnt,enum uio_rw rw,int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_close(int fdesc);
+int sys_dup2(int oldfd, int newfd, int *retval);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
@@ -69,6 +80,7 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
 #ifdef OPT_A2 
 int sys_fork(struct trapframe* parent_tf, pid_t *retval);
+int sys_vfork(struct trapframe* parent_tf, pid_t *retval);
 int sys_execv(userptr_t program, userptr_t args);
 #endif // OPT_A2
 
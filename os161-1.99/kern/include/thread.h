@@ -157,6 +157,13 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Cause the current thread to sleep until the tick count (see
+ * clock_ticks in clock.h) reaches DEADLINE. Returns at once if it
+ * already has. The thread is woken exactly once, by a callout.
+ */
+void thread_sleep_until(uint32_t deadline);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
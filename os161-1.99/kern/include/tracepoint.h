@@ -0,0 +1,54 @@
+#ifndef _TRACEPOINT_H_
+#define _TRACEPOINT_H_
+
+/*
+ * Static tracepoints.
+ *
+ * TRACEPOINT(event, arg0, arg1) marks a place in the kernel where
+ * something worth tracing happens; the events and the meaning of
+ * their arguments are listed in <kern/trace.h>. When the event is not
+ * being traced, a tracepoint costs a load and a test. When it is, it
+ * appends a binary record (time, CPU, thread, event, arguments) to the
+ * trace ring, overwriting the oldest record if the ring is full, and
+ * if asked also sends it to trace161 through ltrace_debug.
+ *
+ * Tracing is controlled from the kernel menu (tron, troff, trdump).
+ * The ring is allocated when tracing is first turned on and freed when
+ * it is dumped. Tracepoints take a spinlock, so they may be used
+ * anywhere, including with interrupts off and spinlocks held.
+ */
+
+#include <kern/trace.h>
+
+/* Records in the trace ring */
+#define TRACE_NRECORDS	4096
+
+/* Events being traced (TP_BIT mask); 0 when tracing is off */
+extern volatile uint32_t tracepoint_mask;
+
+#define TRACEPOINT(e, a0, a1) \
+	do { \
+		if (tracepoint_mask & TP_BIT(e)) { \
+			tracepoint_hit(e, (uint32_t)(a0), (uint32_t)(a1)); \
+		} \
+	} while (0)
+
+/* Record an event. Called by TRACEPOINT. */
+void tracepoint_hit(unsigned event, uint32_t arg0, uint32_t arg1);
+
+/*
+ * Start tracing the events in MASK, after emptying the ring. If
+ * USELTRACE is true, also send each record to trace161.
+ */
+int tracepoint_start(uint32_t mask, bool useltrace);
+
+/* Stop tracing. The records stay in the ring. */
+void tracepoint_stop(void);
+
+/*
+ * Stop tracing and write the contents of the ring to the file PATH in
+ * the format described in <kern/trace.h>, then free the ring.
+ */
+int tracepoint_dump(const char *path);
+
+#endif /* _TRACEPOINT_H_ */
@@ -52,6 +52,19 @@ enum uio_seg {
         UIO_SYSSPACE,			/* Kernel. */
 };
 
+/*
+ * Readahead state: how a file is being read, so a filesystem can tell
+ * sequential reads and fetch ahead of them. Each open file has its
+ * own, passed down with its reads in uio_ra, so two readers of one
+ * file don't upset each other's pattern. All zeros is the initial
+ * state; what the fields mean beyond that is up to the filesystem.
+ */
+struct readahead {
+	uint32_t ra_next;		/* next block, if sequential */
+	uint32_t ra_window;		/* how far ahead to read */
+	uint32_t ra_end;		/* first block not yet prefetched */
+};
+
 struct uio {
 	struct iovec     *uio_iov;	/* Data blocks */
 	unsigned          uio_iovcnt;	/* Number of iovecs */
@@ -60,6 +73,7 @@ struct uio {
 	enum uio_seg      uio_segflg;	/* What kind of pointer we have */
 	enum uio_rw       uio_rw;	/* Whether op is a read or write */
 	struct addrspace *uio_space;	/* Address space for user pointer */
+	struct readahead *uio_ra;	/* Reader's readahead state, or NULL */
 };
 
 
@@ -30,6 +30,7 @@
 #ifndef _VNODE_H_
 #define _VNODE_H_
 
+#include <spinlock.h>
 
 struct uio;
 struct stat;
@@ -50,10 +51,17 @@ struct stat;
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
+ *
+ * Both counts are protected by vn_countlock. vn_cachedpages, the
+ * number of the file's pages in the page cache (pagecache.h), belongs
+ * to the page cache. Everything else about the file is up to the
+ * filesystem to lock.
  */
 struct vnode {
 	int vn_refcount;                /* Reference count */
 	int vn_opencount;
+	struct spinlock vn_countlock;   /* Lock for vn_refcount and vn_opencount */
+	unsigned vn_cachedpages;        /* Pages in the page cache */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
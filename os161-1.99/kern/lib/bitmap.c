@@ -49,6 +49,7 @@
 
 struct bitmap {
         unsigned nbits;
+        unsigned hint;          /* where the next bitmap_alloc starts looking */
         WORD_TYPE *v;
 };
 
@@ -72,6 +73,7 @@ bitmap_create(unsigned nbits)
 
         bzero(b->v, words*sizeof(WORD_TYPE));
         b->nbits = nbits;
+        b->hint = 0;
 
         /* Mark any leftover bits at the end in use */
         if (words > nbits / BITS_PER_WORD) {
@@ -95,29 +97,101 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
+/*
+ * Return the index of the first word in [IX, LIMIT) that isn't full,
+ * or LIMIT if there isn't one. Full words are skipped four at a time
+ * where they are aligned for it. (This compares against all ones,
+ * which looks the same in either byte order, so it doesn't bring back
+ * the endianness problem described above.)
+ */
+static
+unsigned
+bitmap_findword(struct bitmap *b, unsigned ix, unsigned limit)
+{
+        while (ix < limit && ix % sizeof(uint32_t) != 0 &&
+               b->v[ix] == WORD_ALLBITS) {
+                ix++;
+        }
+        while (ix % sizeof(uint32_t) == 0 && ix + sizeof(uint32_t) <= limit &&
+               *(uint32_t *)&b->v[ix] == 0xffffffff) {
+                ix += sizeof(uint32_t);
+        }
+        while (ix < limit && b->v[ix] == WORD_ALLBITS) {
+                ix++;
+        }
+        return ix;
+}
+
+/*
+ * Find the first clear bit at or after START, wrapping around to the
+ * beginning if need be, set it, and return its index.
+ */
+static
 int
-bitmap_alloc(struct bitmap *b, unsigned *index)
+bitmap_allocfrom(struct bitmap *b, unsigned start, unsigned *index)
 {
-        unsigned ix;
         unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        unsigned startix, ix, offset;
+        WORD_TYPE w, mask;
+
+        if (b->nbits == 0) {
+                return ENOSPC;
+        }
+        if (start >= b->nbits) {
+                start = 0;
+        }
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
-
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
-                                        return 0;
-                                }
+        /* First the bits of START's word from START up... */
+        startix = start / BITS_PER_WORD;
+        mask = ((WORD_TYPE)1 << (start % BITS_PER_WORD)) - 1;
+        ix = startix;
+        w = b->v[ix] | mask;
+
+        if (w == WORD_ALLBITS) {
+                /* ...then the words after it, then from the beginning. */
+                ix = bitmap_findword(b, startix+1, maxix);
+                if (ix == maxix) {
+                        ix = bitmap_findword(b, 0, startix+1);
+                        if (ix == startix+1) {
+                                return ENOSPC;
                         }
-                        KASSERT(0);
                 }
+                w = b->v[ix];
+        }
+
+        for (offset = 0; offset < BITS_PER_WORD; offset++) {
+                mask = ((WORD_TYPE)1) << offset;
+                if ((w & mask)==0) {
+                        break;
+                }
+        }
+        KASSERT(offset < BITS_PER_WORD);
+
+        b->v[ix] |= mask;
+        *index = (ix*BITS_PER_WORD)+offset;
+        KASSERT(*index < b->nbits);
+
+        b->hint = *index + 1 < b->nbits ? *index + 1 : 0;
+        return 0;
+}
+
+/*
+ * Start where the last allocation left off, so a mostly-full bitmap
+ * doesn't get scanned from the top every time.
+ */
+int
+bitmap_alloc(struct bitmap *b, unsigned *index)
+{
+        return bitmap_allocfrom(b, b->hint, index);
+}
+
+int
+bitmap_alloc_near(struct bitmap *b, unsigned goal, unsigned *index)
+{
+        if (goal >= b->nbits) {
+                goal = b->hint;
         }
-        return ENOSPC;
+        return bitmap_allocfrom(b, goal, index);
 }
 
 static
@@ -0,0 +1,273 @@
+/*
+ * Kernel log. See klog.h for the interface.
+ *
+ * Each CPU has a ring of fixed-size records. kr_head counts records
+ * ever added and is written only by the owning CPU; kr_tail counts
+ * records ever printed and is written only by whoever holds
+ * klog_drainlock (or by panic, once nobody else is running). The ring
+ * is full when they are KLOG_NRECORDS apart. A record is filled in
+ * before kr_head is advanced past it, and kr_tail is advanced only
+ * after the record has been printed, so neither side ever looks at a
+ * slot the other is using.
+ *
+ * The owning CPU fills a record with interrupts off, so an interrupt
+ * handler that logs cannot land in the middle of a record being
+ * written by the thread it interrupted. That is all the exclusion the
+ * producer side needs. (System/161 does not reorder memory accesses,
+ * so there are no barriers between filling a record and publishing
+ * it; a port to a machine that does would need them there and before
+ * reading the record in the drainer.)
+ *
+ * The drainer prints the records of all rings merged in timestamp
+ * order. It polls rather than being woken, since the loggers may be
+ * in places that cannot wake anyone up. To keep that cheap when
+ * nothing is being logged, loggers set klog_pending and the drainer
+ * only looks at the rings when it is set, checking every
+ * KLOG_IDLEUSEC while idle and every KLOG_BUSYUSEC while busy.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <stdarg.h>
+#include <spl.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <clock.h>
+#include <klog.h>
+
+struct klog_record {
+	time_t kr_secs;			/* when it was logged */
+	uint32_t kr_nsecs;
+	char kr_thread[KLOG_NAMELEN];	/* who logged it */
+	char kr_msg[KLOG_MSGLEN];	/* what they said */
+};
+
+struct klog_ring {
+	volatile unsigned kr_head;	/* records added; owning CPU only */
+	volatile unsigned kr_tail;	/* records printed; drainer only */
+	volatile unsigned kr_dropped;	/* records lost to a full ring */
+	unsigned kr_reported;		/* drops already reported */
+	struct klog_record kr_records[KLOG_NRECORDS];
+};
+
+static struct klog_ring *klog_rings[KLOG_MAXCPUS];
+static unsigned klog_nrings;
+
+/* True once records go to the rings instead of straight to kprintf */
+static volatile bool klog_running;
+
+/* Held by whoever is printing records */
+static struct lock *klog_drainlock;
+
+/* Set when a record is added or dropped; cleared by the drainer */
+static volatile bool klog_pending;
+
+#define KLOG_IDLEUSEC  50000	/* drainer poll interval, nothing logged */
+#define KLOG_BUSYUSEC  10000	/* and after printing something */
+
+void
+klog_cpuinit(struct cpu *c)
+{
+	struct klog_ring *kr;
+
+	if (c->c_number >= KLOG_MAXCPUS) {
+		panic("klog_cpuinit: too many CPUs\n");
+	}
+
+	kr = kmalloc(sizeof(*kr));
+	if (kr == NULL) {
+		panic("klog_cpuinit: Out of memory\n");
+	}
+	kr->kr_head = 0;
+	kr->kr_tail = 0;
+	kr->kr_dropped = 0;
+	kr->kr_reported = 0;
+
+	klog_rings[c->c_number] = kr;
+	if (c->c_number >= klog_nrings) {
+		klog_nrings = c->c_number + 1;
+	}
+}
+
+/*
+ * Log a message.
+ */
+int
+klog_printf(const char *fmt, ...)
+{
+	struct klog_ring *kr;
+	struct klog_record *rec;
+	char buf[KLOG_MSGLEN];
+	unsigned head;
+	va_list ap;
+	int spl, chars;
+
+	if (!klog_running) {
+		va_start(ap, fmt);
+		chars = vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		kprintf("%s", buf);
+		return chars;
+	}
+
+	spl = splhigh();
+
+	kr = klog_rings[curcpu->c_number];
+	head = kr->kr_head;
+	if (head - kr->kr_tail >= KLOG_NRECORDS) {
+		kr->kr_dropped++;
+		klog_pending = true;
+		splx(spl);
+		return 0;
+	}
+
+	rec = &kr->kr_records[head % KLOG_NRECORDS];
+	gettime(&rec->kr_secs, &rec->kr_nsecs);
+	snprintf(rec->kr_thread, sizeof(rec->kr_thread), "%s",
+		 curthread->t_name);
+	va_start(ap, fmt);
+	chars = vsnprintf(rec->kr_msg, sizeof(rec->kr_msg), fmt, ap);
+	va_end(ap);
+	if (chars >= KLOG_MSGLEN) {
+		/* Truncated; keep the line break */
+		rec->kr_msg[KLOG_MSGLEN - 2] = '\n';
+	}
+
+	/* Now the drainer may have it. */
+	kr->kr_head = head + 1;
+	klog_pending = true;
+
+	splx(spl);
+	return chars;
+}
+
+/*
+ * Print the oldest record in any ring, and any news of dropped
+ * records. Returns false if there was nothing to print.
+ */
+static
+bool
+klog_print_one(void)
+{
+	struct klog_ring *kr, *best;
+	struct klog_record *rec, *bestrec;
+	unsigned i, bestcpu, dropped;
+
+	best = NULL;
+	bestrec = NULL;
+	bestcpu = 0;
+
+	for (i=0; i<klog_nrings; i++) {
+		kr = klog_rings[i];
+		if (kr == NULL) {
+			continue;
+		}
+
+		dropped = kr->kr_dropped;
+		if (dropped != kr->kr_reported) {
+			kprintf("[klog: cpu%u dropped %u records]\n",
+				i, dropped - kr->kr_reported);
+			kr->kr_reported = dropped;
+		}
+
+		if (kr->kr_tail == kr->kr_head) {
+			continue;
+		}
+		rec = &kr->kr_records[kr->kr_tail % KLOG_NRECORDS];
+		if (bestrec == NULL ||
+		    rec->kr_secs < bestrec->kr_secs ||
+		    (rec->kr_secs == bestrec->kr_secs &&
+		     rec->kr_nsecs < bestrec->kr_nsecs)) {
+			best = kr;
+			bestrec = rec;
+			bestcpu = i;
+		}
+	}
+
+	if (best == NULL) {
+		return false;
+	}
+
+	kprintf("[%llu.%06u cpu%u %s] %s",
+		(unsigned long long)bestrec->kr_secs, bestrec->kr_nsecs / 1000,
+		bestcpu, bestrec->kr_thread, bestrec->kr_msg);
+
+	/* Now the slot may be reused. */
+	best->kr_tail++;
+	return true;
+}
+
+/*
+ * Drainer thread: print whatever turns up. The flag is cleared before
+ * draining, so a record added meanwhile sets it again and is picked
+ * up next time around if this pass misses it.
+ */
+static
+void
+klog_drainer(void *unused1, unsigned long unused2)
+{
+	int idleticks, busyticks;
+
+	(void)unused1;
+	(void)unused2;
+
+	idleticks = clock_usec_to_ticks(KLOG_IDLEUSEC);
+	busyticks = clock_usec_to_ticks(KLOG_BUSYUSEC);
+
+	while (1) {
+		if (!klog_pending) {
+			clocknap(idleticks);
+			continue;
+		}
+		klog_pending = false;
+		lock_acquire(klog_drainlock);
+		while (klog_print_one()) {
+			/* nothing */
+		}
+		lock_release(klog_drainlock);
+		clocknap(busyticks);
+	}
+}
+
+void
+klog_start_thread(void)
+{
+	int result;
+
+	klog_drainlock = lock_create("klog");
+	if (klog_drainlock == NULL) {
+		panic("klog_start_thread: lock_create failed\n");
+	}
+	result = thread_fork("klog", NULL, klog_drainer, NULL, 0);
+	if (result) {
+		panic("klog_start_thread: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	klog_running = true;
+}
+
+void
+klog_flush(void)
+{
+	if (!klog_running) {
+		return;
+	}
+	lock_acquire(klog_drainlock);
+	while (klog_print_one()) {
+		/* nothing */
+	}
+	lock_release(klog_drainlock);
+}
+
+void
+klog_dump(void)
+{
+	if (!klog_running) {
+		return;
+	}
+	while (klog_print_one()) {
+		/* nothing */
+	}
+}
@@ -37,6 +37,7 @@
 #include <synch.h>
 #include <mainbus.h>
 #include <vfs.h>          // for vfs_sync()
+#include <klog.h>
 
 
 /* Flags word for DEBUG() macro. */
@@ -169,6 +170,16 @@ panic(const char *fmt, ...)
 	if (evil == 2) {
 		evil = 3;
 
+		/*
+		 * Print whatever is still in the kernel log, so the
+		 * last things logged come out before the message.
+		 */
+		klog_dump();
+	}
+
+	if (evil == 3) {
+		evil = 4;
+
 		/* Print the message. */
 		kprintf("panic: ");
 		putch_prepare();
@@ -178,15 +189,15 @@ panic(const char *fmt, ...)
 		putch_complete();
 	}
 
-	if (evil == 3) {
-		evil = 4;
+	if (evil == 4) {
+		evil = 5;
 
 		/* Try to sync the disks. */
 		vfs_sync();
 	}
 
-	if (evil == 4) {
-		evil = 5;
+	if (evil == 5) {
+		evil = 6;
 
 		/* Shut down or reboot the system. */
 		mainbus_panic();
@@ -0,0 +1,172 @@
+/*
+ * Static tracepoints. See tracepoint.h for the interface.
+ *
+ * There is one ring for the whole system, protected by trace_lock.
+ * trace_next counts records ever written since tracing was started;
+ * the oldest surviving record is at trace_next - TRACE_NRECORDS once
+ * the ring has wrapped. The ring is only ever read after tracing has
+ * been stopped and the ring detached from trace_ring under the lock,
+ * so nothing can be writing into it at the same time.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <clock.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <lamebus/ltrace.h>
+#include <tracepoint.h>
+
+volatile uint32_t tracepoint_mask;
+
+static struct spinlock trace_lock = SPINLOCK_INITIALIZER;
+static struct trace_record *trace_ring;	/* NULL until tracing starts */
+static unsigned trace_next;		/* records written */
+static bool trace_useltrace;		/* also send to trace161 */
+
+void
+tracepoint_hit(unsigned event, uint32_t arg0, uint32_t arg1)
+{
+	struct trace_record *tr;
+	time_t secs;
+	uint32_t nsecs;
+
+	spinlock_acquire(&trace_lock);
+
+	/* Recheck under the lock, in case tracing just stopped. */
+	if (trace_ring == NULL || (tracepoint_mask & TP_BIT(event)) == 0) {
+		spinlock_release(&trace_lock);
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+
+	tr = &trace_ring[trace_next % TRACE_NRECORDS];
+	trace_next++;
+	tr->tr_secs = secs;
+	tr->tr_nsecs = nsecs;
+	tr->tr_thread = (uint32_t)curthread;
+	tr->tr_event = event;
+	tr->tr_cpu = curcpu->c_number;
+	tr->tr_arg0 = arg0;
+	tr->tr_arg1 = arg1;
+
+	if (trace_useltrace) {
+		ltrace_debug(TRACE_LTRACE_WORD(event, curcpu->c_number));
+		ltrace_debug(arg0);
+		ltrace_debug(arg1);
+	}
+
+	spinlock_release(&trace_lock);
+}
+
+int
+tracepoint_start(uint32_t mask, bool useltrace)
+{
+	struct trace_record *ring;
+
+	ring = kmalloc(TRACE_NRECORDS * sizeof(struct trace_record));
+	if (ring == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&trace_lock);
+	if (trace_ring == NULL) {
+		trace_ring = ring;
+		ring = NULL;
+	}
+	trace_next = 0;
+	trace_useltrace = useltrace;
+	tracepoint_mask = mask & TP_ALL;
+	spinlock_release(&trace_lock);
+
+	if (ring != NULL) {
+		/* We already had one, which has now been emptied. */
+		kfree(ring);
+	}
+	return 0;
+}
+
+void
+tracepoint_stop(void)
+{
+	tracepoint_mask = 0;
+}
+
+int
+tracepoint_dump(const char *path)
+{
+	struct trace_header th;
+	struct trace_record *ring;
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	unsigned next, first, n, len;
+	uint32_t mask;
+	char *copy;
+	int result;
+
+	/* Stop tracing and take the ring. */
+	spinlock_acquire(&trace_lock);
+	mask = tracepoint_mask;
+	tracepoint_mask = 0;
+	ring = trace_ring;
+	next = trace_next;
+	trace_ring = NULL;
+	spinlock_release(&trace_lock);
+
+	if (ring == NULL) {
+		return ENOENT;
+	}
+
+	/* vfs_open may modify the path it's given */
+	copy = kstrdup(path);
+	if (copy == NULL) {
+		kfree(ring);
+		return ENOMEM;
+	}
+	result = vfs_open(copy, O_WRONLY|O_CREAT|O_TRUNC, 0664, &vn);
+	kfree(copy);
+	if (result) {
+		kfree(ring);
+		return result;
+	}
+
+	n = next < TRACE_NRECORDS ? next : TRACE_NRECORDS;
+	th.th_magic = TRACE_MAGIC;
+	th.th_nrecords = n;
+	th.th_lost = next - n;
+	th.th_mask = mask;
+
+	uio_kinit(&iov, &ku, &th, sizeof(th), 0, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+
+	/*
+	 * Oldest first: from the slot after the newest record to the end
+	 * of the ring, then from the start.
+	 */
+	first = next % TRACE_NRECORDS;
+	if (result == 0 && n == TRACE_NRECORDS && first > 0) {
+		len = (TRACE_NRECORDS - first) * sizeof(struct trace_record);
+		uio_kinit(&iov, &ku, &ring[first], len, ku.uio_offset,
+			  UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+		n = first;
+	}
+	if (result == 0) {
+		len = n * sizeof(struct trace_record);
+		uio_kinit(&iov, &ku, ring, len, ku.uio_offset, UIO_WRITE);
+		result = VOP_WRITE(vn, &ku);
+	}
+
+	vfs_close(vn);
+	kfree(ring);
+	return result;
+}
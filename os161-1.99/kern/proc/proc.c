@@ -49,6 +49,10 @@
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <file.h>
+#include <bitmap.h>
+#include <limits.h>
+#include <clock.h>
 #include <kern/fcntl.h>  
 
 /*
@@ -69,7 +73,94 @@ static struct semaphore *proc_count_mutex;
 struct semaphore *no_proc_sem; 
 #endif  // UW
 
-static volatile pid_t global_pid_count; // HAODA
+/*
+ * The pid table (see proc.h). pids_in_use has one bit for every pid up to
+ * PID_MAX; a pid's bit is cleared (and the pid recycled) only when its
+ * skeleton is destroyed, i.e. once nobody can waitpid() on it any more.
+ */
+static struct skeleboi *pidtable[PIDTABLE_SIZE];
+static struct bitmap *pids_in_use;
+
+#define PIDTABLE_HASH(pid) ((unsigned)(pid) & (PIDTABLE_SIZE - 1))
+
+struct skeleboi *
+pidtable_lookup(pid_t pid)
+{
+	struct skeleboi *s;
+
+	KASSERT(lock_do_i_hold(master_lock));
+
+	if (pid <= 0 || pid > PID_MAX) {
+		return NULL;
+	}
+	for (s = pidtable[PIDTABLE_HASH(pid)]; s != NULL; s = s->s_hashnext) {
+		if (s->p_id == pid) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+pidtable_add(struct skeleboi *s)
+{
+	unsigned bucket = PIDTABLE_HASH(s->p_id);
+
+	KASSERT(lock_do_i_hold(master_lock));
+
+	s->s_hashnext = pidtable[bucket];
+	pidtable[bucket] = s;
+}
+
+void
+skeleton_adopt(struct skeleboi *parent, struct skeleboi *child)
+{
+	KASSERT(lock_do_i_hold(master_lock));
+	KASSERT(child->p_parent == NULL);
+
+	child->p_parent = parent;
+	child->s_sibling = parent->s_children;
+	parent->s_children = child;
+}
+
+void
+skeleton_disown(struct skeleboi *child)
+{
+	struct skeleboi **sp;
+
+	KASSERT(lock_do_i_hold(master_lock));
+	KASSERT(child->p_parent != NULL);
+
+	for (sp = &child->p_parent->s_children; *sp != NULL; sp = &(*sp)->s_sibling) {
+		if (*sp == child) {
+			*sp = child->s_sibling;
+			child->s_sibling = NULL;
+			child->p_parent = NULL;
+			return;
+		}
+	}
+	panic("skeleton for pid %d is missing from its parent\n", child->p_id);
+}
+
+void
+skeleton_destroy(struct skeleboi *s)
+{
+	struct skeleboi **sp;
+
+	KASSERT(lock_do_i_hold(master_lock));
+	KASSERT(s->p_parent == NULL);
+	KASSERT(s->s_children == NULL);
+
+	for (sp = &pidtable[PIDTABLE_HASH(s->p_id)]; *sp != s; sp = &(*sp)->s_hashnext) {
+		KASSERT(*sp != NULL);
+	}
+	*sp = s->s_hashnext;
+
+	bitmap_unmark(pids_in_use, s->p_id);
+	cv_destroy(s->exit_cv);
+	kfree(s);
+}
 
 /*
  * Create a proc structure.
@@ -99,18 +190,11 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
-#ifdef UW
-	proc->console = NULL;
-#endif // UW
+	proc->p_filetable = NULL;
 	
-	// Haoda pid
-	lock_acquire(master_lock);
-		proc->p_id = global_pid_count;
-		global_pid_count++;
-	lock_release(master_lock);
-
 	// Haoda parent-child relationship 
 	proc->p_parent = NULL; 
+	proc->p_vfork_sem = NULL;
 	//proc->p_children = array_create();
 
 	// Haoda additional control variables 
@@ -123,14 +207,40 @@ proc_create(const char *name)
 	
 	// Add to Process Table 
 	struct skeleboi * skeleton = kmalloc(sizeof(*skeleton));
-	skeleton->p_id = proc->p_id; 
+	if (skeleton == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 	skeleton->p_parent = NULL; // Don't know the parent yet
 	skeleton->p_this = proc; 
 	skeleton->terminated = proc->terminated; 
+	skeleton->s_children = NULL;
+	skeleton->s_sibling = NULL;
 	// no exit status, has not exited yet
+	skeleton->exit_cv = cv_create(name);
+	if (skeleton->exit_cv == NULL) {
+		kfree(skeleton);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 
+	// Haoda pid (recycled through the pid bitmap)
 	lock_acquire(master_lock);
-	  array_add(proctable, skeleton, NULL);
+	  unsigned pid;
+	  if (bitmap_alloc(pids_in_use, &pid)) {
+	    lock_release(master_lock);
+	    cv_destroy(skeleton->exit_cv);
+	    kfree(skeleton);
+	    kfree(proc->p_name);
+	    kfree(proc);
+	    return NULL;
+	  }
+	  proc->p_id = pid;
+	  skeleton->p_id = pid; 
+	  proc->p_skeleton = skeleton;
+	  pidtable_add(skeleton);
 	lock_release(master_lock);
 
 	return proc;
@@ -160,19 +270,7 @@ proc_destroy(struct proc *proc)
 	 * incorrect to destroy it.)
 	 */
 
-	// Set process table entry to null 
-/*    lock_acquire(master_lock); 
-      for (unsigned int i = 0; i < proctable->max; i++)
-      {
-        struct skeleboi * skeleboi_in_question = array_get(proctable, i);
-        if (skeleboi_in_question->p_id == p->p_id)
-        {
-          skeleboi_in_question->p_this = NULL;
-          skeleboi_in_question->terminated = true; 
-          break;
-        }
-      }
-    lock_release(master_lock);*/
+	// The pid table entry (skeleton) is taken care of in sys__exit
 
 	/* VFS fields */
 	if (proc->p_cwd) {
@@ -201,11 +299,10 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-#ifdef UW
-	if (proc->console) {
-	  vfs_close(proc->console);
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
 	}
-#endif // UW
 
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
@@ -237,12 +334,20 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
-  global_pid_count = 1; // haoda
   // Haoda's code : Initialize the process table
-  proctable = array_create();
-  //array_add(proctable, kproc, NULL);
   master_lock = lock_create("master_lock");
-  master_condition = cv_create("master_condition");
+  if (master_lock == NULL) {
+    panic("could not create master_lock\n");
+  }
+  pids_in_use = bitmap_create(PID_MAX + 1);
+  if (pids_in_use == NULL) {
+    panic("could not create the pid bitmap\n");
+  }
+  // pid 0 is never handed out; the kernel process gets PID_MIN - 1 (it is
+  // created first), so user processes start at PID_MIN
+  for (unsigned pid = 0; pid < PID_MIN - 1; pid++) {
+    bitmap_mark(pids_in_use, pid);
+  }
 
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
@@ -271,24 +376,20 @@ struct proc *
 proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
-	char *console_path;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
 		return NULL;
 	}
 
-#ifdef UW
-	/* open the console - this should always succeed */
-	console_path = kstrdup("con:");
-	if (console_path == NULL) {
-	  panic("unable to copy console path name during process creation\n");
+	/* stdin, stdout and stderr on the console - this should always succeed */
+	proc->p_filetable = filetable_create();
+	if (proc->p_filetable == NULL) {
+	  panic("unable to create a file table during process creation\n");
 	}
-	if (vfs_open(console_path,O_WRONLY,0,&(proc->console))) {
+	if (filetable_openconsole(proc->p_filetable)) {
 	  panic("unable to open the console during process creation\n");
 	}
-	kfree(console_path);
-#endif // UW
 	  
 	/* VM fields */
 
@@ -325,6 +426,72 @@ proc_create_runprogram(const char *name)
 	return proc;
 }
 
+/*
+ * Create a proc for fork().
+ *
+ * This is the fast path of proc_create_runprogram: instead of looking up
+ * and opening "con:" all over again for every fork, the child shares the
+ * parent's open files (and, like runprogram, its current directory).
+ * The address space is left for the caller to copy.
+ */
+struct proc *
+proc_create_fork(const char *name)
+{
+	struct proc *proc;
+
+	proc = proc_create(name);
+	if (proc == NULL) {
+		return NULL;
+	}
+
+	/* VFS fields */
+
+	/* no need for p_lock, see proc_create_runprogram */
+	if (curproc->p_cwd != NULL) {
+		VOP_INCREF(curproc->p_cwd);
+		proc->p_cwd = curproc->p_cwd;
+	}
+
+#ifdef UW
+	/* increment the count of processes */
+	P(proc_count_mutex); 
+	proc_count++;
+	V(proc_count_mutex);
+#endif // UW
+
+	/* the child shares all of the parent's open files (and their offsets) */
+	KASSERT(curproc->p_filetable != NULL);
+	if (filetable_copy(curproc->p_filetable, &proc->p_filetable)) {
+		lock_acquire(master_lock);
+		skeleton_destroy(proc->p_skeleton);
+		proc->p_skeleton = NULL;
+		lock_release(master_lock);
+		proc_destroy(proc);
+		return NULL;
+	}
+
+	return proc;
+}
+
+/*
+ * Give a borrowed (vfork) address space back to the parent.
+ *
+ * The parent destroys the semaphore as soon as it gets through P, so
+ * we must not touch it after the V.
+ */
+void
+proc_vfork_release(struct proc *proc)
+{
+	struct semaphore *sem;
+
+	sem = proc->p_vfork_sem;
+	if (sem == NULL) {
+		return;
+	}
+	proc->p_vfork_sem = NULL;
+	V(sem);
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -415,3 +582,54 @@ curproc_setas(struct addrspace *newas)
 	spinlock_release(&proc->p_lock);
 	return oldas;
 }
+
+/*
+ * Fork/exec latency stats, printed by the "pst" menu command.
+ */
+static struct spinlock procstats_lock = SPINLOCK_INITIALIZER;
+static unsigned procstats_count[PROCSTAT_COUNT];
+static uint64_t procstats_totalns[PROCSTAT_COUNT];
+static uint64_t procstats_maxns[PROCSTAT_COUNT];
+
+void
+procstats_record(unsigned which, time_t startsecs, uint32_t startnsecs)
+{
+	time_t secs;
+	uint32_t nsecs;
+	uint64_t ns;
+
+	KASSERT(which < PROCSTAT_COUNT);
+
+	gettime(&secs, &nsecs);
+	ns = (uint64_t)(secs - startsecs) * 1000000000 + nsecs - startnsecs;
+
+	spinlock_acquire(&procstats_lock);
+	procstats_count[which]++;
+	procstats_totalns[which] += ns;
+	if (ns > procstats_maxns[which]) {
+		procstats_maxns[which] = ns;
+	}
+	spinlock_release(&procstats_lock);
+}
+
+void
+procstats_print(void)
+{
+	static const char *names[PROCSTAT_COUNT] = {
+		"fork (parent)", "fork (child start)", "execv",
+	};
+	unsigned i, count;
+	uint64_t total, max;
+
+	for (i=0; i<PROCSTAT_COUNT; i++) {
+		spinlock_acquire(&procstats_lock);
+		count = procstats_count[i];
+		total = procstats_totalns[i];
+		max = procstats_maxns[i];
+		spinlock_release(&procstats_lock);
+
+		kprintf("%-20s %8u calls, avg %8lu us, max %8lu us\n", names[i],
+			count, count ? (unsigned long)(total / count / 1000) : 0UL,
+			(unsigned long)(max / 1000));
+	}
+}
@@ -46,6 +46,8 @@
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
+#include <klog.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
@@ -125,6 +127,8 @@ boot(void)
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	buffer_start_threads();
+	klog_start_thread();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -145,6 +149,7 @@ void
 shutdown(void)
 {
 
+	klog_flush();
 	kprintf("Shutting down.\n");
 	
 	vfs_clearbootfs();
@@ -40,6 +40,10 @@
 #include <synch.h>
 #include <vfs.h>
 #include <sfs.h>
+#include <buf.h>
+#include <dcache.h>
+#include <pagecache.h>
+#include <tracepoint.h>
 #include <syscall.h>
 #include <test.h>
 #include "opt-synchprobs.h"
@@ -398,6 +402,127 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_procstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	procstats_print();
+
+	return 0;
+}
+
+static
+int
+cmd_bufstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	buffer_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_dcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	dcache_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_pagecachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	pagecache_printstats();
+
+	return 0;
+}
+
+/*
+ * Commands for kernel tracing (see tracepoint.h).
+ */
+
+/* Groups of events that can be named to tron */
+static const struct {
+	const char *name;
+	uint32_t mask;
+} traceevents[] = {
+	{ "syscall",	TP_BIT(TP_SYSCALL_ENTER) | TP_BIT(TP_SYSCALL_EXIT) },
+	{ "fault",	TP_BIT(TP_VM_FAULT) },
+	{ "switch",	TP_BIT(TP_THREAD_SWITCH) },
+	{ "lock",	TP_BIT(TP_LOCK_ACQUIRE) },
+	{ "disk",	TP_BIT(TP_DISK_START) | TP_BIT(TP_DISK_DONE) },
+	{ NULL, 0 }
+};
+
+static
+int
+cmd_tron(int nargs, char **args)
+{
+	uint32_t mask = 0;
+	bool useltrace = false;
+	int i, j;
+
+	for (i=1; i<nargs; i++) {
+		if (!strcmp(args[i], "-l")) {
+			useltrace = true;
+			continue;
+		}
+		for (j=0; traceevents[j].name; j++) {
+			if (!strcmp(traceevents[j].name, args[i])) {
+				mask |= traceevents[j].mask;
+				break;
+			}
+		}
+		if (traceevents[j].name == NULL) {
+			kprintf("Usage: tron [-l] [syscall] [fault] [switch] "
+				"[lock] [disk]\n");
+			return EINVAL;
+		}
+	}
+	if (mask == 0) {
+		mask = TP_ALL;
+	}
+
+	return tracepoint_start(mask, useltrace);
+}
+
+static
+int
+cmd_troff(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	tracepoint_stop();
+
+	return 0;
+}
+
+static
+int
+cmd_trdump(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: trdump [file]\n");
+		return EINVAL;
+	}
+
+	return tracepoint_dump(nargs == 2 ? args[1] : "emu0:trace.out");
+}
+
 /*
  * Haoda's Commands
  */
@@ -453,6 +578,9 @@ static const char *opsmenu[] = {
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
 	"[panic]   Intentional panic         ",
+	"[tron]    Start kernel tracing      ",
+	"[troff]   Stop kernel tracing       ",
+	"[trdump]  Write kernel trace to file",
 	"[q]       Quit and shut down        ",
 	NULL
 };
@@ -522,6 +650,10 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[pst] Fork/exec latency stats       ",
+	"[bst] Buffer cache stats            ",
+	"[dst] Name cache stats              ",
+	"[pcs] Exec page cache stats         ",
 	"[dth] Enables debugging messages    ", // HAODA CHANGE
 	"[q] Quit and shut down              ",
 	NULL
@@ -564,6 +696,9 @@ static struct {
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
 	{ "panic",	cmd_panic },
+	{ "tron",	cmd_tron },
+	{ "troff",	cmd_troff },
+	{ "trdump",	cmd_trdump },
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
 	{ "halt",	cmd_quit },
@@ -581,6 +716,10 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "pst",        cmd_procstats },
+	{ "bst",        cmd_bufstats },
+	{ "dst",        cmd_dcachestats },
+	{ "pcs",        cmd_pagecachestats },
 
 	/* base system tests */
 	{ "at",		arraytest },
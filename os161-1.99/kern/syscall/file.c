@@ -0,0 +1,191 @@
+/*
+ * Open files and file descriptor tables. See file.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <file.h>
+
+////////////////////////////////////////////////////////////
+//
+// Open files.
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct openfile *of;
+	int result;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	result = vfs_open(path, flags, mode, &of->of_vnode);
+	if (result) {
+		lock_destroy(of->of_lock);
+		kfree(of);
+		return result;
+	}
+
+	/* O_CREAT, O_EXCL and O_TRUNC only matter to vfs_open */
+	of->of_flags = flags & (O_ACCMODE | O_APPEND);
+	of->of_offset = 0;
+	bzero(&of->of_ra, sizeof(of->of_ra));
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	lock_acquire(of->of_lock);
+	of->of_refcount++;
+	lock_release(of->of_lock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	lock_acquire(of->of_lock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	lock_release(of->of_lock);
+
+	if (last) {
+		vfs_close(of->of_vnode);
+		lock_destroy(of->of_lock);
+		kfree(of);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// File descriptor tables.
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	int fd;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		ft->ft_files[fd] = NULL;
+	}
+	return ft;
+}
+
+int
+filetable_copy(struct filetable *ft, struct filetable **ret)
+{
+	struct filetable *newft;
+	int fd;
+
+	newft = filetable_create();
+	if (newft == NULL) {
+		return ENOMEM;
+	}
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] != NULL) {
+			openfile_incref(ft->ft_files[fd]);
+			newft->ft_files[fd] = ft->ft_files[fd];
+		}
+	}
+	*ret = newft;
+	return 0;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	int fd;
+
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] != NULL) {
+			openfile_decref(ft->ft_files[fd]);
+			ft->ft_files[fd] = NULL;
+		}
+	}
+	kfree(ft);
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *ret)
+{
+	int fd;
+
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] == NULL) {
+			ft->ft_files[fd] = of;
+			*ret = fd;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+void
+filetable_setfd(struct filetable *ft, int fd, struct openfile *of)
+{
+	struct openfile *old;
+
+	KASSERT(fd >= 0 && fd < OPEN_MAX);
+
+	old = ft->ft_files[fd];
+	ft->ft_files[fd] = of;
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+}
+
+int
+filetable_openconsole(struct filetable *ft)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *of;
+	char path[5];
+	int fd, result;
+
+	KASSERT(STDIN_FILENO == 0 && STDOUT_FILENO == 1 && STDERR_FILENO == 2);
+
+	for (fd = 0; fd < 3; fd++) {
+		/* vfs_open may destroy the path, so use a fresh copy each time */
+		strcpy(path, "con:");
+		result = openfile_open(path, modes[fd], 0, &of);
+		if (result) {
+			return result;
+		}
+		filetable_setfd(ft, fd, of);
+	}
+	return 0;
+}
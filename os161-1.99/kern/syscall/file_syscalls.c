@@ -1,60 +1,375 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
 #include <lib.h>
+#include <limits.h>
 #include <uio.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
+#include <synch.h>
+#include <copyinout.h>
 #include <current.h>
 #include <proc.h>
+#include <file.h>
+#include <pagecache.h>
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
+ * File descriptor system calls.
  *
- * You will need to improve this implementation
+ * Each process has a table of descriptors (curproc->p_filetable) that
+ * point to refcounted openfiles; see file.h. The openfile's lock is held
+ * for the whole of a read or write, so that I/O through one openfile is
+ * atomic and the offset is updated consistently, even when the openfile
+ * is shared with other processes through fork.
  */
 
+/*
+ * Common code for all the read and write calls: set up a uio for the
+ * user's buffer(s), do the I/O with one VOP_READ/VOP_WRITE, and pass back
+ * the number of bytes transferred.
+ *
+ * IOV is a kernel array of IOVCNT user-pointer iovecs, TOTAL bytes long.
+ * If POS is NULL the I/O happens at (and advances) the openfile's offset,
+ * under the openfile's lock; otherwise it happens at *POS and the
+ * openfile's offset is neither used nor changed (pread/pwrite).
+ */
+static
 int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+file_rw(int fdesc, struct iovec *iov, unsigned iovcnt, size_t total,
+	const off_t *pos, enum uio_rw rw, int *retval)
 {
-  struct iovec iov;
+  struct openfile *of;
   struct uio u;
+  int accmode;
   int res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
-  }
   KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
+  KASSERT(curproc->p_filetable != NULL);
   KASSERT(curproc->p_addrspace != NULL);
 
-  /* set up a uio structure to refer to the user program's buffer (ubuf) */
-  iov.iov_ubase = ubuf;
-  iov.iov_len = nbytes;
-  u.uio_iov = &iov;
-  u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
-  u.uio_resid = nbytes;
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+
+  accmode = of->of_flags & O_ACCMODE;
+  if ((rw == UIO_READ && accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && accmode == O_RDONLY)) {
+    return EBADF;
+  }
+
+  /* set up a uio structure to refer to the user program's buffer(s) */
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_resid = total;
   u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
+  u.uio_rw = rw;
   u.uio_space = curproc->p_addrspace;
 
-  res = VOP_WRITE(curproc->console,&u);
+  if (pos != NULL) {
+    /* positional I/O: only makes sense on seekable objects */
+    if (*pos < 0) {
+      return EINVAL;
+    }
+    res = VOP_TRYSEEK(of->of_vnode, *pos);
+    if (res) {
+      return res;
+    }
+    u.uio_offset = *pos;
+    /* not part of the file's read pattern */
+    u.uio_ra = NULL;
+  }
+  else {
+    lock_acquire(of->of_lock);
+
+    if (rw == UIO_WRITE && (of->of_flags & O_APPEND)) {
+      struct stat st;
+      res = VOP_STAT(of->of_vnode, &st);
+      if (res) {
+        lock_release(of->of_lock);
+        return res;
+      }
+      of->of_offset = st.st_size;
+    }
+    u.uio_offset = of->of_offset;
+    u.uio_ra = &of->of_ra;
+  }
+
+  if (rw == UIO_READ) {
+    res = VOP_READ(of->of_vnode, &u);
+  }
+  else {
+    res = VOP_WRITE(of->of_vnode, &u);
+    /* even a failed write may have changed some of the file */
+    pagecache_invalidate(of->of_vnode);
+  }
+
+  if (pos == NULL) {
+    if (res == 0) {
+      of->of_offset = u.uio_offset;
+    }
+    lock_release(of->of_lock);
+  }
   if (res) {
     return res;
   }
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
+  /* pass back the number of bytes actually transferred */
+  *retval = total - u.uio_resid;
   KASSERT(*retval >= 0);
   return 0;
 }
+
+/*
+ * Fetch a user iovec array for readv/writev into a kmalloc'd kernel copy,
+ * and add up its length.
+ */
+static
+int
+file_copyiniov(userptr_t uiov, int iovcnt, struct iovec **ret, size_t *total)
+{
+  struct iovec *iov;
+  size_t sum;
+  int i;
+  int res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+
+  iov = kmalloc(iovcnt * sizeof(struct iovec));
+  if (iov == NULL) {
+    return ENOMEM;
+  }
+  res = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+  if (res) {
+    kfree(iov);
+    return res;
+  }
+
+  /* the total must fit in the (int) return value; 0x7fffffff is INT_MAX */
+  sum = 0;
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > (size_t)0x7fffffff - sum) {
+      kfree(iov);
+      return EINVAL;
+    }
+    sum += iov[i].iov_len;
+  }
+
+  *ret = iov;
+  *total = sum;
+  return 0;
+}
+
+/* handler for open() system call                  */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  char *path;
+  struct openfile *of;
+  int fd;
+  int res;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+
+  DEBUG(DB_SYSCALL,"Syscall: open(%s,0x%x)\n",path,flags);
+
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+
+  res = filetable_place(curproc->p_filetable, of, &fd);
+  if (res) {
+    openfile_decref(of);
+    return res;
+  }
+
+  *retval = fd;
+  return 0;
+}
+
+/* handler for read() system call                  */
+int
+sys_read(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  struct iovec iov;
+
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, NULL, UIO_READ, retval);
+}
+
+/* handler for write() system call                  */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  struct iovec iov;
+
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, NULL, UIO_WRITE, retval);
+}
+
+/* handler for pread() system call                  */
+int
+sys_pread(int fdesc,userptr_t ubuf,unsigned int nbytes,off_t pos,int *retval)
+{
+  struct iovec iov;
+
+  DEBUG(DB_SYSCALL,"Syscall: pread(%d,%x,%d,%d)\n",fdesc,(unsigned int)ubuf,nbytes,(int)pos);
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, &pos, UIO_READ, retval);
+}
+
+/* handler for pwrite() system call                  */
+int
+sys_pwrite(int fdesc,userptr_t ubuf,unsigned int nbytes,off_t pos,int *retval)
+{
+  struct iovec iov;
+
+  DEBUG(DB_SYSCALL,"Syscall: pwrite(%d,%x,%d,%d)\n",fdesc,(unsigned int)ubuf,nbytes,(int)pos);
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, &pos, UIO_WRITE, retval);
+}
+
+/* handler for readv() and writev() system calls                  */
+int
+sys_readwritev(int fdesc,userptr_t uiov,int iovcnt,enum uio_rw rw,int *retval)
+{
+  struct iovec *iov;
+  size_t total;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: %s(%d,%x,%d)\n",rw == UIO_READ ? "readv" : "writev",
+        fdesc,(unsigned int)uiov,iovcnt);
+
+  res = file_copyiniov(uiov, iovcnt, &iov, &total);
+  if (res) {
+    return res;
+  }
+  res = file_rw(fdesc, iov, iovcnt, total, NULL, rw, retval);
+  kfree(iov);
+  return res;
+}
+
+/* handler for lseek() system call                  */
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: lseek(%d,%d,%d)\n",fdesc,(int)pos,whence);
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+
+  lock_acquire(of->of_lock);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(of->of_vnode, &st);
+    if (res) {
+      lock_release(of->of_lock);
+      return res;
+    }
+    newpos = st.st_size + pos;
+    break;
+  default:
+    lock_release(of->of_lock);
+    return EINVAL;
+  }
+
+  if (newpos < 0) {
+    lock_release(of->of_lock);
+    return EINVAL;
+  }
+
+  /* this also rejects seeking on the console (ESPIPE) */
+  res = VOP_TRYSEEK(of->of_vnode, newpos);
+  if (res) {
+    lock_release(of->of_lock);
+    return res;
+  }
+
+  of->of_offset = newpos;
+  lock_release(of->of_lock);
+
+  *retval = newpos;
+  return 0;
+}
+
+/* handler for close() system call                  */
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: close(%d)\n",fdesc);
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  filetable_setfd(curproc->p_filetable, fdesc, NULL);
+  return 0;
+}
+
+/* handler for dup2() system call                  */
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct openfile *of;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: dup2(%d,%d)\n",oldfd,newfd);
+
+  res = filetable_get(curproc->p_filetable, oldfd, &of);
+  if (res) {
+    return res;
+  }
+  if (newfd < 0 || newfd >= OPEN_MAX) {
+    return EBADF;
+  }
+
+  if (oldfd != newfd) {
+    openfile_incref(of);
+    filetable_setfd(curproc->p_filetable, newfd, of);
+  }
+
+  *retval = newfd;
+  return 0;
+}
@@ -42,6 +42,9 @@
  * circumstances, as_prepare_load and as_complete_load probably don't
  * need to do anything.
  *
+ * All reads from the file go through the page cache (pagecache.h), so
+ * loading the same program again doesn't go back to the filesystem.
+ *
  * If you wanted to support memory-mapped executables you would need
  * to rearrange this to map each segment.
  *
@@ -58,6 +61,7 @@
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <pagecache.h>
 #include <elf.h>
 
 /*
@@ -102,8 +106,9 @@ load_segment(struct addrspace *as, struct vnode *v,
 	u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
 	u.uio_rw = UIO_READ;
 	u.uio_space = as;
+	u.uio_ra = NULL;
 
-	result = VOP_READ(v, &u);
+	result = pagecache_read(v, &u);
 	if (result) {
 		return result;
 	}
@@ -169,7 +174,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 */
 
 	uio_kinit(&iov, &ku, &eh, sizeof(eh), 0, UIO_READ);
-	result = VOP_READ(v, &ku);
+	result = pagecache_read(v, &ku);
 	if (result) {
 		return result;
 	}
@@ -223,7 +228,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
 
-		result = VOP_READ(v, &ku);
+		result = pagecache_read(v, &ku);
 		if (result) {
 			return result;
 		}
@@ -268,7 +273,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
 
-		result = VOP_READ(v, &ku);
+		result = pagecache_read(v, &ku);
 		if (result) {
 			return result;
 		}
@@ -9,12 +9,14 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include <limits.h>
 
 #include <opt-A2.h>
 #include <mips/trapframe.h>
 #include <synch.h>
 #include <kern/fcntl.h>
 #include <vfs.h>
+#include <clock.h>
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
@@ -53,46 +55,46 @@ void sys__exit(int exitcode) {
 
   // NEW DOCTRINE: SKELETON PROCTABLE 
   // UPDATE THE PROCESS TABLiE 
+  // Only our own skeleton and our own children need to be looked at, so this
+  // is proportional to the number of children, not the number of processes
   lock_acquire(master_lock); 
-    for (unsigned int i = 0; i < array_num(proctable); i++)
-    {
-      struct skeleboi * skeleboi_in_question = array_get(proctable, i);
+    struct skeleboi * skeleton = p->p_skeleton;
 
-      // IF THE PROCESS IS THIS PROCESS AND THE PARENT IS NULL 
-      //    THEN WE REMOVE THIS PROCESS FROM THE TABLE 
-      if (skeleboi_in_question->p_id == p->p_id && skeleboi_in_question->p_parent == NULL)
-      {
-        array_remove(proctable, i);
-        kfree(skeleboi_in_question);
-      }
-      // IF THE PROCESS IS THIS PROCESS AND THE PARENT IS NOT NULL
-      //    THEN WE UPDATE THE PROCESS TO AN EMPTY SKELETON 
-      else if (skeleboi_in_question->p_id == p->p_id)
-      {
-        skeleboi_in_question->p_this = NULL;
-        skeleboi_in_question->terminated = true; 
-        skeleboi_in_question->exitcode = exitcode;
-      }
-      // IF THE PROCESS'S PARENT IS NULL AND IT IS NOT THIS PROCESS 
-      //    THEN THERE IS NO NEED TO REMOVE IT (since it will do it itself when it exits)
-      //    AND WE NEED TO ENSURE THE NEXT IF STATEMENT DOESNT PERFORM A TLB MISS
-      else if (skeleboi_in_question->p_parent == NULL)
-      {
-        // nothing happens
-      }
-      
-      // IF THE PROCESS IS A CHILD OF THIS PROCESS AND THE PROCESS IS AN EMPTY SKELETON 
-      //    THEN WE REMOVE THIS PROCESS FROM THE TABLE (since we can't call waitpid on it)
-      else if (skeleboi_in_question->p_parent->p_id == p->p_id && skeleboi_in_question->p_this == NULL)
+    // OUR CHILDREN ARE NOW ORPHANS (nobody can call waitpid on them)
+    //    THE ONES THAT ARE ALREADY EMPTY SKELETONS ARE REMOVED FROM THE TABLE,
+    //    THE LIVE ONES WILL REMOVE THEMSELVES WHEN THEY EXIT
+    struct skeleboi * child = skeleton->s_children;
+    while (child != NULL)
+    {
+      struct skeleboi * next = child->s_sibling;
+      child->p_parent = NULL;
+      child->s_sibling = NULL;
+      if (child->terminated)
       {
-        array_remove(proctable, i);
-        kfree(skeleboi_in_question);
+        skeleton_destroy(child);
       }
+      child = next;
     }
-  lock_release(master_lock);
+    skeleton->s_children = NULL;
 
-  // Wake up sleeping threads 
-  cv_broadcast(master_condition, master_lock);
+    // IF THE PARENT IS NULL 
+    //    THEN WE REMOVE THIS PROCESS FROM THE TABLE 
+    if (skeleton->p_parent == NULL)
+    {
+      skeleton_destroy(skeleton);
+    }
+    // IF THE PARENT IS NOT NULL
+    //    THEN WE UPDATE THE PROCESS TO AN EMPTY SKELETON 
+    else
+    {
+      skeleton->p_this = NULL;
+      skeleton->terminated = true; 
+      skeleton->exitcode = exitcode;
+      // Wake up our parent (and only our parent) if it is sleeping in waitpid
+      cv_signal(skeleton->exit_cv, master_lock);
+    }
+    p->p_skeleton = NULL;
+  lock_release(master_lock);
 
   /*
    * clear p_addrspace before calling as_destroy. Otherwise if
@@ -102,7 +104,15 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
-  as_destroy(as);
+  if (p->p_vfork_sem != NULL)
+  {
+    // the address space belongs to our vfork parent, just hand it back
+    proc_vfork_release(p);
+  }
+  else
+  {
+    as_destroy(as);
+  }
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
@@ -131,6 +141,29 @@ void sys__exit(int exitcode) {
 	
 //}
 
+// Undo a partially built fork child (it has no thread yet, so nobody else
+// can be looking at it)
+static
+void
+fork_abandon(struct proc * child)
+{
+  lock_acquire(master_lock);
+    if (child->p_skeleton->p_parent != NULL)
+    {
+      skeleton_disown(child->p_skeleton);
+    }
+    skeleton_destroy(child->p_skeleton);
+    child->p_skeleton = NULL;
+  lock_release(master_lock);
+
+  if (child->p_addrspace != NULL)
+  {
+    as_destroy(child->p_addrspace);
+    child->p_addrspace = NULL;
+  }
+  proc_destroy(child);
+}
+
 int
 sys_fork(struct trapframe * parent_tf, pid_t * retval)
 {
@@ -149,50 +182,40 @@ sys_fork(struct trapframe * parent_tf, pid_t * retval)
 	//             the child's process thread's kernel stack 
 	//    5) Set the retval to child's pid, and return 0 if everything is successful
 	
+	time_t startsecs;
+	uint32_t startnsecs;
+	gettime(&startsecs, &startnsecs); // for procstats
 	
 	// 1) Create a process structure ()
-	struct proc * child = proc_create_runprogram(curproc->p_name); 
+	//    (proc_create_fork shares our console instead of re-opening "con:")
+	struct proc * child = proc_create_fork(curproc->p_name); 
 	
-	if (child == NULL) // if proc_create_runprogram fails, it's because there's not enough memory 
+	if (child == NULL) // if proc_create_fork fails, it's because there's not enough memory 
 		return ENOMEM; // error code for no memory 
 	
 	
 	// 2) Create new address space and copy its parent contents 
-	//struct addrspace* child_addrspace = as_create();
-	// int as_copy(struct addrspace *src, struct addrspace **ret);
-	
-	
-	spinlock_acquire(&child->p_lock);
-		int code = as_copy(curproc->p_addrspace, &child->p_addrspace); // no need to malloc 
-	spinlock_release(&child->p_lock);
+	//    Nobody else can see the child yet, so no need for its p_lock 
+	//    (and as_copy may sleep, so we must not hold a spinlock anyway)
+	int code = as_copy(curproc->p_addrspace, &child->p_addrspace); // no need to malloc 
 	
 	if (code != 0)
-		return ENOMEM; // error code for no memory
-	// Set the child's address space (from curproc_setas)
-	// child->p_addrspace = child_addrspace;
+	{
+		fork_abandon(child);
+		return code;
+	}
 	
 	// 3) Assign process id number (up to us) 
-	//       Note: process does not have a pid field. We need to add the field ourselves 
-	//             process ids cannot have a value of 0 or a negative value 
-	//       haoda's proposed strategy: global pid incrementable number, lock every time u increment
-	
 	// The code to assign the process id number is located in proc/proc.c
+	pid_t child_pid = child->p_id; // the child might be gone by the time thread_fork returns
 	
 	// 3.5) Create the parent-child relationship - simple solution: 
 	// 	point the child to the parent process  
 	// 	dynamic array of pointers to children
 	child->p_parent = curproc;
-  // Create relationship in proctable (NEW DOCTRINE : SKELETON PROCTABLE : STRATEGY 1)
+  // Create relationship in the pid table (NEW DOCTRINE : SKELETON PROCTABLE : STRATEGY 1)
 	lock_acquire(master_lock); 
-    for (unsigned int i = 0; i < array_num(proctable); i++)
-    {
-      struct skeleboi * skeleboi_in_question = array_get(proctable, i);
-      if (skeleboi_in_question->p_id == child->p_id) // child process skeleton detected
-      {
-        skeleboi_in_question->p_parent = curproc;
-        break;
-      }
-    }
+    skeleton_adopt(curproc->p_skeleton, child->p_skeleton);
   lock_release(master_lock);
 
 	// 4) Create a thread 
@@ -201,29 +224,90 @@ sys_fork(struct trapframe * parent_tf, pid_t * retval)
 	//          |-> our new process is going to start execution in KERNEL mode
 	//              thus, we need to pass in a kernel function enter_forked_process
 	
-	// First, we want to store the trap frame into the HEAP to prevent the case where 
-	// the parent returns from fork before the child can execute. 
-	struct trapframe* copy_tf;
-	//spinlock_acquire(&curproc->p_lock);
-		copy_tf = kmalloc(sizeof(struct trapframe)); // remember to free this!
-		memcpy(copy_tf, parent_tf, sizeof(struct trapframe));
-	//spinlock_release(&curproc->p_lock);
+	// The parent may return from fork before the child gets to run, so the 
+	// trap frame is copied into the child's proc structure (no extra kmalloc); 
+	// enter_forked_process copies it onto the child's own kernel stack. 
+	child->p_forktf = *parent_tf;
+	child->p_fork_secs = startsecs;
+	child->p_fork_nsecs = startnsecs;
 	
 	code = thread_fork(curthread->t_name,
 				child, 
 				enter_forked_process, 
-				(void*)copy_tf,
+				(void*)&child->p_forktf,
 				0);
-				
-  // We no longer need the kernel's copy of the trapframe 
-  //kfree(copy_tf);
 
 	// there was a problem with thread forks
 	if (code != 0)
-		return ENOMEM; // probably a memory error????? 
+	{
+		fork_abandon(child);
+		return code;
+	}
 	
 	// RETURN
-	*retval = child->p_id; // if ur the parent
+	*retval = child_pid; // if ur the parent
+	procstats_record(PROCSTAT_FORK_PARENT, startsecs, startnsecs);
+	return 0;
+}
+
+// vfork is fork without the as_copy: the child runs on the parent's address 
+// space (and user stack!) while the parent sleeps, until the child calls 
+// execv or _exit. This makes fork-then-exec (e.g. in the shell) cheap, since 
+// we no longer copy the whole address space only to throw it away in execv.
+int
+sys_vfork(struct trapframe * parent_tf, pid_t * retval)
+{
+	time_t startsecs;
+	uint32_t startnsecs;
+	gettime(&startsecs, &startnsecs); // for procstats
+
+	struct semaphore * vfork_sem = sem_create(curproc->p_name, 0);
+	if (vfork_sem == NULL)
+		return ENOMEM;
+
+	struct proc * child = proc_create_fork(curproc->p_name); 
+	if (child == NULL)
+	{
+		sem_destroy(vfork_sem);
+		return ENOMEM;
+	}
+
+	// Lend our address space to the child (instead of as_copy)
+	child->p_addrspace = curproc->p_addrspace;
+	child->p_vfork_sem = vfork_sem;
+
+	pid_t child_pid = child->p_id;
+	child->p_parent = curproc;
+	lock_acquire(master_lock); 
+	  skeleton_adopt(curproc->p_skeleton, child->p_skeleton);
+	lock_release(master_lock);
+
+	child->p_forktf = *parent_tf;
+	child->p_fork_secs = startsecs;
+	child->p_fork_nsecs = startnsecs;
+
+	int code = thread_fork(curthread->t_name,
+				child, 
+				enter_forked_process, 
+				(void*)&child->p_forktf,
+				0);
+	if (code != 0)
+	{
+		child->p_addrspace = NULL; // it's ours, don't let fork_abandon destroy it
+		fork_abandon(child);
+		sem_destroy(vfork_sem);
+		return code;
+	}
+
+	// Sleep until the child has exec'd or exited; it is using our address space
+	P(vfork_sem);
+	sem_destroy(vfork_sem);
+
+	// The child may have switched our TLB over to its address space
+	as_activate();
+
+	*retval = child_pid;
+	procstats_record(PROCSTAT_FORK_PARENT, startsecs, startnsecs);
 	return 0;
 }
 
@@ -253,40 +337,33 @@ sys_waitpid(pid_t pid,
 
   // first you need to know who are your children
   // if the process id does not correspond to your children, then you must return an ERROR code
-  bool isChild = false; 
-  struct skeleboi * s_myChild;
-  for (unsigned int i = 0; i < array_num(proctable); i++) // NEW DOCTRINE: SKELETON PROCTABLE (STRATEGY ONE)
-  {
-    struct skeleboi* skeleboi_in_question = array_get(proctable, i);
-    if (pid == skeleboi_in_question->p_id)
-    {
-      // If this is NOT your child ... 
-      if (skeleboi_in_question->p_parent == NULL || skeleboi_in_question->p_parent->p_id != curproc->p_id)
-      {
-        return ESRCH; // this is the code for 'no such process', idk if its the appropriate one
-      }
-      isChild = true; 
-      s_myChild = skeleboi_in_question; 
-      //if (s_myChild->p_this == NULL)
-      //  return ERSCH; // no such process
-      break;
-    }
+  if (options != 0) {
+    return(EINVAL);
   }
-  if (!isChild)
-    return ESRCH; // no such process 
-
-
 
+  lock_acquire(master_lock);
+  struct skeleboi * s_myChild = pidtable_lookup(pid); // NEW DOCTRINE: SKELETON PROCTABLE (STRATEGY ONE)
+  // If this is NOT your child ... 
+  if (s_myChild == NULL || s_myChild->p_parent != curproc->p_skeleton)
+  {
+    lock_release(master_lock);
+    return ESRCH; // this is the code for 'no such process', idk if its the appropriate one
+  }
 
   // You need to determine if your child process has terminated or not 
 
   // If your child is still alive, you want to WAIT for your child to terminate - recommended: use a CV 
   // Since the parent waits for the child to terminate, the parent should call cv wait on the child's condition variable 
-  lock_acquire(master_lock);
+  // (the skeleton cannot disappear under us: only its parent - us - can remove it)
   while (!s_myChild->terminated)
   {
-    cv_wait(master_condition, master_lock);
+    cv_wait(s_myChild->exit_cv, master_lock);
   }
+  int exitcode = s_myChild->exitcode;
+
+  // We have collected our dead child, so its skeleton (and pid) can be recycled
+  skeleton_disown(s_myChild);
+  skeleton_destroy(s_myChild);
   lock_release(master_lock);
 
   // Once you wake back up, your child process has terminated, thus you need to retrieve exit status and code 
@@ -303,15 +380,10 @@ sys_waitpid(pid_t pid,
   //cv_broadcast(master_condition, master_lock);
   
   // STRATEGY 1
-  int exitstatus = _MKWAIT_EXIT(s_myChild->exitcode); // ???
+  int exitstatus = _MKWAIT_EXIT(exitcode); // ???
   // No need to tell dead child it can delete itself
 
-  // But we do need to delete the dead child's skeleton! 
-  //kfree(s_myChild); // maybe we dont
-  
-  if (options != 0) {
-    return(EINVAL);
-  }
+  // But we do need to delete the dead child's skeleton! (done above)
 
 
   /* for now, just pretend the exitstatus is 0 */
@@ -326,50 +398,103 @@ sys_waitpid(pid_t pid,
 
 
 // sys_execv(const char *program, char ** args)
+//
+// The arguments are marshalled through ONE kernel buffer, which starts at a 
+// page and doubles (up to ARG_MAX) only when the strings don't fit, so the 
+// usual short argument list never needs a large contiguous allocation:
+//
+//   Step 1 packs every argument string into it (one copyinstr each, straight 
+//          from the user's argv, no strlen on user pointers), 
+//   Step 6 slides the strings up to make room for the argv pointer array, 
+//          fills in the pointers (already pointing at where the strings will 
+//          be on the new user stack), and copies the whole thing out onto the 
+//          new stack with a single copyout. 
+//
+// So the old stack layout (strings, then NULL, then pointers) is built in the 
+// kernel and no per-argument kmallocs are needed.
 int
 sys_execv(userptr_t program, userptr_t args)
 {
-  char ** charargs = (char**) args; // temporary conversion to make things easier to debug
-  
+  time_t startsecs;
+  uint32_t startnsecs;
+  gettime(&startsecs, &startnsecs); // for procstats
+
+  int result;
+  char * progname = NULL;
+  char * argbuf = NULL;
+
+  if (program == NULL || args == NULL) 
+  {
+    return EFAULT;
+  }
+
   // Step 1: Count the number of arguments and copy them into the kernel 
-  int argnum = 0; 
-  while (charargs[argnum] != NULL) // dis right??? ?_? 
+  size_t argbufsize = PAGE_SIZE;
+  argbuf = kmalloc(argbufsize);
+  if (argbuf == NULL)
   {
-    argnum++; 
+    return ENOMEM;
   }
 
-  ///kprintf("argnum: %d\n", argnum); // DEBUGGING
-  
-  char ** kargs = kmalloc(sizeof(char*) * argnum); 
-  for (int i = 0; i < argnum; i++)
+  int argnum = 0; 
+  size_t argbytes = 0; // bytes of argbuf used by the packed strings
+  while (1)
   {
-    unsigned int got = 0; 
-    char * kargv = kmalloc(sizeof(char) * (strlen(charargs[i]) + 1));
-    
-	int res = copyinstr((const_userptr_t) (charargs[i]), kargv, strlen(charargs[i]) + 1, &got);
-    if (res != 0) return res; // lol
-    //kprintf(kargv);
-    //kprintf("\n"); // DEBUGGING   
-	kargs[i] = kargv; 
+    userptr_t uarg;
+    size_t got;
+
+    result = copyin(args + argnum * sizeof(userptr_t), &uarg, sizeof(userptr_t));
+    if (result) goto fail;
+    if (uarg == NULL) break;
+
+    // need room for this string and (later) one more pointer
+    size_t reserved = argbytes + (argnum + 2) * sizeof(userptr_t);
+    if (reserved < argbufsize)
+    {
+      result = copyinstr(uarg, argbuf + argbytes, argbufsize - reserved, &got);
+    }
+    else
+    {
+      result = ENAMETOOLONG;
+    }
+    if (result == ENAMETOOLONG)
+    {
+      // out of room: double the buffer and copy this string again
+      if (argbufsize >= ARG_MAX)
+      {
+        result = E2BIG;
+        goto fail;
+      }
+      char * bigger = kmalloc(argbufsize * 2);
+      if (bigger == NULL)
+      {
+        result = ENOMEM;
+        goto fail;
+      }
+      memcpy(bigger, argbuf, argbytes);
+      kfree(argbuf);
+      argbuf = bigger;
+      argbufsize *= 2;
+      continue;
+    }
+    if (result) goto fail;
+
+    argbytes += got; // got includes the null terminator
+    argnum++; 
   }
 
   // Step 2: Copy program file into kernel 
   // The program path passed in is a pointer to string in user-level address space. 
   // Execv purges the old address space and replaces it with a new one, thus to prevent that problem we will need 
   // to copy the string into the kernel space before destroying the user space. 
-
-  int program_charsize = 0; 
-  while (((char*)program)[program_charsize] != '\0')
+  progname = kmalloc(PATH_MAX);
+  if (progname == NULL)
   {
-    program_charsize++; 
-  }
-  
-  // Does this count as passing to kernel stack ??? :'( 
-  char * progname = kmalloc(sizeof(char) * (program_charsize + 1)); // +1 for null terminator
-  for (int i = 0; i < program_charsize + 1; i++) // idk if i should have used strcpy() instead 
-  {
-    progname[i] = ((char*)program)[i];
+    result = ENOMEM;
+    goto fail;
   }
+  result = copyinstr(program, progname, PATH_MAX, NULL);
+  if (result) goto fail;
 
   // EXTRA STEP: SAVE THE CURRENT ADDRSPACE SO WE CAN DELETE IT? 
   struct addrspace *oldas = curproc_getas(); 
@@ -380,13 +505,10 @@ sys_execv(userptr_t program, userptr_t args)
   struct addrspace *as;
   struct vnode *v;
   vaddr_t entrypoint, stackptr;
-  int result;
 
   /* Open the file. */
   result = vfs_open(progname, O_RDONLY, 0, &v);
-  if (result) {
-    return result;
-  }
+  if (result) goto fail;
 
   /* We should be a new process. */
   // KASSERT(curproc_getas() == NULL); // Haoda change: not necessarily!
@@ -395,7 +517,8 @@ sys_execv(userptr_t program, userptr_t args)
   as = as_create();
   if (as ==NULL) {
     vfs_close(v);
-    return ENOMEM;
+    result = ENOMEM;
+    goto fail;
   }
 
   /* Switch to it and activate it. */
@@ -404,20 +527,13 @@ sys_execv(userptr_t program, userptr_t args)
 
   /* Load the executable. */
   result = load_elf(v, &entrypoint);
-  if (result) {
-    /* p_addrspace will go away when curproc is destroyed */
-    vfs_close(v);
-    return result;
-  }
 
   /* Done with the file now. */
   vfs_close(v);
 
   /* Define the user stack in the address space */
-  result = as_define_stack(as, &stackptr);
-  if (result) {
-    /* p_addrspace will go away when curproc is destroyed */
-    return result;
+  if (result == 0) {
+    result = as_define_stack(as, &stackptr);
   }
 
   // Haoda change: We do enter_new_process and end code things later
@@ -425,89 +541,68 @@ sys_execv(userptr_t program, userptr_t args)
   // ========== END OF COPY PASTED RUNPROGRAM ==========
 
   // Step 6: Need to copy arguments into new address space. 
-  vaddr_t ogstackptr = stackptr; 
-
   // The user stack is composed of 2 parts: 
   // (bottom of stack)  -->  (top of stack) 
-  // 1) THE STRING ARGS ; 2) THE POINTERS WHICH POINT TO THE STRING ARGS 
-  
-  userptr_t * userargsptr = kmalloc(sizeof(char*) * argnum);  
-  //panic("this part of the code is reached 0");
-  // 6.1 : Add sring args onto the user stack (needs to be on the STACK, not the heap)
-  int allocated_size; 
-  for (int i = 0; i < argnum; i++) 
+  // 1) THE POINTERS WHICH POINT TO THE STRING ARGS (NULL terminated) ; 2) THE STRING ARGS 
+  if (result == 0) {
+    size_t ptrbytes = (argnum + 1) * sizeof(userptr_t);
+    size_t total = ROUNDUP(ptrbytes + argbytes, 8); // stack items are 8-byte aligned
+    KASSERT(ptrbytes + argbytes <= argbufsize); // may fill it exactly
+
+    stackptr -= total;
+    memmove(argbuf + ptrbytes, argbuf, argbytes);
+
+    userptr_t * argvptrs = (userptr_t *) argbuf;
+    size_t offset = ptrbytes;
+    for (int i = 0; i < argnum; i++)
+    {
+      argvptrs[i] = (userptr_t) (stackptr + offset);
+      offset += strlen(argbuf + offset) + 1;
+    }
+    argvptrs[argnum] = NULL;
+
+    result = copyout(argbuf, (userptr_t) stackptr, ptrbytes + argbytes);
+  }
+
+  if (result) {
+    /* Go back to the old address space; it is still intact */
+    curproc_setas(oldas);
+    as_activate();
+    as_destroy(as);
+    goto fail;
+  }
+
+  kfree(argbuf); 
+  kfree(progname);
+
+  // Step 7: Delete old addrspace 
+  //         (unless we are a vfork child, in which case it is our parent's, 
+  //          and our parent can now have it back)
+  if (curproc->p_vfork_sem != NULL)
   {
-	  // We need to ensure we have enough space for the string 
-	  unsigned int length = strlen(kargs[i]) + 1; // +1 for null terminator
-	  unsigned int used = 0; 
-	  // We know each char is 1 byte 
-	  allocated_size = ROUNDUP(length, 8); 
-	  stackptr = stackptr - allocated_size; 
-	  //panic((char*)kargs[i]); 
-	  result = copyoutstr(kargs[i], (userptr_t) stackptr, length, &used); // Copy into stack location
-	  if (result != 0) return result; // idk this seems right i sppose 
-	 //kprintf(((char*)stackptr)); // debugging
-         //panic(((char*)stackptr)); 
-	  userargsptr[i] = (userptr_t) stackptr; // convert to user pointer 
-	 //panic("the end of the step 6.1 for loop");
-	 //kprintf((char*)stackptr);
-	 //kprintf("\n"); // DEBUGGING 
+    proc_vfork_release(curproc);
   }
-  
-  
-  // 6.2 : Add string pointers onto the user stack 
-  //       Note that stack items are 8-byte aligned, while pointers (like vaddr_t) are 4 byte
-  vaddr_t argvptr; 
-
-  // NULL will be on the BOTTOM of the stack, and thus is added first 
-  stackptr = stackptr - 4; 
-  char** nullptr = (char**) stackptr; 
-  *nullptr = NULL; 
-  
-  // Push in backwards order ... 
-  for (int i = argnum - 1; i >= 0; i--)
+  else
   {
-	  stackptr = stackptr - 4; // 4 byte alignment ?? 
-	  //result = copyout(userargsptr[i], (userptr_t) stackptr, sizeof(char*)); // I think this is how you use copyout
-	  userptr_t * thisptr = (userptr_t *) stackptr; 
-	  *thisptr = userargsptr[i];
-	  if (i == 0) argvptr = stackptr; // set argument pointer to first argument
-	  //kprintf((char*)userargsptr[i]);
-	  //kprintf("\n"); //DEBUGGING
+    as_destroy(oldas); 
   }
-  
-  stackptr = stackptr - 4; // artificial padding
-
-  // 6.1 : Copy Arguments onto the user stack as part of as_define_stack
-  //*stackptr = argnum; // argc 
-  //stackptr += 4; 
-  //for (int i = 0; i < argnum; i++)
-  //{
-    //int got; 
-    //char * argv = malloc(sizeof(char) * (strlen(args[i]) + 1)); 
-    //result = copyoutstr(kargs[i], argv, strlen(args[i]), &got);
-    
-  //  if (result != 0)
-  //    return result; 
-
-  //  *stackptr = argv; 
-  //  stackptr += 4; 
-  //}
-  //panic("this part of the code is reached 2"); 
-  // Step 7: Delete old addrspace 
-  kfree(oldas); 
+
+  procstats_record(PROCSTAT_EXEC, startsecs, startnsecs);
 
   // Step 8: Call enter_new_process with address to the arguments on the stack, 
   //         the stack pointer, and the program entry point 
   
   /* Warp to user mode. */
-  //kprintf(*((char**)argvptr));
-  enter_new_process(argnum/*argc*/, (userptr_t) argvptr /*userspace addr of argv*/,
-        stackptr, entrypoint); // Note: we will do argument passing later
-  (void) ogstackptr; // idk if we use it
+  enter_new_process(argnum/*argc*/, (userptr_t) stackptr /*userspace addr of argv*/,
+        stackptr, entrypoint);
   /* enter_new_process does not return. */
   panic("enter_new_process returned\n");
   return EINVAL;
+
+fail:
+  kfree(argbuf);
+  if (progname != NULL) kfree(progname);
+  return result;
 }
 
 
@@ -28,7 +28,10 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
+#include <thread.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +59,94 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Get the time from one of the clocks. CLOCK_REALTIME is the time of
+ * day, like __time; CLOCK_MONOTONIC is the time since boot.
+ */
+int
+sys_clock_gettime(int clockid, userptr_t user_ts)
+{
+	struct timespec ts;
+	time_t seconds;
+	uint32_t nanoseconds;
+
+	switch (clockid) {
+	    case CLOCK_REALTIME:
+		gettime(&seconds, &nanoseconds);
+		break;
+	    case CLOCK_MONOTONIC:
+		getuptime(&seconds, &nanoseconds);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	ts.tv_sec = seconds;
+	ts.tv_nsec = nanoseconds;
+	return copyout(&ts, user_ts, sizeof(ts));
+}
+
+/*
+ * Sleep for the time given in the timespec at USER_REQ.
+ *
+ * The timer wheel only has the resolution of a timer tick, so we
+ * sleep on it until less than two ticks are left (waking up early
+ * rather than late), and then a tick at a time until the clock says
+ * the time has come. We never return early, and at most a tick late;
+ * a sleep shorter than a tick lasts until the next tick or so.
+ *
+ * There are no signals, so the sleep is never interrupted and the
+ * remaining-time pointer USER_REM is never written.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req;
+	time_t nowsecs, endsecs, leftsecs;
+	uint32_t nownsecs, endnsecs, leftnsecs;
+	uint32_t tickspersec, ticknsecs, ticks;
+	int result;
+
+	(void)user_rem;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	tickspersec = clock_usec_to_ticks(1000000);
+	ticknsecs = 1000000000 / tickspersec;
+
+	getuptime(&nowsecs, &nownsecs);
+	endsecs = nowsecs + req.tv_sec;
+	endnsecs = nownsecs + req.tv_nsec;
+	if (endnsecs >= 1000000000) {
+		endnsecs -= 1000000000;
+		endsecs++;
+	}
+
+	while (nowsecs < endsecs ||
+	       (nowsecs == endsecs && nownsecs < endnsecs)) {
+		getinterval(nowsecs, nownsecs, endsecs, endnsecs,
+			    &leftsecs, &leftnsecs);
+		if (leftsecs > 0 || leftnsecs >= 2 * ticknsecs) {
+			/* Keep each sleep well inside the wheel's range */
+			if (leftsecs > 1000000) {
+				leftsecs = 1000000;
+			}
+			ticks = leftsecs * tickspersec + leftnsecs / ticknsecs;
+			thread_sleep_until(clock_ticks() + ticks - 1);
+		}
+		else {
+			/* The last stretch: wait for the next tick */
+			thread_sleep_until(clock_ticks() + 1);
+		}
+		getuptime(&nowsecs, &nownsecs);
+	}
+
+	return 0;
+}
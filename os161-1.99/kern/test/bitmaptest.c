@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
 #include <test.h>
@@ -101,6 +102,37 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/*
+	 * Free a few scattered bits, then check that bitmap_alloc_near
+	 * hands back the first free one at or after the goal, wrapping
+	 * around past the end.
+	 */
+	for (i=0; i<TESTSIZE/16; i++) {
+		x = random() % TESTSIZE;
+		if (bitmap_isset(b, x)) {
+			bitmap_unmark(b, x);
+			data[x] = 1;
+		}
+	}
+	while (1) {
+		uint32_t goal, want;
+
+		goal = random() % TESTSIZE;
+		for (want = goal; want < TESTSIZE && !data[want]; want++);
+		if (want == TESTSIZE) {
+			for (want = 0; want < goal && !data[want]; want++);
+			if (want == goal) {
+				break;
+			}
+		}
+		KASSERT(bitmap_alloc_near(b, goal, &x)==0);
+		KASSERT(x == want);
+		data[x] = 0;
+	}
+	KASSERT(bitmap_alloc_near(b, 0, &x)==ENOSPC);
+
+	bitmap_destroy(b);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
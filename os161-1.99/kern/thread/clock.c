@@ -30,7 +30,7 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
-#include <wchan.h>
+#include <spinlock.h>
 #include <clock.h>
 #include <thread.h>
 #include <lamebus/ltimer.h>
@@ -39,9 +39,11 @@
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Timed events are done with callouts, kept in a timing wheel driven
+ * by timerclock(). Threads that want to sleep for a while schedule a
+ * callout to wake themselves (thread_sleep_until), so each sleeper is
+ * woken once, when its time comes, rather than everyone being woken
+ * every tick to check.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -55,23 +57,185 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * The wheel.
+ *
+ * There are TW_LEVELS levels of TW_SIZE slots each. A slot at level 0
+ * holds the callouts due on one particular tick; a slot at level N
+ * holds those due in a particular run of TW_SIZE^N ticks. A callout
+ * due less than TW_SIZE ticks from now goes in level 0, one due less
+ * than TW_SIZE^2 ticks from now in level 1, and so on, in the slot
+ * picked out by the corresponding bits of its expiry tick.
+ *
+ * Each tick, the level 0 slot for the new tick is run. Every TW_SIZE
+ * ticks, when the level 0 index wraps around to 0, the next level 1
+ * slot is "cascaded": its callouts, which are now all due within
+ * TW_SIZE ticks, are redistributed into level 0; and likewise level 2
+ * into level 1 when the level 1 index wraps, and so on. So each
+ * callout is touched at most TW_LEVELS times however far off it is.
+ *
+ * With 1 ms ticks, four levels of 64 cover about 4.6 hours. Callouts
+ * further off than that are parked in the top level and reinserted
+ * (further down, or at the top again) each time their slot cascades.
+ *
+ * Everything here is protected by tw_lock, which is never held while
+ * a callout function runs.
  */
-static struct wchan *lbolt;
+#define TW_BITS		6
+#define TW_SIZE		(1 << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	4
+#define TW_MAXDELTA	((1U << (TW_BITS * TW_LEVELS)) - 1)
+
+static struct spinlock tw_lock = SPINLOCK_INITIALIZER;
+static struct callout *tw_slots[TW_LEVELS][TW_SIZE];
+static volatile uint32_t tw_now;	/* last tick processed */
+
 /*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
+ * Put CO in the right slot for its expiry time. Call with tw_lock held.
  */
-static struct wchan *minibolt;
+static
+void
+tw_insert(struct callout *co)
+{
+	uint32_t delta, when;
+	struct callout **slot;
+	unsigned level;
+
+	/*
+	 * Something already due (only possible when cascading, since
+	 * callout_schedule_at always asks for a future tick) goes in
+	 * the slot that's about to be run.
+	 */
+	if ((int32_t)(co->co_expire - tw_now) < 0) {
+		co->co_expire = tw_now;
+	}
+	delta = co->co_expire - tw_now;
+	when = co->co_expire;
+	if (delta > TW_MAXDELTA) {
+		when = tw_now + TW_MAXDELTA;
+		delta = TW_MAXDELTA;
+	}
+
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < (1U << (TW_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slot = &tw_slots[level][(when >> (TW_BITS * level)) & TW_MASK];
+
+	co->co_next = *slot;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = &co->co_next;
+	}
+	co->co_prevp = slot;
+	*slot = co;
+}
 
-/* 
- * number of minibolts per second
+/*
+ * Take CO out of its slot. Call with tw_lock held.
  */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
+static
+void
+tw_remove(struct callout *co)
+{
+	KASSERT(co->co_prevp != NULL);
+
+	*co->co_prevp = co->co_next;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = co->co_prevp;
+	}
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+}
 
 /*
- * minibolt countdown
+ * Move everything in a slot of LEVEL down to where it now belongs.
+ * Call with tw_lock held.
  */
-static int minicount;
+static
+void
+tw_cascade(unsigned level, unsigned index)
+{
+	struct callout *co, *next;
+
+	co = tw_slots[level][index];
+	tw_slots[level][index] = NULL;
+	for (; co != NULL; co = next) {
+		next = co->co_next;
+		co->co_prevp = NULL;
+		tw_insert(co);
+	}
+}
+
+void
+callout_init(struct callout *co)
+{
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+	co->co_expire = 0;
+	co->co_func = NULL;
+	co->co_arg = NULL;
+}
+
+void
+callout_schedule_at(struct callout *co, void (*func)(void *), void *arg,
+		    uint32_t tick)
+{
+	spinlock_acquire(&tw_lock);
+	if (co->co_prevp != NULL) {
+		tw_remove(co);
+	}
+	co->co_func = func;
+	co->co_arg = arg;
+	if ((int32_t)(tick - tw_now) <= 0) {
+		/* The current tick has already been run; the next one */
+		tick = tw_now + 1;
+	}
+	co->co_expire = tick;
+	tw_insert(co);
+	spinlock_release(&tw_lock);
+}
+
+void
+callout_schedule(struct callout *co, void (*func)(void *), void *arg,
+		 uint32_t usec)
+{
+	uint32_t ticks;
+
+	ticks = clock_usec_to_ticks(usec);
+	if (ticks == 0) {
+		/* Not this tick, which may be half over; the next one */
+		ticks = 1;
+	}
+	callout_schedule_at(co, func, arg, clock_ticks() + ticks);
+}
+
+bool
+callout_cancel(struct callout *co)
+{
+	bool wasscheduled;
+
+	spinlock_acquire(&tw_lock);
+	wasscheduled = co->co_prevp != NULL;
+	if (wasscheduled) {
+		tw_remove(co);
+	}
+	spinlock_release(&tw_lock);
+
+	return wasscheduled;
+}
+
+uint32_t
+clock_ticks(void)
+{
+	return tw_now;
+}
+
+uint32_t
+clock_usec_to_ticks(uint32_t usec)
+{
+	return DIVROUNDUP(usec, LT_GRANULARITY);
+}
 
 /*
  * Setup.
@@ -79,33 +243,51 @@ static int minicount;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
-	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
-	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
+	/* The wheel is statically initialized; nothing to do. */
 }
 
 /*
- * This is called once every every LT_GRANULARITY usec, on one processor,
- * by the timer code.
+ * This is called once every LT_GRANULARITY usec, on one processor,
+ * by the timer code. Advance the wheel one tick and run whatever is
+ * due.
  */
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
+	struct callout *co;
+	void (*func)(void *);
+	void *arg;
+	unsigned level, index;
+
+	spinlock_acquire(&tw_lock);
+
+	tw_now++;
+	for (level = 1; level < TW_LEVELS; level++) {
+		if ((tw_now >> (TW_BITS * (level - 1))) & TW_MASK) {
+			break;
+		}
+		index = (tw_now >> (TW_BITS * level)) & TW_MASK;
+		tw_cascade(level, index);
+	}
+
+	/*
+	 * Run the callouts due now, one at a time, dropping the lock for
+	 * each. The callout may be freed (or rescheduled) as soon as its
+	 * function is called, so don't touch it after that.
+	 */
+	index = tw_now & TW_MASK;
+	while ((co = tw_slots[0][index]) != NULL) {
+		tw_remove(co);
+		func = co->co_func;
+		arg = co->co_arg;
+		spinlock_release(&tw_lock);
+
+		func(arg);
+
+		spinlock_acquire(&tw_lock);
 	}
+
+	spinlock_release(&tw_lock);
 }
 
 /*
@@ -135,10 +317,9 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
+  if (num_secs > 0) {
+    thread_sleep_until(clock_ticks() +
+		       (uint32_t)num_secs * (1000000 / LT_GRANULARITY));
   }
 }
 
@@ -149,9 +330,7 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
+  if (num_ticks > 0) {
+    thread_sleep_until(clock_ticks() + num_ticks);
   }
 }
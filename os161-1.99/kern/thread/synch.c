@@ -39,6 +39,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <tracepoint.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -206,6 +207,8 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+	bool waited = false;
+
 	KASSERT(lock != NULL);
 	//KASSERT(curthread->t_in_interrupt == false); //not sure what this does
 
@@ -217,6 +220,7 @@ lock_acquire(struct lock *lock)
 		spinlock_release(&lock->spin);
 
 		wchan_sleep(lock->wchan); // sleep the wait channel
+		waited = true;
 		//lock->held = true;  // Having these two lines here actually doesn't make a lot of sense
 		//lock->owner = curthread;
 
@@ -228,6 +232,26 @@ lock_acquire(struct lock *lock)
 	lock->owner = curthread; // the current thread owns the lock
 
 	spinlock_release(&lock->spin);
+
+	TRACEPOINT(TP_LOCK_ACQUIRE, lock, waited);
+}
+
+bool
+lock_tryacquire(struct lock *lock)
+{
+	bool got;
+
+	KASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->spin);
+	got = !lock->held;
+	if (got) {
+		lock->held = true;
+		lock->owner = curthread;
+	}
+	spinlock_release(&lock->spin);
+
+	return got;
 }
 
 void
@@ -41,6 +41,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <clock.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
@@ -50,6 +51,8 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <klog.h>
+#include <tracepoint.h>
 
 #include "opt-synchprobs.h"
 
@@ -193,6 +196,7 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	klog_cpuinit(c);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -641,6 +645,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	TRACEPOINT(TP_THREAD_SWITCH, next, newstate);
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -1108,6 +1114,50 @@ wchan_isempty(struct wchan *wc)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Timed sleep.
+ *
+ * The sleeping thread waits on a wait channel of its own, on its
+ * stack, and schedules a callout to wake it. The channel is locked
+ * before the callout is scheduled and stays locked until the thread
+ * is on it (wchan_sleep unlocks it), so the callout can't get in
+ * between and have its wakeup lost. The callout doesn't touch the
+ * channel after taking the thread off it, so the thread is free to
+ * return (and pop the channel off its stack) as soon as it runs.
+ */
+
+static
+void
+thread_sleep_timeout(void *vwc)
+{
+	wchan_wakeone(vwc);
+}
+
+void
+thread_sleep_until(uint32_t deadline)
+{
+	struct wchan wc;
+	struct callout co;
+
+	if ((int32_t)(deadline - clock_ticks()) <= 0) {
+		return;
+	}
+
+	spinlock_init(&wc.wc_lock);
+	threadlist_init(&wc.wc_threads);
+	wc.wc_name = "sleep";
+	callout_init(&co);
+
+	wchan_lock(&wc);
+	callout_schedule_at(&co, thread_sleep_timeout, &wc, deadline);
+	wchan_sleep(&wc);
+
+	threadlist_cleanup(&wc.wc_threads);
+	spinlock_cleanup(&wc.wc_lock);
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Machine-independent IPI handling
  */
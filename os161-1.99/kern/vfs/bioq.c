@@ -0,0 +1,219 @@
+/*
+ * Block I/O request queue with a C-SCAN/deadline elevator. See bioq.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <thread.h>
+#include <device.h>
+#include <bioq.h>
+
+struct bioq {
+	struct device *bq_dev;
+	int (*bq_doio)(struct device *, struct uio *);
+
+	struct lock *bq_lock;
+	struct cv *bq_workcv;		/* worker waits for requests */
+	struct cv *bq_donecv;		/* bioq_io waits for completion */
+
+	struct bioreq *bq_pending;	/* sorted by sector */
+	uint32_t bq_headpos;		/* sector after the last one served */
+	unsigned bq_served;		/* requests served; deadline clock */
+};
+
+/*
+ * Pick the next request to serve, and take it off the pending list.
+ */
+static
+struct bioreq *
+bioq_next(struct bioq *q)
+{
+	struct bioreq *br, *pick;
+	struct bioreq **pp, **pickpp;
+
+	KASSERT(lock_do_i_hold(q->bq_lock));
+	KASSERT(q->bq_pending != NULL);
+
+	/* Anyone past their deadline? Take the one that's waited longest. */
+	pick = NULL;
+	pickpp = NULL;
+	for (pp = &q->bq_pending; *pp != NULL; pp = &(*pp)->br_next) {
+		br = *pp;
+		if ((int)(q->bq_served - br->br_deadline) >= 0 &&
+		    (pick == NULL ||
+		     (int)(br->br_deadline - pick->br_deadline) < 0)) {
+			pick = br;
+			pickpp = pp;
+		}
+	}
+
+	if (pick == NULL) {
+		/*
+		 * C-SCAN: the first request at or after the head, or
+		 * failing that, the lowest one (the list is sorted).
+		 */
+		pickpp = &q->bq_pending;
+		for (pp = &q->bq_pending; *pp != NULL; pp = &(*pp)->br_next) {
+			if ((*pp)->br_sector >= q->bq_headpos) {
+				pickpp = pp;
+				break;
+			}
+		}
+		pick = *pickpp;
+	}
+
+	*pickpp = pick->br_next;
+	pick->br_next = NULL;
+	return pick;
+}
+
+/*
+ * Worker thread: serve requests forever.
+ */
+static
+void
+bioq_worker(void *vq, unsigned long unused)
+{
+	struct bioq *q = vq;
+	struct bioreq *br;
+	int result;
+
+	(void)unused;
+
+	lock_acquire(q->bq_lock);
+	while (1) {
+		while (q->bq_pending == NULL) {
+			cv_wait(q->bq_workcv, q->bq_lock);
+		}
+		br = bioq_next(q);
+		q->bq_served++;
+		q->bq_headpos = br->br_sector +
+			br->br_uio->uio_resid / q->bq_dev->d_blocksize;
+		lock_release(q->bq_lock);
+
+		result = q->bq_doio(q->bq_dev, br->br_uio);
+		br->br_done(br, result);
+
+		lock_acquire(q->bq_lock);
+	}
+}
+
+struct bioq *
+bioq_create(const char *name, struct device *dev,
+	    int (*doio)(struct device *, struct uio *))
+{
+	struct bioq *q;
+	int result;
+
+	q = kmalloc(sizeof(struct bioq));
+	if (q == NULL) {
+		return NULL;
+	}
+	q->bq_lock = lock_create(name);
+	if (q->bq_lock == NULL) {
+		kfree(q);
+		return NULL;
+	}
+	q->bq_workcv = cv_create(name);
+	if (q->bq_workcv == NULL) {
+		lock_destroy(q->bq_lock);
+		kfree(q);
+		return NULL;
+	}
+	q->bq_donecv = cv_create(name);
+	if (q->bq_donecv == NULL) {
+		cv_destroy(q->bq_workcv);
+		lock_destroy(q->bq_lock);
+		kfree(q);
+		return NULL;
+	}
+	q->bq_dev = dev;
+	q->bq_doio = doio;
+	q->bq_pending = NULL;
+	q->bq_headpos = 0;
+	q->bq_served = 0;
+
+	result = thread_fork(name, NULL, bioq_worker, q, 0);
+	if (result) {
+		cv_destroy(q->bq_donecv);
+		cv_destroy(q->bq_workcv);
+		lock_destroy(q->bq_lock);
+		kfree(q);
+		return NULL;
+	}
+	return q;
+}
+
+void
+bioq_submit(struct bioq *q, struct bioreq *br)
+{
+	struct bioreq **pp;
+
+	KASSERT(br->br_uio->uio_segflg == UIO_SYSSPACE);
+	br->br_sector = br->br_uio->uio_offset / q->bq_dev->d_blocksize;
+
+	lock_acquire(q->bq_lock);
+	br->br_deadline = q->bq_served + BIOQ_DEADLINE;
+
+	/* Insert in sector order, after any others for the same sector */
+	for (pp = &q->bq_pending; *pp != NULL; pp = &(*pp)->br_next) {
+		if ((*pp)->br_sector > br->br_sector) {
+			break;
+		}
+	}
+	br->br_next = *pp;
+	*pp = br;
+
+	cv_signal(q->bq_workcv, q->bq_lock);
+	lock_release(q->bq_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Synchronous requests
+
+struct bioq_waiter {
+	struct bioq *bw_q;
+	bool bw_done;
+	int bw_result;
+};
+
+static
+void
+bioq_wakeup(struct bioreq *br, int result)
+{
+	struct bioq_waiter *bw = br->br_data;
+
+	lock_acquire(bw->bw_q->bq_lock);
+	bw->bw_done = true;
+	bw->bw_result = result;
+	cv_broadcast(bw->bw_q->bq_donecv, bw->bw_q->bq_lock);
+	lock_release(bw->bw_q->bq_lock);
+}
+
+int
+bioq_io(struct bioq *q, struct uio *uio)
+{
+	struct bioq_waiter bw;
+	struct bioreq br;
+
+	bw.bw_q = q;
+	bw.bw_done = false;
+	bw.bw_result = 0;
+
+	br.br_uio = uio;
+	br.br_done = bioq_wakeup;
+	br.br_data = &bw;
+	bioq_submit(q, &br);
+
+	lock_acquire(q->bq_lock);
+	while (!bw.bw_done) {
+		cv_wait(q->bq_donecv, q->bq_lock);
+	}
+	lock_release(q->bq_lock);
+
+	return bw.bw_result;
+}
@@ -0,0 +1,951 @@
+/*
+ * Block buffer cache. See buf.h for the interface.
+ *
+ * All of the cache's own state (the hash chains, the buffer array, the
+ * clock hand, the pin counts and flags, the counters, the prefetch
+ * queue) is protected by buffer_lock. The lock is not held across
+ * device I/O; instead a buffer being read or written is marked busy,
+ * and anyone else who wants it waits on buffer_cv until it is not.
+ * Busy buffers are never evicted.
+ *
+ * Writes are delayed: a modified buffer just stays dirty in memory, so
+ * repeated updates to the same block cost one disk write. The syncer
+ * thread flushes everything (via vfs_sync, so that dirty inodes, free
+ * maps and superblocks get pushed into the cache and written too)
+ * every BUFFER_SYNCINTERVAL seconds, or sooner when dirty buffers pile
+ * up or eviction runs out of clean ones.
+ *
+ * Reads can be started ahead of time with buffer_prefetch, which queues
+ * the block for the prefetcher thread to load into the cache. On
+ * devices with a request queue (bioq.h) the prefetcher submits the
+ * reads asynchronously.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <clock.h>
+#include <thread.h>
+#include <vfs.h>
+#include <device.h>
+#include <bioq.h>
+#include <mainbus.h>
+#include <buf.h>
+
+struct buf {
+	struct device *b_dev;		/* device, or NULL if buffer unused */
+	uint32_t b_block;		/* block number on b_dev */
+	void *b_data;			/* BUFFER_SIZE bytes, or NULL */
+	unsigned b_refcount;		/* number of pins */
+	bool b_dirty;			/* modified since read/written */
+	bool b_referenced;		/* CLOCK "recently used" bit */
+	bool b_busy;			/* device I/O in progress */
+	struct buf *b_hashnext;		/* next in hash chain */
+};
+
+static struct lock *buffer_lock;
+static struct cv *buffer_cv;		/* for waiting on busy buffers */
+static struct buf *buffers;		/* array of buffer_max buffers */
+static unsigned buffer_max;
+static unsigned buffer_clockhand;
+static struct buf *buffer_hash[BUFFER_HASHSIZE];
+static unsigned buffer_ndirty;		/* number of dirty buffers */
+static bool buffer_pressure;		/* eviction had to write back */
+
+/* Counters, for buffer_printstats */
+static unsigned buffer_hits;
+static unsigned buffer_misses;
+static unsigned buffer_evictions;
+static unsigned buffer_writebacks;
+static unsigned buffer_prefetches;
+static unsigned buffer_clusters;	/* device requests for the above */
+
+/* Prefetch queue: a ring of blocks for the prefetcher to load */
+static struct {
+	struct device *pf_dev;
+	uint32_t pf_block;
+} buffer_pfqueue[BUFFER_PREFETCHMAX];
+static unsigned buffer_pfhead, buffer_pfcount;
+static unsigned buffer_pfinflight;	/* blocks in submitted prefetches */
+static struct cv *buffer_pfcv;		/* prefetcher waits for work */
+
+void
+buffer_bootstrap(void)
+{
+	unsigned i;
+
+	buffer_max = mainbus_ramsize() / BUFFER_RAMFRACTION / BUFFER_SIZE;
+	if (buffer_max < BUFFER_MIN) {
+		buffer_max = BUFFER_MIN;
+	}
+
+	buffers = kmalloc(buffer_max * sizeof(struct buf));
+	if (buffers == NULL) {
+		panic("buffer_bootstrap: Out of memory\n");
+	}
+	for (i=0; i<buffer_max; i++) {
+		buffers[i].b_dev = NULL;
+		buffers[i].b_block = 0;
+		buffers[i].b_data = NULL;
+		buffers[i].b_refcount = 0;
+		buffers[i].b_dirty = false;
+		buffers[i].b_referenced = false;
+		buffers[i].b_busy = false;
+		buffers[i].b_hashnext = NULL;
+	}
+	for (i=0; i<BUFFER_HASHSIZE; i++) {
+		buffer_hash[i] = NULL;
+	}
+	buffer_clockhand = 0;
+	buffer_ndirty = 0;
+	buffer_pressure = false;
+	buffer_pfhead = buffer_pfcount = 0;
+	buffer_pfinflight = 0;
+
+	buffer_lock = lock_create("buffer cache");
+	buffer_cv = cv_create("buffer busy");
+	buffer_pfcv = cv_create("buffer prefetch");
+	if (buffer_lock == NULL || buffer_cv == NULL || buffer_pfcv == NULL) {
+		panic("buffer_bootstrap: Could not create synchronization\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Internal routines; all called with buffer_lock held.
+
+static
+unsigned
+buffer_hashfunc(struct device *dev, uint32_t block)
+{
+	return (((uintptr_t)dev >> 4) ^ block) % BUFFER_HASHSIZE;
+}
+
+/* Look up a block in the hash table. */
+static
+struct buf *
+buffer_lookup(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	for (b = buffer_hash[buffer_hashfunc(dev, block)];
+	     b != NULL; b = b->b_hashnext) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Look up a block. If its buffer is busy, wait until it is not, and
+ * look again (a failed read will have thrown the buffer away).
+ */
+static
+struct buf *
+buffer_find(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	while ((b = buffer_lookup(dev, block)) != NULL && b->b_busy) {
+		cv_wait(buffer_cv, buffer_lock);
+	}
+	return b;
+}
+
+static
+void
+buffer_unhash(struct buf *b)
+{
+	struct buf **pp;
+
+	KASSERT(b->b_dev != NULL);
+	pp = &buffer_hash[buffer_hashfunc(b->b_dev, b->b_block)];
+	while (*pp != b) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->b_hashnext;
+	}
+	*pp = b->b_hashnext;
+	b->b_hashnext = NULL;
+	b->b_dev = NULL;
+}
+
+/*
+ * Transfer a run of N buffers, holding consecutive blocks of one
+ * device, to or from the device as a single request, retrying on I/O
+ * errors. The caller marks the buffers busy; buffer_lock is dropped
+ * for the duration of the I/O, and afterwards the buffers are marked
+ * not busy and waiters are woken.
+ */
+static
+int
+buffer_devio(struct buf **run, unsigned n, enum uio_rw rw)
+{
+	struct iovec iov[BUFFER_CLUSTERMAX];
+	struct uio ku;
+	struct device *dev = run[0]->b_dev;
+	uint32_t block = run[0]->b_block;
+	unsigned i;
+	int result;
+	int tries = 0;
+
+	KASSERT(lock_do_i_hold(buffer_lock));
+	KASSERT(dev->d_blocksize == BUFFER_SIZE);
+	KASSERT(n > 0 && n <= BUFFER_CLUSTERMAX);
+	for (i=0; i<n; i++) {
+		KASSERT(run[i]->b_busy);
+		KASSERT(run[i]->b_dev == dev);
+		KASSERT(run[i]->b_block == block + i);
+	}
+
+	lock_release(buffer_lock);
+
+ retry:
+	/* (uiomove consumes the iovecs, so set them up every time) */
+	for (i=0; i<n; i++) {
+		iov[i].iov_kbase = run[i]->b_data;
+		iov[i].iov_len = BUFFER_SIZE;
+	}
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = n;
+	ku.uio_offset = ((off_t)block)*BUFFER_SIZE;
+	ku.uio_resid = n*BUFFER_SIZE;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = rw;
+	ku.uio_space = NULL;
+	ku.uio_ra = NULL;
+
+	result = dev->d_io(dev, &ku);
+	if (result == EINVAL) {
+		/*
+		 * This means the sector we requested was out of range,
+		 * or the seek address we gave wasn't sector-aligned,
+		 * or a couple of other things that are our fault.
+		 */
+		panic("buffer: d_io returned EINVAL\n");
+	}
+	if (result == EIO) {
+		if (tries == 0) {
+			kprintf("buffer: blocks %u-%u I/O error, retrying\n",
+				block, block + n - 1);
+		}
+		if (tries < 10) {
+			tries++;
+			goto retry;
+		}
+		kprintf("buffer: blocks %u-%u I/O error, giving up after "
+			"%d retries\n", block, block + n - 1, tries);
+	}
+
+	lock_acquire(buffer_lock);
+	for (i=0; i<n; i++) {
+		run[i]->b_busy = false;
+	}
+	cv_broadcast(buffer_cv, buffer_lock);
+	return result;
+}
+
+/*
+ * Write back a dirty buffer, along with the dirty buffers for the
+ * blocks after it (up to BUFFER_CLUSTERMAX in all), in one request.
+ * Drops buffer_lock during the write.
+ */
+static
+int
+buffer_writeback(struct buf *b)
+{
+	struct buf *run[BUFFER_CLUSTERMAX];
+	struct buf *next;
+	unsigned i, n;
+	int result;
+
+	KASSERT(b->b_dirty);
+	KASSERT(!b->b_busy);
+
+	run[0] = b;
+	for (n=1; n<BUFFER_CLUSTERMAX; n++) {
+		next = buffer_lookup(b->b_dev, b->b_block + n);
+		if (next == NULL || !next->b_dirty || next->b_busy) {
+			break;
+		}
+		run[n] = next;
+	}
+	for (i=0; i<n; i++) {
+		run[i]->b_busy = true;
+	}
+
+	result = buffer_devio(run, n, UIO_WRITE);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<n; i++) {
+		KASSERT(run[i]->b_dirty);
+		run[i]->b_dirty = false;
+	}
+	KASSERT(buffer_ndirty >= n);
+	buffer_ndirty -= n;
+	buffer_writebacks += n;
+	buffer_clusters++;
+	return 0;
+}
+
+/*
+ * Find a buffer to hold a new block: an unused one if there is one,
+ * otherwise the CLOCK victim. Clean victims are preferred, since dirty
+ * ones would have to be written first; the syncer will clean them. Only
+ * if there are no clean buffers to be had is a dirty one written back
+ * here, after which we look again, as the lock was dropped for the
+ * write. Returns the buffer unhashed, with data allocated.
+ *
+ * If every buffer that could be used is busy with I/O, wait for some
+ * to finish if WAIT is true, or fail with ENOMEM if not. The
+ * prefetcher must not wait: the busy buffers may be its own.
+ */
+static
+int
+buffer_evict(bool wait, struct buf **ret)
+{
+	struct buf *b;
+	struct buf *dirtyvictim;
+	bool sawbusy;
+	unsigned i;
+	int result;
+
+ again:
+	dirtyvictim = NULL;
+	sawbusy = false;
+
+	/* Two sweeps: the first may only clear referenced bits. */
+	for (i=0; i<2*buffer_max; i++) {
+		b = &buffers[buffer_clockhand];
+		buffer_clockhand = (buffer_clockhand + 1) % buffer_max;
+
+		if (b->b_dev == NULL) {
+			if (b->b_data == NULL) {
+				b->b_data = kmalloc(BUFFER_SIZE);
+				if (b->b_data == NULL) {
+					/* Make do with the buffers we have. */
+					continue;
+				}
+			}
+			*ret = b;
+			return 0;
+		}
+		if (b->b_busy) {
+			sawbusy = true;
+			continue;
+		}
+		if (b->b_refcount > 0) {
+			continue;
+		}
+		if (b->b_referenced) {
+			b->b_referenced = false;
+			continue;
+		}
+		if (b->b_dirty) {
+			if (dirtyvictim == NULL) {
+				dirtyvictim = b;
+			}
+			continue;
+		}
+
+		buffer_unhash(b);
+		buffer_evictions++;
+		*ret = b;
+		return 0;
+	}
+
+	if (dirtyvictim != NULL) {
+		/* Out of clean buffers: write one back, and hurry the syncer */
+		buffer_pressure = true;
+		result = buffer_writeback(dirtyvictim);
+		if (result) {
+			return result;
+		}
+		goto again;
+	}
+
+	if (sawbusy && wait) {
+		/* Wait for some I/O (e.g. prefetches) to finish */
+		cv_wait(buffer_cv, buffer_lock);
+		goto again;
+	}
+
+	/*
+	 * Everything is pinned or busy (or we could not allocate any
+	 * memory).
+	 */
+	return ENOMEM;
+}
+
+/*
+ * Get a buffer for a block that is not cached, and enter it in the
+ * hash table marked busy, so anyone else who wants the block waits
+ * while we fill it in. Returns EEXIST if the block is cached (or, as
+ * eviction may drop the lock, has become cached meanwhile). WAIT is
+ * passed to buffer_evict.
+ */
+static
+int
+buffer_claim(struct device *dev, uint32_t block, bool wait,
+	     struct buf **ret)
+{
+	struct buf *b;
+	unsigned bucket;
+	int result;
+
+	if (buffer_lookup(dev, block) != NULL) {
+		return EEXIST;
+	}
+	result = buffer_evict(wait, &b);
+	if (result) {
+		return result;
+	}
+	if (buffer_lookup(dev, block) != NULL) {
+		/* B stays unused */
+		return EEXIST;
+	}
+
+	b->b_dev = dev;
+	b->b_block = block;
+	b->b_dirty = false;
+	b->b_referenced = false;
+	b->b_busy = true;
+	bucket = buffer_hashfunc(dev, block);
+	b->b_hashnext = buffer_hash[bucket];
+	buffer_hash[bucket] = b;
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Find or load a block. Returns the buffer, unpinned, with
+ * buffer_lock still held. If DOREAD is false and the block was not
+ * cached, the buffer is zeroed instead of read. *HIT reports whether
+ * the block was already cached.
+ */
+static
+int
+buffer_load(struct device *dev, uint32_t block, bool doread,
+	    struct buf **ret, bool *hit)
+{
+	struct buf *b;
+	int result;
+
+	KASSERT(lock_do_i_hold(buffer_lock));
+
+	while (1) {
+		b = buffer_find(dev, block);
+		if (b != NULL) {
+			*hit = true;
+			*ret = b;
+			return 0;
+		}
+		result = buffer_claim(dev, block, true, &b);
+		if (result != EEXIST) {
+			break;
+		}
+	}
+	if (result) {
+		return result;
+	}
+
+	if (doread) {
+		result = buffer_devio(&b, 1, UIO_READ);
+		if (result) {
+			buffer_unhash(b);
+			return result;
+		}
+	}
+	else {
+		bzero(b->b_data, BUFFER_SIZE);
+		b->b_busy = false;
+		cv_broadcast(buffer_cv, buffer_lock);
+	}
+
+	*hit = false;
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Common code for buffer_read and buffer_get.
+ */
+static
+int
+buffer_getpinned(struct device *dev, uint32_t block, bool doread,
+		 struct buf **ret)
+{
+	struct buf *b;
+	bool hit;
+	int result;
+
+	lock_acquire(buffer_lock);
+
+	result = buffer_load(dev, block, doread, &b, &hit);
+	if (result) {
+		lock_release(buffer_lock);
+		return result;
+	}
+	if (hit) {
+		buffer_hits++;
+	}
+	else {
+		buffer_misses++;
+	}
+
+	b->b_refcount++;
+	b->b_referenced = true;
+
+	lock_release(buffer_lock);
+
+	*ret = b;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Interface
+
+int
+buffer_read(struct device *dev, uint32_t block, struct buf **ret)
+{
+	return buffer_getpinned(dev, block, true, ret);
+}
+
+int
+buffer_get(struct device *dev, uint32_t block, struct buf **ret)
+{
+	return buffer_getpinned(dev, block, false, ret);
+}
+
+void *
+buffer_map(struct buf *b)
+{
+	KASSERT(b->b_refcount > 0);
+	return b->b_data;
+}
+
+void
+buffer_mark_dirty(struct buf *b)
+{
+	KASSERT(b->b_refcount > 0);
+	lock_acquire(buffer_lock);
+	/*
+	 * If it's being written back, that write may have missed the
+	 * caller's changes; wait for it to finish, so it can't mark the
+	 * buffer clean after we mark it dirty.
+	 */
+	while (b->b_busy) {
+		cv_wait(buffer_cv, buffer_lock);
+	}
+	if (!b->b_dirty) {
+		b->b_dirty = true;
+		buffer_ndirty++;
+	}
+	lock_release(buffer_lock);
+}
+
+void
+buffer_release(struct buf *b)
+{
+	lock_acquire(buffer_lock);
+	KASSERT(b->b_refcount > 0);
+	b->b_refcount--;
+	lock_release(buffer_lock);
+}
+
+void
+buffer_drop(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	lock_acquire(buffer_lock);
+	b = buffer_find(dev, block);
+	if (b != NULL) {
+		KASSERT(b->b_refcount == 0);
+		KASSERT(!b->b_busy);
+		if (b->b_dirty) {
+			b->b_dirty = false;
+			buffer_ndirty--;
+		}
+		buffer_unhash(b);
+	}
+	lock_release(buffer_lock);
+}
+
+int
+buffer_sync(struct device *dev)
+{
+	struct buf *prev;
+	unsigned i, n;
+	int result;
+
+	lock_acquire(buffer_lock);
+	for (i=0; i<buffer_max; i++) {
+		struct buf *b = &buffers[i];
+
+		while (b->b_busy) {
+			cv_wait(buffer_cv, buffer_lock);
+		}
+		if (b->b_dev == NULL || (dev != NULL && b->b_dev != dev) ||
+		    !b->b_dirty) {
+			continue;
+		}
+
+		/* Start from the beginning of its run of dirty blocks */
+		for (n=1; n<BUFFER_CLUSTERMAX && b->b_block > 0; n++) {
+			prev = buffer_lookup(b->b_dev, b->b_block - 1);
+			if (prev == NULL || !prev->b_dirty || prev->b_busy) {
+				break;
+			}
+			b = prev;
+		}
+
+		result = buffer_writeback(b);
+		if (result) {
+			lock_release(buffer_lock);
+			return result;
+		}
+	}
+	lock_release(buffer_lock);
+	return 0;
+}
+
+int
+buffer_sync_range(struct device *dev, uint32_t first, uint32_t n)
+{
+	struct buf *b;
+	uint32_t i;
+	int result;
+
+	KASSERT(dev != NULL);
+
+	lock_acquire(buffer_lock);
+	for (i=0; i<n; i++) {
+		b = buffer_find(dev, first + i);
+		if (b == NULL || !b->b_dirty) {
+			continue;
+		}
+		/* (this also takes any dirty blocks right after it) */
+		result = buffer_writeback(b);
+		if (result) {
+			lock_release(buffer_lock);
+			return result;
+		}
+	}
+	lock_release(buffer_lock);
+	return 0;
+}
+
+void
+buffer_invalidate(struct device *dev)
+{
+	unsigned i;
+
+	KASSERT(dev != NULL);
+
+	lock_acquire(buffer_lock);
+	for (i=0; i<buffer_max; i++) {
+		struct buf *b = &buffers[i];
+
+		while (b->b_busy) {
+			/* presumably the prefetcher */
+			cv_wait(buffer_cv, buffer_lock);
+		}
+		if (b->b_dev == dev) {
+			KASSERT(b->b_refcount == 0);
+			KASSERT(!b->b_dirty);
+			buffer_unhash(b);
+		}
+	}
+	lock_release(buffer_lock);
+}
+
+void
+buffer_prefetch(struct device *dev, uint32_t block)
+{
+	unsigned i, slot;
+
+	lock_acquire(buffer_lock);
+
+	/* Already queued? */
+	for (i=0; i<buffer_pfcount; i++) {
+		slot = (buffer_pfhead + i) % BUFFER_PREFETCHMAX;
+		if (buffer_pfqueue[slot].pf_dev == dev &&
+		    buffer_pfqueue[slot].pf_block == block) {
+			lock_release(buffer_lock);
+			return;
+		}
+	}
+
+	/* If the queue is full, just forget it; it's only a hint. */
+	if (buffer_pfcount < BUFFER_PREFETCHMAX) {
+		slot = (buffer_pfhead + buffer_pfcount) % BUFFER_PREFETCHMAX;
+		buffer_pfqueue[slot].pf_dev = dev;
+		buffer_pfqueue[slot].pf_block = block;
+		buffer_pfcount++;
+		cv_signal(buffer_pfcv, buffer_lock);
+	}
+
+	lock_release(buffer_lock);
+}
+
+void
+buffer_printstats(void)
+{
+	unsigned i, inuse, dirty;
+
+	lock_acquire(buffer_lock);
+	inuse = dirty = 0;
+	for (i=0; i<buffer_max; i++) {
+		if (buffers[i].b_dev != NULL) {
+			inuse++;
+			if (buffers[i].b_dirty) {
+				dirty++;
+			}
+		}
+	}
+	KASSERT(dirty == buffer_ndirty);
+	kprintf("Buffer cache: %u buffers of %u bytes, %u in use, %u dirty\n",
+		buffer_max, BUFFER_SIZE, inuse, dirty);
+	kprintf("  %u hits, %u misses, %u evictions, %u writebacks, "
+		"%u prefetches\n",
+		buffer_hits, buffer_misses, buffer_evictions,
+		buffer_writebacks, buffer_prefetches);
+	kprintf("  %u device requests for the writebacks and prefetches\n",
+		buffer_clusters);
+	lock_release(buffer_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Syncer
+
+/*
+ * Body of the syncer thread. Wakes up once a second; syncs when the
+ * interval has passed, when more than 1/BUFFER_DIRTYFRACTION of the
+ * buffers are dirty, or when eviction has had to write back.
+ */
+static
+void
+buffer_syncer(void *unused1, unsigned long unused2)
+{
+	unsigned secs = 0;
+	bool hurry;
+
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		clocksleep(1);
+		secs++;
+
+		lock_acquire(buffer_lock);
+		hurry = buffer_pressure ||
+			buffer_ndirty > buffer_max / BUFFER_DIRTYFRACTION;
+		buffer_pressure = false;
+		lock_release(buffer_lock);
+
+		if (hurry || secs >= BUFFER_SYNCINTERVAL) {
+			vfs_sync();
+			secs = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Prefetcher
+
+/*
+ * Finish off a prefetch of N blocks, after the read and after the
+ * buffers are marked not busy.
+ */
+static
+void
+buffer_pfdone(struct buf **run, unsigned n, int result)
+{
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(buffer_lock));
+
+	for (i=0; i<n; i++) {
+		if (result) {
+			buffer_unhash(run[i]);
+		}
+		else {
+			run[i]->b_referenced = true;
+			buffer_prefetches++;
+		}
+	}
+	if (result == 0) {
+		buffer_clusters++;
+	}
+}
+
+/*
+ * Asynchronous prefetch, for devices with a request queue: the
+ * prefetcher submits the read and goes straight on to the next one,
+ * so several can be pending at once and the elevator can order them
+ * along with everyone else's requests. The read's completion function
+ * releases the buffers.
+ */
+struct buffer_pfio {
+	struct bioreq pf_req;
+	struct uio pf_uio;
+	struct iovec pf_iov[BUFFER_CLUSTERMAX];
+	struct buf *pf_run[BUFFER_CLUSTERMAX];
+	unsigned pf_n;
+};
+
+static
+void
+buffer_pfiodone(struct bioreq *br, int result)
+{
+	struct buffer_pfio *pf = br->br_data;
+	unsigned i;
+
+	lock_acquire(buffer_lock);
+	for (i=0; i<pf->pf_n; i++) {
+		pf->pf_run[i]->b_busy = false;
+	}
+	KASSERT(buffer_pfinflight >= pf->pf_n);
+	buffer_pfinflight -= pf->pf_n;
+	cv_broadcast(buffer_cv, buffer_lock);
+	buffer_pfdone(pf->pf_run, pf->pf_n, result);
+	lock_release(buffer_lock);
+
+	kfree(pf);
+}
+
+/*
+ * Submit a prefetch of the (claimed, busy) buffers in RUN. Fails if
+ * the device has no request queue, or we're out of memory, in which
+ * case the caller must do the read itself.
+ */
+static
+int
+buffer_pfsubmit(struct buf **run, unsigned n)
+{
+	struct buffer_pfio *pf;
+	struct device *dev = run[0]->b_dev;
+	unsigned i;
+
+	if (dev->d_bioq == NULL) {
+		return ENOSYS;
+	}
+	pf = kmalloc(sizeof(struct buffer_pfio));
+	if (pf == NULL) {
+		return ENOMEM;
+	}
+
+	for (i=0; i<n; i++) {
+		pf->pf_run[i] = run[i];
+		pf->pf_iov[i].iov_kbase = run[i]->b_data;
+		pf->pf_iov[i].iov_len = BUFFER_SIZE;
+	}
+	pf->pf_n = n;
+	pf->pf_uio.uio_iov = pf->pf_iov;
+	pf->pf_uio.uio_iovcnt = n;
+	pf->pf_uio.uio_offset = ((off_t)run[0]->b_block)*BUFFER_SIZE;
+	pf->pf_uio.uio_resid = n*BUFFER_SIZE;
+	pf->pf_uio.uio_segflg = UIO_SYSSPACE;
+	pf->pf_uio.uio_rw = UIO_READ;
+	pf->pf_uio.uio_space = NULL;
+	pf->pf_uio.uio_ra = NULL;
+	pf->pf_req.br_uio = &pf->pf_uio;
+	pf->pf_req.br_done = buffer_pfiodone;
+	pf->pf_req.br_data = pf;
+	buffer_pfinflight += n;
+
+	/* (the completion function needs buffer_lock) */
+	lock_release(buffer_lock);
+	bioq_submit(dev->d_bioq, &pf->pf_req);
+	lock_acquire(buffer_lock);
+	return 0;
+}
+
+/*
+ * Body of the prefetcher thread: load queued blocks into the cache, so
+ * the thread that asked can go on working on the blocks it already
+ * has. Queued blocks that are consecutive on disk are read together in
+ * one request. The buffers are left marked referenced so they survive
+ * until they are used.
+ */
+static
+void
+buffer_prefetcher(void *unused1, unsigned long unused2)
+{
+	struct buf *run[BUFFER_CLUSTERMAX];
+	struct device *dev;
+	uint32_t block;
+	unsigned n;
+	int result;
+
+	(void)unused1;
+	(void)unused2;
+
+	lock_acquire(buffer_lock);
+	while (1) {
+		while (buffer_pfcount == 0) {
+			cv_wait(buffer_pfcv, buffer_lock);
+		}
+		/* Leave most of the cache for everyone else */
+		while (buffer_pfinflight >= buffer_max / 4) {
+			cv_wait(buffer_cv, buffer_lock);
+		}
+		dev = buffer_pfqueue[buffer_pfhead].pf_dev;
+		block = buffer_pfqueue[buffer_pfhead].pf_block;
+		buffer_pfhead = (buffer_pfhead + 1) % BUFFER_PREFETCHMAX;
+		buffer_pfcount--;
+
+		if (buffer_claim(dev, block, false, &run[0])) {
+			/* Already cached, or no buffers to spare */
+			continue;
+		}
+
+		/* Take the following blocks too, while they're consecutive */
+		for (n=1; n<BUFFER_CLUSTERMAX && buffer_pfcount > 0; n++) {
+			if (buffer_pfqueue[buffer_pfhead].pf_dev != dev ||
+			    buffer_pfqueue[buffer_pfhead].pf_block != block+n) {
+				break;
+			}
+			if (buffer_claim(dev, block+n, false, &run[n])) {
+				/* Cached, or no buffers; end the run here */
+				break;
+			}
+			buffer_pfhead = (buffer_pfhead + 1) % BUFFER_PREFETCHMAX;
+			buffer_pfcount--;
+		}
+
+		if (buffer_pfsubmit(run, n) == 0) {
+			continue;
+		}
+
+		/* Do it ourselves */
+		result = buffer_devio(run, n, UIO_READ);
+		buffer_pfdone(run, n, result);
+	}
+}
+
+void
+buffer_start_threads(void)
+{
+	int result;
+
+	result = thread_fork("syncer", NULL, buffer_syncer, NULL, 0);
+	if (result) {
+		panic("buffer_start_threads: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	result = thread_fork("prefetcher", NULL, buffer_prefetcher, NULL, 0);
+	if (result) {
+		panic("buffer_start_threads: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
@@ -0,0 +1,320 @@
+/*
+ * Directory name lookup cache. See dcache.h for the interface.
+ *
+ * The entries, hash chains, clock hand, generation number and counters
+ * are protected by dcache_lock. Nothing is called with it held except
+ * VOP_INCREF; references are dropped after letting go of it, because
+ * dropping the last one reclaims the vnode, which goes down into the
+ * filesystem. So dcache_lock comes after vfs_listlock and before all
+ * the filesystem locks (see design/fslocking.txt).
+ *
+ * dcache_generation counts invalidations. A lookup that missed in the
+ * cache goes to the filesystem without any lock of ours, so by the
+ * time it comes back with an answer someone may have changed the
+ * directory and invalidated the name; comparing generations catches
+ * that, at the price of occasionally not caching a result that was
+ * fine.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <dcache.h>
+
+struct dcentry {
+	struct vnode *dc_dir;		/* directory, or NULL if unused */
+	struct vnode *dc_vn;		/* what the name is; NULL if nothing */
+	bool dc_referenced;		/* CLOCK "recently used" bit */
+	struct dcentry *dc_hashnext;	/* next in hash chain */
+	char dc_name[DCACHE_NAMEMAX+1];
+};
+
+static struct lock *dcache_lock;
+static struct dcentry dcache_entries[DCACHE_SIZE];
+static struct dcentry *dcache_hash[DCACHE_HASHSIZE];
+static unsigned dcache_clockhand;
+static unsigned dcache_gen;
+
+/* Counters, for dcache_printstats */
+static unsigned dcache_hits;
+static unsigned dcache_neghits;
+static unsigned dcache_misses;
+static unsigned dcache_invalidations;
+
+void
+dcache_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<DCACHE_SIZE; i++) {
+		dcache_entries[i].dc_dir = NULL;
+		dcache_entries[i].dc_vn = NULL;
+		dcache_entries[i].dc_referenced = false;
+		dcache_entries[i].dc_hashnext = NULL;
+		dcache_entries[i].dc_name[0] = 0;
+	}
+	for (i=0; i<DCACHE_HASHSIZE; i++) {
+		dcache_hash[i] = NULL;
+	}
+	dcache_clockhand = 0;
+	dcache_gen = 0;
+
+	dcache_lock = lock_create("dcache");
+	if (dcache_lock == NULL) {
+		panic("dcache_bootstrap: Could not create lock\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Internal routines; all called with dcache_lock held.
+
+static
+unsigned
+dcache_hashfunc(struct vnode *dir, const char *name)
+{
+	unsigned h = 5381;
+
+	while (*name) {
+		h = h*33 + (unsigned char)*name++;
+	}
+	return (h ^ ((uintptr_t)dir >> 4)) % DCACHE_HASHSIZE;
+}
+
+static
+struct dcentry *
+dcache_find(struct vnode *dir, const char *name)
+{
+	struct dcentry *e;
+
+	for (e = dcache_hash[dcache_hashfunc(dir, name)];
+	     e != NULL; e = e->dc_hashnext) {
+		if (e->dc_dir == dir && !strcmp(e->dc_name, name)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take an entry out of use. Hands back the references it held, for
+ * the caller to drop once it has let go of dcache_lock.
+ */
+static
+void
+dcache_remove(struct dcentry *e, struct vnode **dir, struct vnode **vn)
+{
+	struct dcentry **pp;
+
+	KASSERT(e->dc_dir != NULL);
+
+	pp = &dcache_hash[dcache_hashfunc(e->dc_dir, e->dc_name)];
+	while (*pp != e) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->dc_hashnext;
+	}
+	*pp = e->dc_hashnext;
+	e->dc_hashnext = NULL;
+
+	*dir = e->dc_dir;
+	*vn = e->dc_vn;
+	e->dc_dir = NULL;
+	e->dc_vn = NULL;
+}
+
+/* Pick an entry to reuse, with the CLOCK algorithm. */
+static
+struct dcentry *
+dcache_victim(void)
+{
+	struct dcentry *e;
+
+	while (1) {
+		e = &dcache_entries[dcache_clockhand];
+		dcache_clockhand = (dcache_clockhand + 1) % DCACHE_SIZE;
+		if (e->dc_dir == NULL || !e->dc_referenced) {
+			return e;
+		}
+		e->dc_referenced = false;
+	}
+}
+
+/* Drop references handed back by dcache_remove. */
+static
+void
+dcache_release(struct vnode *dir, struct vnode *vn)
+{
+	if (vn != NULL) {
+		VOP_DECREF(vn);
+	}
+	if (dir != NULL) {
+		VOP_DECREF(dir);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// External interface
+
+bool
+dcache_lookup(struct vnode *dir, const char *name, struct vnode **ret)
+{
+	struct dcentry *e;
+
+	lock_acquire(dcache_lock);
+	e = dcache_find(dir, name);
+	if (e == NULL) {
+		dcache_misses++;
+		lock_release(dcache_lock);
+		return false;
+	}
+	e->dc_referenced = true;
+	if (e->dc_vn != NULL) {
+		VOP_INCREF(e->dc_vn);
+		dcache_hits++;
+	}
+	else {
+		dcache_neghits++;
+	}
+	*ret = e->dc_vn;
+	lock_release(dcache_lock);
+	return true;
+}
+
+unsigned
+dcache_generation(void)
+{
+	unsigned gen;
+
+	lock_acquire(dcache_lock);
+	gen = dcache_gen;
+	lock_release(dcache_lock);
+	return gen;
+}
+
+void
+dcache_enter(struct vnode *dir, const char *name, struct vnode *vn,
+	     unsigned gen)
+{
+	struct dcentry *e;
+	struct vnode *olddir = NULL, *oldvn = NULL;
+	unsigned h;
+
+	if (strlen(name) > DCACHE_NAMEMAX) {
+		return;
+	}
+
+	lock_acquire(dcache_lock);
+
+	/* Stale, or someone else got there first */
+	if (gen != dcache_gen || dcache_find(dir, name) != NULL) {
+		lock_release(dcache_lock);
+		return;
+	}
+
+	e = dcache_victim();
+	if (e->dc_dir != NULL) {
+		dcache_remove(e, &olddir, &oldvn);
+	}
+
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	e->dc_dir = dir;
+	e->dc_vn = vn;
+	e->dc_referenced = false;
+	strcpy(e->dc_name, name);
+
+	h = dcache_hashfunc(dir, name);
+	e->dc_hashnext = dcache_hash[h];
+	dcache_hash[h] = e;
+
+	lock_release(dcache_lock);
+
+	dcache_release(olddir, oldvn);
+}
+
+void
+dcache_invalidate(struct vnode *dir, const char *name)
+{
+	struct dcentry *e;
+	struct vnode *olddir, *oldvn;
+	unsigned i;
+
+	lock_acquire(dcache_lock);
+	dcache_gen++;
+	dcache_invalidations++;
+	lock_release(dcache_lock);
+
+	/*
+	 * Go through the entries one at a time, so we can drop each
+	 * one's references without holding the lock.
+	 */
+	for (i=0; i<DCACHE_SIZE; i++) {
+		olddir = oldvn = NULL;
+
+		lock_acquire(dcache_lock);
+		e = &dcache_entries[i];
+		if (e->dc_dir != NULL &&
+		    e->dc_dir->vn_fs == dir->vn_fs &&
+		    (e->dc_dir != dir ||
+		     !strcmp(e->dc_name, name) ||
+		     strchr(e->dc_name, '/') != NULL)) {
+			dcache_remove(e, &olddir, &oldvn);
+		}
+		lock_release(dcache_lock);
+
+		dcache_release(olddir, oldvn);
+	}
+}
+
+void
+dcache_purgefs(struct fs *fs)
+{
+	struct dcentry *e;
+	struct vnode *olddir, *oldvn;
+	unsigned i;
+
+	lock_acquire(dcache_lock);
+	dcache_gen++;
+	lock_release(dcache_lock);
+
+	for (i=0; i<DCACHE_SIZE; i++) {
+		olddir = oldvn = NULL;
+
+		lock_acquire(dcache_lock);
+		e = &dcache_entries[i];
+		if (e->dc_dir != NULL && e->dc_dir->vn_fs == fs) {
+			dcache_remove(e, &olddir, &oldvn);
+		}
+		lock_release(dcache_lock);
+
+		dcache_release(olddir, oldvn);
+	}
+}
+
+void
+dcache_printstats(void)
+{
+	unsigned i, inuse, negative;
+
+	lock_acquire(dcache_lock);
+	inuse = negative = 0;
+	for (i=0; i<DCACHE_SIZE; i++) {
+		if (dcache_entries[i].dc_dir != NULL) {
+			inuse++;
+			if (dcache_entries[i].dc_vn == NULL) {
+				negative++;
+			}
+		}
+	}
+	kprintf("Name cache: %u entries, %u in use, %u negative\n",
+		DCACHE_SIZE, inuse, negative);
+	kprintf("  %u hits, %u negative hits, %u misses, "
+		"%u invalidations\n",
+		dcache_hits, dcache_neghits, dcache_misses,
+		dcache_invalidations);
+	lock_release(dcache_lock);
+}
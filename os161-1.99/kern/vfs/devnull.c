@@ -115,6 +115,7 @@ devnull_create(void)
 
 	dev->d_blocks = 0;
 	dev->d_blocksize = 1;
+	dev->d_bioq = NULL;
 
 	dev->d_devnumber = 0; /* assigned by vfs_adddev */
 
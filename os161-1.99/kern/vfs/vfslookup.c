@@ -35,12 +35,14 @@
 #include <kern/errno.h>
 #include <limits.h>
 #include <lib.h>
-#include <synch.h>
+#include <spinlock.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
+#include <dcache.h>
 
 static struct vnode *bootfs_vnode = NULL;
+static struct spinlock bootfs_lock = SPINLOCK_INITIALIZER;
 
 /*
  * Helper function for actually changing bootfs_vnode.
@@ -51,8 +53,10 @@ change_bootfs(struct vnode *newvn)
 {
 	struct vnode *oldvn;
 
+	spinlock_acquire(&bootfs_lock);
 	oldvn = bootfs_vnode;
 	bootfs_vnode = newvn;
+	spinlock_release(&bootfs_lock);
 
 	if (oldvn != NULL) {
 		VOP_DECREF(oldvn);
@@ -75,14 +79,11 @@ vfs_setbootfs(const char *fsname)
 	int result;
 	struct vnode *newguy;
 
-	vfs_biglock_acquire();
-
 	snprintf(tmp, sizeof(tmp)-1, "%s", fsname);
 	s = strchr(tmp, ':');
 	if (s) {
 		/* If there's a colon, it must be at the end */
 		if (strlen(s)>0) {
-			vfs_biglock_release();
 			return EINVAL;
 		}
 	}
@@ -92,19 +93,16 @@ vfs_setbootfs(const char *fsname)
 
 	result = vfs_chdir(tmp);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	result = vfs_getcurdir(&newguy);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	change_bootfs(newguy);
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -114,9 +112,7 @@ vfs_setbootfs(const char *fsname)
 void
 vfs_clearbootfs(void)
 {
-	vfs_biglock_acquire();
 	change_bootfs(NULL);
-	vfs_biglock_release();
 }
 
 
@@ -133,8 +129,6 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	struct vnode *vn;
 	int result;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/*
 	 * Locate the first colon or slash.
 	 */
@@ -188,11 +182,14 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	KASSERT(colon==0 || slash==0);
 
 	if (path[0]=='/') {
+		spinlock_acquire(&bootfs_lock);
 		if (bootfs_vnode==NULL) {
+			spinlock_release(&bootfs_lock);
 			return ENOENT;
 		}
 		VOP_INCREF(bootfs_vnode);
 		*startvn = bootfs_vnode;
+		spinlock_release(&bootfs_lock);
 	}
 	else {
 		KASSERT(path[0]==':');
@@ -235,11 +232,8 @@ vfs_lookparent(char *path, struct vnode **retval,
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -257,7 +251,6 @@ vfs_lookparent(char *path, struct vnode **retval,
 
 	VOP_DECREF(startvn);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -265,25 +258,42 @@ int
 vfs_lookup(char *path, struct vnode **retval)
 {
 	struct vnode *startvn;
+	char name[DCACHE_NAMEMAX+1];
+	bool cacheable;
+	unsigned gen = 0;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	if (strlen(path)==0) {
 		*retval = startvn;
-		vfs_biglock_release();
 		return 0;
 	}
 
+	/*
+	 * Try the name cache. Devices (with no filesystem) aren't worth
+	 * caching. Save a copy of the path, because VOP_LOOKUP is
+	 * allowed to destroy it.
+	 */
+	cacheable = startvn->vn_fs != NULL && strlen(path) <= DCACHE_NAMEMAX;
+	if (cacheable) {
+		if (dcache_lookup(startvn, path, retval)) {
+			VOP_DECREF(startvn);
+			return *retval == NULL ? ENOENT : 0;
+		}
+		strcpy(name, path);
+		gen = dcache_generation();
+	}
+
 	result = VOP_LOOKUP(startvn, path, retval);
 
+	if (cacheable && (result == 0 || result == ENOENT)) {
+		dcache_enter(startvn, name, result ? NULL : *retval, gen);
+	}
+
 	VOP_DECREF(startvn);
-	vfs_biglock_release();
 	return result;
 }
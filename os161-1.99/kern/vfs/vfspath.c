@@ -38,6 +38,8 @@
 #include <lib.h>
 #include <vfs.h>
 #include <vnode.h>
+#include <dcache.h>
+#include <pagecache.h>
 
 
 /* Does most of the work for open(). */
@@ -74,6 +76,10 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 		}
 
 		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		if (result==0) {
+			/* It may have been a negative entry in the cache */
+			dcache_invalidate(dir, name);
+		}
 
 		VOP_DECREF(dir);
 	}
@@ -101,6 +107,7 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 		}
 		else {
 			result = VOP_TRUNCATE(vn, 0);
+			pagecache_invalidate(vn);
 		}
 		if (result) {
 			VOP_DECOPEN(vn);
@@ -150,6 +157,9 @@ vfs_remove(char *path)
 	}
 
 	result = VOP_REMOVE(dir, name);
+	if (result==0) {
+		dcache_invalidate(dir, name);
+	}
 	VOP_DECREF(dir);
 
 	return result;
@@ -183,6 +193,10 @@ vfs_rename(char *oldpath, char *newpath)
 	}
 
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
+	if (result==0) {
+		dcache_invalidate(olddir, oldname);
+		dcache_invalidate(newdir, newname);
+	}
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
@@ -217,6 +231,9 @@ vfs_link(char *oldpath, char *newpath)
 	}
 
 	result = VOP_LINK(newdir, newname, oldfile);
+	if (result==0) {
+		dcache_invalidate(newdir, newname);
+	}
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -244,6 +261,9 @@ vfs_symlink(const char *contents, char *path)
 	}
 
 	result = VOP_SYMLINK(newdir, newname, contents);
+	if (result==0) {
+		dcache_invalidate(newdir, newname);
+	}
 	VOP_DECREF(newdir);
 
 	return result;
@@ -290,6 +310,9 @@ vfs_mkdir(char *path, mode_t mode)
 	}
 
 	result = VOP_MKDIR(parent, name, mode);
+	if (result==0) {
+		dcache_invalidate(parent, name);
+	}
 
 	VOP_DECREF(parent);
 
@@ -312,6 +335,9 @@ vfs_rmdir(char *path)
 	}
 
 	result = VOP_RMDIR(parent, name);
+	if (result==0) {
+		dcache_invalidate(parent, name);
+	}
 
 	VOP_DECREF(parent);
 
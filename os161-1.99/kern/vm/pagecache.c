@@ -0,0 +1,492 @@
+/*
+ * Page cache for executables. See pagecache.h for the interface.
+ *
+ * All of the cache's state (the slots, the hash chains, the clock hand,
+ * the counters, and vn_cachedpages in each vnode) is protected by
+ * pagecache_lock. The lock is not held while reading a page from the
+ * file or copying it out; instead a page being read is marked busy,
+ * and anyone else who wants it waits on pagecache_cv, and a page being
+ * copied out is pinned, so it won't be replaced.
+ *
+ * Invalidating a vnode takes its pages out of the hash table at once,
+ * so no one can find them again. Pages that are pinned or busy at the
+ * time are marked stale and freed when they're let go; whoever was
+ * using them gets the contents from before the change, as if they had
+ * read a moment earlier.
+ *
+ * pagecache_lock is only ever held while calling kmalloc and kfree,
+ * so it comes after all the file system locks. pagecache_shrink is
+ * called from inside the page allocator, so it only tries the lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <current.h>
+#include <thread.h>
+#include <mainbus.h>
+#include <pagecache.h>
+
+struct pcpage {
+	struct vnode *pp_vn;		/* file, or NULL if slot is free */
+	uint32_t pp_index;		/* page number in the file */
+	char *pp_data;			/* PAGE_SIZE bytes, or NULL */
+	size_t pp_len;			/* bytes of file in the page */
+	unsigned pp_refcount;		/* number of pins */
+	bool pp_busy;			/* being read from the file */
+	bool pp_stale;			/* invalidated; free when unpinned */
+	bool pp_referenced;		/* CLOCK "recently used" bit */
+	struct pcpage *pp_hashnext;	/* next in hash chain */
+};
+
+#define PAGECACHE_HASHSIZE 64
+
+static struct lock *pagecache_lock;
+static struct cv *pagecache_cv;		/* for waiting on busy pages */
+static struct pcpage *pagecache_pages;	/* array of pagecache_max slots */
+static unsigned pagecache_max;
+static unsigned pagecache_nalloc;	/* slots with pp_data */
+static unsigned pagecache_clockhand;
+static struct pcpage *pagecache_hash[PAGECACHE_HASHSIZE];
+
+/* Counters, for pagecache_printstats */
+static unsigned pagecache_hits;
+static unsigned pagecache_misses;
+static unsigned pagecache_evictions;
+static unsigned pagecache_invalidations;
+static uint64_t pagecache_servedbytes;	/* copied out of cached pages */
+static uint64_t pagecache_readbytes;	/* read from files on misses */
+
+void
+pagecache_bootstrap(void)
+{
+	unsigned i;
+
+	pagecache_max = mainbus_ramsize() / PAGECACHE_RAMFRACTION / PAGE_SIZE;
+	if (pagecache_max < PAGECACHE_MIN) {
+		pagecache_max = PAGECACHE_MIN;
+	}
+
+	pagecache_pages = kmalloc(pagecache_max * sizeof(struct pcpage));
+	if (pagecache_pages == NULL) {
+		panic("pagecache_bootstrap: Out of memory\n");
+	}
+	for (i=0; i<pagecache_max; i++) {
+		pagecache_pages[i].pp_vn = NULL;
+		pagecache_pages[i].pp_index = 0;
+		pagecache_pages[i].pp_data = NULL;
+		pagecache_pages[i].pp_len = 0;
+		pagecache_pages[i].pp_refcount = 0;
+		pagecache_pages[i].pp_busy = false;
+		pagecache_pages[i].pp_stale = false;
+		pagecache_pages[i].pp_referenced = false;
+		pagecache_pages[i].pp_hashnext = NULL;
+	}
+	for (i=0; i<PAGECACHE_HASHSIZE; i++) {
+		pagecache_hash[i] = NULL;
+	}
+	pagecache_nalloc = 0;
+	pagecache_clockhand = 0;
+
+	pagecache_lock = lock_create("pagecache");
+	pagecache_cv = cv_create("pagecache busy");
+	if (pagecache_lock == NULL || pagecache_cv == NULL) {
+		panic("pagecache_bootstrap: Could not create synchronization\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Internal routines; all called with pagecache_lock held.
+
+static
+unsigned
+pagecache_hashfunc(struct vnode *v, uint32_t index)
+{
+	return (((uintptr_t)v >> 4) ^ index) % PAGECACHE_HASHSIZE;
+}
+
+static
+struct pcpage *
+pagecache_lookup(struct vnode *v, uint32_t index)
+{
+	struct pcpage *pp;
+
+	for (pp = pagecache_hash[pagecache_hashfunc(v, index)];
+	     pp != NULL; pp = pp->pp_hashnext) {
+		if (pp->pp_vn == v && pp->pp_index == index) {
+			return pp;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+pagecache_unhash(struct pcpage *pp)
+{
+	struct pcpage **ppp;
+
+	KASSERT(pp->pp_vn != NULL && !pp->pp_stale);
+
+	ppp = &pagecache_hash[pagecache_hashfunc(pp->pp_vn, pp->pp_index)];
+	while (*ppp != pp) {
+		KASSERT(*ppp != NULL);
+		ppp = &(*ppp)->pp_hashnext;
+	}
+	*ppp = pp->pp_hashnext;
+	pp->pp_hashnext = NULL;
+
+	KASSERT(pp->pp_vn->vn_cachedpages > 0);
+	pp->pp_vn->vn_cachedpages--;
+}
+
+/*
+ * Take a page out of the cache. If it's in use, it's freed when
+ * its last user lets go of it.
+ */
+static
+void
+pagecache_drop(struct pcpage *pp)
+{
+	pagecache_unhash(pp);
+	if (pp->pp_refcount > 0) {
+		pp->pp_stale = true;
+	}
+	else {
+		pp->pp_vn = NULL;
+	}
+}
+
+/* Give a free slot's memory back. */
+static
+void
+pagecache_freedata(struct pcpage *pp)
+{
+	KASSERT(pp->pp_vn == NULL && pp->pp_data != NULL);
+
+	kfree(pp->pp_data);
+	pp->pp_data = NULL;
+	pagecache_nalloc--;
+}
+
+/*
+ * Find an unused page that isn't needed: a free one, or, with the
+ * CLOCK algorithm, one nobody has used lately. Returns NULL if every
+ * page with memory is in use.
+ */
+static
+struct pcpage *
+pagecache_victim(void)
+{
+	struct pcpage *pp;
+	unsigned i;
+
+	/* Two trips round, so the first can clear referenced bits */
+	for (i=0; i<2*pagecache_max; i++) {
+		pp = &pagecache_pages[pagecache_clockhand];
+		pagecache_clockhand = (pagecache_clockhand + 1) % pagecache_max;
+
+		if (pp->pp_data == NULL || pp->pp_refcount > 0) {
+			continue;
+		}
+		if (pp->pp_vn == NULL) {
+			return pp;
+		}
+		if (pp->pp_referenced) {
+			pp->pp_referenced = false;
+			continue;
+		}
+		pagecache_drop(pp);
+		pagecache_evictions++;
+		return pp;
+	}
+	return NULL;
+}
+
+/*
+ * Get a free slot with a page of memory. Grow the cache if there's
+ * room and memory to spare; otherwise reuse a page, and, if memory is
+ * short, give another one back as well.
+ */
+static
+struct pcpage *
+pagecache_alloc(void)
+{
+	struct pcpage *pp, *extra;
+	bool lowmem;
+	unsigned i;
+
+	lowmem = vm_freepages() < PAGECACHE_LOWFREE;
+
+	if (!lowmem && pagecache_nalloc < pagecache_max) {
+		for (i=0; i<pagecache_max; i++) {
+			pp = &pagecache_pages[i];
+			if (pp->pp_data == NULL) {
+				KASSERT(pp->pp_vn == NULL);
+				pp->pp_data = kmalloc(PAGE_SIZE);
+				if (pp->pp_data == NULL) {
+					break;
+				}
+				pagecache_nalloc++;
+				return pp;
+			}
+		}
+	}
+
+	pp = pagecache_victim();
+	if (pp != NULL && lowmem) {
+		extra = pagecache_victim();
+		if (extra != NULL && extra != pp) {
+			pagecache_freedata(extra);
+		}
+	}
+	return pp;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Getting and releasing pages
+
+/*
+ * Get page INDEX of V, pinned, reading it from the file if need be.
+ * Sets *HIT to say which.
+ */
+static
+int
+pagecache_get(struct vnode *v, uint32_t index, struct pcpage **ret,
+	      bool *hit)
+{
+	struct pcpage *pp;
+	struct iovec iov;
+	struct uio ku;
+	unsigned h;
+	int result;
+
+	lock_acquire(pagecache_lock);
+	while (1) {
+		pp = pagecache_lookup(v, index);
+		if (pp == NULL) {
+			break;
+		}
+		if (!pp->pp_busy) {
+			pp->pp_refcount++;
+			pp->pp_referenced = true;
+			pagecache_hits++;
+			lock_release(pagecache_lock);
+			*hit = true;
+			*ret = pp;
+			return 0;
+		}
+		/* Someone else is reading it; wait and look again */
+		cv_wait(pagecache_cv, pagecache_lock);
+	}
+
+	pp = pagecache_alloc();
+	if (pp == NULL) {
+		lock_release(pagecache_lock);
+		return ENOMEM;
+	}
+
+	/* Claim the page, so nobody else reads it at the same time */
+	pp->pp_vn = v;
+	pp->pp_index = index;
+	pp->pp_len = 0;
+	pp->pp_refcount = 1;
+	pp->pp_busy = true;
+	pp->pp_stale = false;
+	pp->pp_referenced = false;
+	h = pagecache_hashfunc(v, index);
+	pp->pp_hashnext = pagecache_hash[h];
+	pagecache_hash[h] = pp;
+	v->vn_cachedpages++;
+	pagecache_misses++;
+	lock_release(pagecache_lock);
+
+	uio_kinit(&iov, &ku, pp->pp_data, PAGE_SIZE,
+		  (off_t)index * PAGE_SIZE, UIO_READ);
+	result = VOP_READ(v, &ku);
+
+	lock_acquire(pagecache_lock);
+	pp->pp_busy = false;
+	cv_broadcast(pagecache_cv, pagecache_lock);
+	if (result) {
+		if (!pp->pp_stale) {
+			pagecache_unhash(pp);
+		}
+		pp->pp_refcount--;
+		pp->pp_stale = false;
+		pp->pp_vn = NULL;
+		lock_release(pagecache_lock);
+		return result;
+	}
+	pp->pp_len = PAGE_SIZE - ku.uio_resid;
+	pagecache_readbytes += pp->pp_len;
+	lock_release(pagecache_lock);
+
+	*hit = false;
+	*ret = pp;
+	return 0;
+}
+
+/* Unpin a page, after copying SERVED bytes out of it. */
+static
+void
+pagecache_release(struct pcpage *pp, size_t served, bool hit)
+{
+	lock_acquire(pagecache_lock);
+	KASSERT(pp->pp_refcount > 0);
+	pp->pp_refcount--;
+	if (hit) {
+		pagecache_servedbytes += served;
+	}
+	if (pp->pp_refcount == 0 && pp->pp_stale) {
+		pp->pp_stale = false;
+		pp->pp_vn = NULL;
+	}
+	lock_release(pagecache_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// External interface
+
+int
+pagecache_read(struct vnode *v, struct uio *uio)
+{
+	struct pcpage *pp;
+	uint32_t index;
+	size_t delta, amt;
+	bool hit;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	/* Devices aren't files; don't cache them */
+	if (v->vn_fs == NULL) {
+		return VOP_READ(v, uio);
+	}
+
+	while (uio->uio_resid > 0) {
+		index = uio->uio_offset / PAGE_SIZE;
+		delta = uio->uio_offset % PAGE_SIZE;
+
+		result = pagecache_get(v, index, &pp, &hit);
+		if (result == ENOMEM) {
+			/* Every page is in use; read the rest directly */
+			return VOP_READ(v, uio);
+		}
+		if (result) {
+			return result;
+		}
+
+		if (delta >= pp->pp_len) {
+			/* EOF */
+			pagecache_release(pp, 0, hit);
+			break;
+		}
+
+		amt = pp->pp_len - delta;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(pp->pp_data + delta, amt, uio);
+		pagecache_release(pp, amt, hit);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+void
+pagecache_invalidate(struct vnode *v)
+{
+	struct pcpage *pp;
+	unsigned i;
+
+	/* No need to lock for devices (such as the console), never cached */
+	if (v->vn_fs == NULL) {
+		return;
+	}
+
+	/*
+	 * Nor for files with nothing cached, which is nearly every write.
+	 * A read caching a page right after this looks is no different
+	 * from one that happened just after we took the lock and dropped
+	 * the file's pages.
+	 */
+	if (v->vn_cachedpages == 0) {
+		return;
+	}
+
+	lock_acquire(pagecache_lock);
+	if (v->vn_cachedpages > 0) {
+		pagecache_invalidations++;
+		for (i=0; i<pagecache_max && v->vn_cachedpages > 0; i++) {
+			pp = &pagecache_pages[i];
+			if (pp->pp_vn == v && !pp->pp_stale) {
+				pagecache_drop(pp);
+			}
+		}
+	}
+	KASSERT(v->vn_cachedpages == 0);
+	lock_release(pagecache_lock);
+}
+
+unsigned
+pagecache_shrink(void)
+{
+	struct pcpage *pp;
+	unsigned i, freed;
+
+	/* (not during boot, before pagecache_bootstrap, either) */
+	if (pagecache_lock == NULL || curthread->t_in_interrupt ||
+	    !lock_tryacquire(pagecache_lock)) {
+		return 0;
+	}
+
+	freed = 0;
+	for (i=0; i<pagecache_max; i++) {
+		pp = &pagecache_pages[i];
+		if (pp->pp_data == NULL || pp->pp_refcount > 0) {
+			continue;
+		}
+		if (pp->pp_vn != NULL) {
+			pagecache_drop(pp);
+			pagecache_evictions++;
+		}
+		pagecache_freedata(pp);
+		freed++;
+	}
+
+	lock_release(pagecache_lock);
+	return freed;
+}
+
+void
+pagecache_printstats(void)
+{
+	unsigned i, inuse;
+
+	lock_acquire(pagecache_lock);
+	inuse = 0;
+	for (i=0; i<pagecache_max; i++) {
+		if (pagecache_pages[i].pp_vn != NULL) {
+			inuse++;
+		}
+	}
+	kprintf("Exec page cache: room for %u pages, %u allocated, "
+		"%u in use\n", pagecache_max, pagecache_nalloc, inuse);
+	kprintf("  %u hits, %u misses, %u evictions, %u invalidations\n",
+		pagecache_hits, pagecache_misses, pagecache_evictions,
+		pagecache_invalidations);
+	kprintf("  %llu bytes served from the cache, %llu read from files\n",
+		(unsigned long long)pagecache_servedbytes,
+		(unsigned long long)pagecache_readbytes);
+	lock_release(pagecache_lock);
+}
@@ -50,6 +50,15 @@ int __vprintf(void (*sendfunc)(void *clientdata, const char *, size_t len),
 	      const char *fmt,
 	      __va_list ap);
 
+/*
+ * Buffered standard output, used by printf, puts, and putchar.
+ * __stdout_putc queues a character; __stdout_flush writes out the
+ * queue. Both return 0, or EOF on error.
+ * (for libc internal use only)
+ */
+int __stdout_putc(int ch);
+int __stdout_flush(void);
+
 /* Printf calls for user programs */
 int printf(const char *fmt, ...);
 int vprintf(const char *fmt, __va_list ap);
@@ -0,0 +1,18 @@
+#ifndef _SYS_UIO_H_
+#define _SYS_UIO_H_
+
+/*
+ * Get size_t and struct iovec
+ */
+#include <sys/types.h>
+#include <kern/iovec.h>
+
+/*
+ * Scatter/gather I/O: readv and writev transfer the IOVCNT buffers in IOV,
+ * in order, as a single read or write at the handle's seek position.
+ * IOVCNT may be at most IOV_MAX.
+ */
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+
+#endif /* _SYS_UIO_H_ */
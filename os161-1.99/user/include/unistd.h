@@ -147,12 +147,32 @@ int chdir(const char *path);
 
 /* Optional. */
 void *sbrk(int change);
+/*
+ * vfork: like fork, but the child runs on the parent's address space (and
+ * stack) and the parent is suspended until the child calls execv or _exit.
+ * The child must not return from the function that called vfork.
+ */
+pid_t vfork(void);
 int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+/*
+ * pread/pwrite: read/write at an explicit file position, without using
+ * or moving the handle's seek pointer. readv/writev - see sys/uio.h
+ */
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+/*
+ * nanosleep: sleep for the time in REQ (REM is never written, since
+ * nothing can interrupt the sleep). clock_gettime: read CLOCK_REALTIME
+ * (the time of day) or CLOCK_MONOTONIC (the time since boot), which
+ * are defined in kern/time.h.
+ */
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int clock_gettime(int clockid, struct timespec *ts);
 int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
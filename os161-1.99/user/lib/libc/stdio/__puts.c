@@ -41,9 +41,10 @@ __puts(const char *str)
 {
 	int count=0;
 	while (*str) {
-		putchar(*str);
+		__stdout_putc(*str);
 		str++;
 		count++;
 	}
+	__stdout_flush();
 	return count;
 }
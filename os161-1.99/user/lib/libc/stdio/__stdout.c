@@ -0,0 +1,58 @@
+/*
+ * Buffering for standard output.
+ *
+ * The stdio output functions hand their characters to __stdout_putc,
+ * which collects them here and passes them to write() a line at a time
+ * (or a buffer at a time, for very long lines), instead of making one
+ * system call per character. Each of those functions calls
+ * __stdout_flush before it returns, so nothing is ever left in the
+ * buffer between calls. That matters here: there is no atexit/exit
+ * flush hook in this libc, many programs leave with _exit, and a
+ * process that prints and then forks would otherwise hand a copy of
+ * its pending output to the child.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define STDOUT_BUFSIZE 256
+
+static char stdout_buf[STDOUT_BUFSIZE];
+static size_t stdout_len;
+
+/*
+ * Write out whatever is buffered. Returns 0, or EOF on error, in which
+ * case the buffered output is discarded.
+ */
+int
+__stdout_flush(void)
+{
+	size_t done = 0;
+	ssize_t len;
+
+	while (done < stdout_len) {
+		len = write(STDOUT_FILENO, stdout_buf + done,
+			    stdout_len - done);
+		if (len <= 0) {
+			stdout_len = 0;
+			return EOF;
+		}
+		done += len;
+	}
+	stdout_len = 0;
+	return 0;
+}
+
+/*
+ * Add a character to the buffer, flushing at end of line or when the
+ * buffer fills. Returns 0, or EOF on error.
+ */
+int
+__stdout_putc(int ch)
+{
+	stdout_buf[stdout_len++] = ch;
+	if (ch == '\n' || stdout_len == STDOUT_BUFSIZE) {
+		return __stdout_flush();
+	}
+	return 0;
+}
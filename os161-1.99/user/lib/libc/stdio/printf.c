@@ -46,7 +46,7 @@ __printf_send(void *mydata, const char *data, size_t len)
 	(void)mydata;  /* not needed */
 
 	for (i=0; i<len; i++) {
-		putchar(data[i]);
+		__stdout_putc(data[i]);
 	}
 }
 
@@ -66,5 +66,9 @@ printf(const char *fmt, ...)
 int
 vprintf(const char *fmt, va_list ap)
 {
-	return __vprintf(__printf_send, NULL, fmt, ap);
+	int chars;
+
+	chars = __vprintf(__printf_send, NULL, fmt, ap);
+	__stdout_flush();
+	return chars;
 }
@@ -28,22 +28,19 @@
  */
 
 #include <stdio.h>
-#include <unistd.h>
 
 /*
  * C standard function - print a single character.
  *
- * Properly, stdio is supposed to be buffered, but for present purposes
- * writing that code is not really worthwhile.
+ * This goes through the stdout buffer (see __stdout.c) like the rest of
+ * stdio, but the buffer is flushed before returning, so a lone putchar
+ * is still a single one-byte write.
  */
 
 int
 putchar(int ch)
 {
-	char c = ch;
-	int len;
-	len = write(STDOUT_FILENO, &c, 1);
-	if (len<=0) {
+	if (__stdout_putc(ch) || __stdout_flush()) {
 		return EOF;
 	}
 	return ch;
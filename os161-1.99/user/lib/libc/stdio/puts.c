@@ -36,7 +36,10 @@
 int
 puts(const char *s)
 {
-	__puts(s);
-	putchar('\n');
-	return 0;
+	while (*s) {
+		__stdout_putc(*s);
+		s++;
+	}
+	__stdout_putc('\n');
+	return __stdout_flush();
 }
@@ -65,6 +65,10 @@ dumpsb(void)
 	if (SWAPL(sp.sp_magic) != SFS_MAGIC) {
 		errx(1, "Not an sfs filesystem");
 	}
+	if (SWAPL(sp.sp_version) != SFS_VERSION) {
+		errx(1, "Filesystem has format version %u, not %u",
+		     SWAPL(sp.sp_version), SFS_VERSION);
+	}
 	sp.sp_volname[sizeof(sp.sp_volname)-1] = 0;
 	printf("Volume name: %-40s  %u blocks\n", sp.sp_volname, 
 	       SWAPL(sp.sp_nblocks));
@@ -72,6 +76,76 @@ dumpsb(void)
 	return SWAPL(sp.sp_nblocks);
 }
 
+/*
+ * Find entry OFFSET of the indirect tree whose top block is IBLOCK,
+ * where each entry of the top block covers SPAN file blocks.
+ */
+static
+uint32_t
+ibmap(uint32_t iblock, uint32_t offset, uint32_t span)
+{
+	uint32_t ib[SFS_DBPERIDB];
+
+	if (iblock == 0) {
+		return 0;
+	}
+	diskread(&ib, iblock);
+	if (span > 1) {
+		return ibmap(SWAPL(ib[offset / span]), offset % span,
+			     span / SFS_DBPERIDB);
+	}
+	return SWAPL(ib[offset]);
+}
+
+/* Disk block of block FILEBLOCK of a file, or 0 if there is none */
+static
+uint32_t
+dobmap(const struct sfs_inode *sfi, uint32_t fileblock)
+{
+	uint32_t i, first, len;
+
+	for (i=0; i<SWAPL(sfi->sfi_nextents) && i<SFS_NEXTENTS; i++) {
+		first = SWAPL(sfi->sfi_extents[i].se_fileblock);
+		len = SWAPL(sfi->sfi_extents[i].se_nblocks);
+		if (fileblock >= first && fileblock < first + len) {
+			return SWAPL(sfi->sfi_extents[i].se_diskblock) +
+				(fileblock - first);
+		}
+	}
+
+	if (fileblock < SFS_DIDBASE) {
+		return ibmap(SWAPL(sfi->sfi_indirect), fileblock, 1);
+	}
+	else if (fileblock < SFS_TIDBASE) {
+		return ibmap(SWAPL(sfi->sfi_dindirect),
+			     fileblock - SFS_DIDBASE, SFS_DBPERIDB);
+	}
+	else if (fileblock < SFS_MAXFILEBLOCKS) {
+		return ibmap(SWAPL(sfi->sfi_tindirect),
+			     fileblock - SFS_TIDBASE,
+			     SFS_DBPERIDB*SFS_DBPERIDB);
+	}
+	return 0;
+}
+
+/* Print a one-line summary of where a file's blocks are */
+static
+void
+dumpmap(uint32_t ino)
+{
+	struct sfs_inode sfi;
+
+	diskread(&sfi, ino);
+	printf("[%s, %u bytes, %u extents",
+	       SWAPS(sfi.sfi_type) == SFS_TYPE_DIR ? "dir" : "file",
+	       SWAPL(sfi.sfi_size), SWAPL(sfi.sfi_nextents));
+	if (sfi.sfi_indirect || sfi.sfi_dindirect || sfi.sfi_tindirect) {
+		printf(", indirect %u/%u/%u", SWAPL(sfi.sfi_indirect),
+		       SWAPL(sfi.sfi_dindirect), SWAPL(sfi.sfi_tindirect));
+	}
+	printf("]");
+}
+
 static
 void
 dodirblock(uint32_t block)
@@ -90,7 +164,9 @@ dodirblock(uint32_t block)
 		}
 		else {
 			sds[i].sfd_name[SFS_NAMELEN-1] = 0; /* just in case */
-			printf("        %u %s\n", ino, sds[i].sfd_name);
+			printf("        %u %s ", ino, sds[i].sfd_name);
+			dumpmap(ino);
+			printf("\n");
 		}
 	}
 }
@@ -100,9 +176,8 @@ void
 dumpdir(uint32_t ino)
 {
 	struct sfs_inode sfi;
-	uint32_t ib[SFS_DBPERIDB];
-	int nentries, i;
-	uint32_t block, nblocks=0;
+	int nentries;
+	uint32_t i, block, nblocks=0, fileblocks;
 
 	diskread(&sfi, ino);
 
@@ -112,23 +187,22 @@ dumpdir(uint32_t ino)
 	}
 	printf("Directory %u: %d entries\n", ino, nentries);
 
-	for (i=0; i<SFS_NDIRECT; i++) {
-		block = SWAPL(sfi.sfi_direct[i]);
+	for (i=0; i<SWAPL(sfi.sfi_nextents) && i<SFS_NEXTENTS; i++) {
+		printf("    extent: blocks %u+%u at %u\n",
+		       SWAPL(sfi.sfi_extents[i].se_fileblock),
+		       SWAPL(sfi.sfi_extents[i].se_nblocks),
+		       SWAPL(sfi.sfi_extents[i].se_diskblock));
+	}
+
+	fileblocks = SFS_ROUNDUP(SWAPL(sfi.sfi_size), SFS_BLOCKSIZE)
+		/ SFS_BLOCKSIZE;
+	for (i=0; i<fileblocks; i++) {
+		block = dobmap(&sfi, i);
 		if (block) {
 			dodirblock(block);
 			nblocks++;
 		}
 	}
-	if (SWAPL(sfi.sfi_indirect)) {
-		diskread(&ib, SWAPL(sfi.sfi_indirect));
-		for (i=0; i<SFS_DBPERIDB; i++) {
-			block = SWAPL(ib[i]);
-			if (block) {
-				dodirblock(block);
-				nblocks++;
-			}
-		}
-	}
 	printf("    %u blocks in directory\n", nblocks);
 }
 
@@ -81,6 +81,7 @@ writesuper(const char *volname, uint32_t nblocks)
 	sp.sp_magic = SWAPL(SFS_MAGIC);
 	sp.sp_nblocks = SWAPL(nblocks);
 	strcpy(sp.sp_volname, volname);
+	sp.sp_version = SWAPL(SFS_VERSION);
 
 	diskwrite(&sp, SFS_SB_LOCATION);
 }
@@ -83,6 +83,7 @@ swapsb(struct sfs_super *sp)
 {
 	sp->sp_magic = SWAPL(sp->sp_magic);
 	sp->sp_nblocks = SWAPL(sp->sp_nblocks);
+	sp->sp_version = SWAPL(sp->sp_version);
 }
 
 static
@@ -94,38 +95,19 @@ swapinode(struct sfs_inode *sfi)
 	sfi->sfi_size = SWAPL(sfi->sfi_size);
 	sfi->sfi_type = SWAPS(sfi->sfi_type);
 	sfi->sfi_linkcount = SWAPS(sfi->sfi_linkcount);
+	sfi->sfi_nextents = SWAPL(sfi->sfi_nextents);
 
-	for (i=0; i<SFS_NDIRECT; i++) {
-		sfi->sfi_direct[i] = SWAPL(sfi->sfi_direct[i]);
-	}
+	for (i=0; i<SFS_NEXTENTS; i++) {
+		struct sfs_extent *se = &sfi->sfi_extents[i];
 
-#ifdef SFS_NIDIRECT
-	for (i=0; i<SFS_NIDIRECT; i++) {
-		sfi->sfi_indirect[i] = SWAPL(sfi->sfi_indirect[i]);
+		se->se_fileblock = SWAPL(se->se_fileblock);
+		se->se_diskblock = SWAPL(se->se_diskblock);
+		se->se_nblocks = SWAPL(se->se_nblocks);
 	}
-#else
-	sfi->sfi_indirect = SWAPL(sfi->sfi_indirect);
-#endif
 
-#ifdef SFS_NDIDIRECT
-	for (i=0; i<SFS_NDIDIRECT; i++) {
-		sfi->sfi_dindirect[i] = SWAPL(sfi->sfi_dindirect[i]);
-	}
-#else
-#ifdef HAS_DIDIRECT
+	sfi->sfi_indirect = SWAPL(sfi->sfi_indirect);
 	sfi->sfi_dindirect = SWAPL(sfi->sfi_dindirect);
-#endif
-#endif
-
-#ifdef SFS_NTIDIRECT
-	for (i=0; i<SFS_NTIDIRECT; i++) {
-		sfi->sfi_tindirect[i] = SWAPL(sfi->sfi_tindirect[i]);
-	}
-#else
-#ifdef HAS_TIDIRECT
 	sfi->sfi_tindirect = SWAPL(sfi->sfi_tindirect);
-#endif
-#endif
 }
 
 static
@@ -521,6 +503,11 @@ check_sb(void)
 	if (sp.sp_magic != SFS_MAGIC) {
 		errx(EXIT_UNRECOV, "Not an sfs filesystem");
 	}
+	if (sp.sp_version != SFS_VERSION) {
+		errx(EXIT_UNRECOV, "Filesystem has format version %lu, not %lu",
+		     (unsigned long) sp.sp_version,
+		     (unsigned long) SFS_VERSION);
+	}
 
 	assert(nblocks==0);
 	assert(bitblocks==0);
@@ -558,149 +545,236 @@ check_sb(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Disk block of FILEBLOCK according to the extents of SFI, or 0 if no
+ * extent maps it.
+ */
+static
+uint32_t
+extent_bmap(const struct sfs_inode *sfi, uint32_t fileblock)
+{
+	const struct sfs_extent *se;
+	uint32_t i;
+
+	for (i=0; i<sfi->sfi_nextents && i<SFS_NEXTENTS; i++) {
+		se = &sfi->sfi_extents[i];
+		if (fileblock >= se->se_fileblock &&
+		    fileblock - se->se_fileblock < se->se_nblocks) {
+			return se->se_diskblock + (fileblock - se->se_fileblock);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Check the indirect block *IENTRY, whose entries each cover SPAN file
+ * blocks starting at file block BASE, and everything under it. Blocks
+ * past EOF (file block FILEBLOCKS) and blocks an extent already maps
+ * are removed; they count in *BADCOUNTP and *DUPCOUNTP respectively.
+ * If nothing is left under it, the indirect block goes too.
+ */
 static
 void
-check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
-		     uint32_t nblocks, uint32_t *badcountp, 
-		     int isdir, int indirection)
+check_indirect_block(uint32_t ino, const struct sfs_inode *sfi,
+		     uint32_t *ientry, uint32_t base, uint32_t span,
+		     uint32_t fileblocks, uint32_t *badcountp,
+		     uint32_t *dupcountp, int isdir)
 {
 	uint32_t entries[SFS_DBPERIDB];
-	uint32_t i, ct;
+	uint32_t i, ct, fileblock;
+	int changed = 0;
 
-	if (*ientry !=0) {
-		diskread(entries, *ientry);
-		swapindir(entries);
-		bitmap_mark(*ientry, B_IBLOCK, ino);
-	}
-	else {
-		for (i=0; i<SFS_DBPERIDB; i++) {
-			entries[i] = 0;
-		}
+	if (*ientry == 0) {
+		return;
 	}
 
-	if (indirection > 1) {
-		for (i=0; i<SFS_DBPERIDB; i++) {
-			check_indirect_block(ino, &entries[i], 
-					     blockp, nblocks, 
-					     badcountp,
-					     isdir,
-					     indirection-1);
+	diskread(entries, *ientry);
+	swapindir(entries);
+
+	for (i=0; i<SFS_DBPERIDB; i++) {
+		if (entries[i] == 0) {
+			continue;
 		}
-	}
-	else {
-		assert(indirection==1);
-
-		for (i=0; i<SFS_DBPERIDB; i++) {
-			if (*blockp < nblocks) {
-				if (entries[i] != 0) {
-					bitmap_mark(entries[i],
-						    isdir ? B_DIRDATA : B_DATA,
-						    ino);
-				}
-			}
-			else {
-				if (entries[i] != 0) {
-					(*badcountp)++;
-					bitmap_mark(entries[i],
-						    isdir ? B_DIRDATA : B_DATA,
-						    ino);
-					entries[i] = 0;
-				}
+		fileblock = base + i*span;
+
+		if (span > 1) {
+			uint32_t old = entries[i];
+
+			check_indirect_block(ino, sfi, &entries[i],
+					     fileblock, span/SFS_DBPERIDB,
+					     fileblocks, badcountp, dupcountp,
+					     isdir);
+			if (entries[i] != old) {
+				changed = 1;
 			}
-			(*blockp)++;
+		}
+		else if (fileblock >= fileblocks) {
+			(*badcountp)++;
+			bitmap_mark(entries[i], B_TOFREE, 0);
+			entries[i] = 0;
+			changed = 1;
+		}
+		else if (extent_bmap(sfi, fileblock) != 0) {
+			(*dupcountp)++;
+			bitmap_mark(entries[i], B_TOFREE, 0);
+			entries[i] = 0;
+			changed = 1;
+		}
+		else {
+			bitmap_mark(entries[i],
+				    isdir ? B_DIRDATA : B_DATA, ino);
 		}
 	}
 
-	ct=0;
 	for (i=ct=0; i<SFS_DBPERIDB; i++) {
 		if (entries[i]!=0) ct++;
 	}
 	if (ct==0) {
-		if (*ientry != 0) {
-			(*badcountp)++;
-			bitmap_mark(*ientry, B_TOFREE, 0);
-			*ientry = 0;
-		}
+		(*badcountp)++;
+		bitmap_mark(*ientry, B_TOFREE, 0);
+		*ientry = 0;
 	}
 	else {
-		assert(*ientry != 0);
-		if (*badcountp > 0) {
+		bitmap_mark(*ientry, B_IBLOCK, ino);
+		if (changed) {
 			swapindir(entries);
 			diskwrite(entries, *ientry);
 		}
 	}
 }
 
-/* returns nonzero if inode modified */
+/*
+ * Check the extents of an inode. Extents that make no sense (empty,
+ * off the disk, or out of order with or overlapping the one before)
+ * are dropped without touching the blocks they name; those past EOF
+ * are dropped or cut short and their blocks freed. Returns nonzero if
+ * the inode was modified.
+ */
 static
 int
-check_inode_blocks(uint32_t ino, struct sfs_inode *sfi, int isdir)
+check_extents(uint32_t ino, struct sfs_inode *sfi, uint32_t fileblocks,
+	      uint32_t *badcountp, int isdir)
 {
-	uint32_t size, block, nblocks, badcount;
-
-	badcount = 0;
+	struct sfs_extent se;
+	uint32_t i, j, k, n, keep, nextfree;
+	int changed = 0;
+
+	n = sfi->sfi_nextents;
+	if (n > SFS_NEXTENTS) {
+		warnx("Inode %lu: extent count %lu too large (fixed)",
+		      (unsigned long) ino, (unsigned long) n);
+		setbadness(EXIT_RECOV);
+		n = SFS_NEXTENTS;
+		changed = 1;
+	}
+
+	/* First file block an extent may start at */
+	nextfree = 0;
+
+	for (i=j=0; i<n; i++) {
+		se = sfi->sfi_extents[i];
+
+		if (se.se_nblocks == 0 ||
+		    se.se_fileblock < nextfree ||
+		    se.se_fileblock >= SFS_MAXFILEBLOCKS ||
+		    se.se_nblocks > SFS_MAXFILEBLOCKS - se.se_fileblock ||
+		    se.se_diskblock == 0 ||
+		    se.se_diskblock >= nblocks ||
+		    se.se_nblocks > nblocks - se.se_diskblock) {
+			warnx("Inode %lu: invalid extent %lu "
+			      "(file blocks %lu+%lu at %lu) (removed)",
+			      (unsigned long) ino, (unsigned long) i,
+			      (unsigned long) se.se_fileblock,
+			      (unsigned long) se.se_nblocks,
+			      (unsigned long) se.se_diskblock);
+			setbadness(EXIT_RECOV);
+			changed = 1;
+			continue;
+		}
 
-	size = SFS_ROUNDUP(sfi->sfi_size, SFS_BLOCKSIZE);
-	nblocks = size/SFS_BLOCKSIZE;
+		keep = se.se_nblocks;
+		if (se.se_fileblock >= fileblocks) {
+			keep = 0;
+		}
+		else if (se.se_nblocks > fileblocks - se.se_fileblock) {
+			keep = fileblocks - se.se_fileblock;
+		}
 
-	for (block=0; block<SFS_NDIRECT; block++) {
-		if (block < nblocks) {
-			if (sfi->sfi_direct[block] != 0) {
-				bitmap_mark(sfi->sfi_direct[block],
+		for (k=0; k<se.se_nblocks; k++) {
+			if (k < keep) {
+				bitmap_mark(se.se_diskblock + k,
 					    isdir ? B_DIRDATA : B_DATA, ino);
 			}
+			else {
+				(*badcountp)++;
+				bitmap_mark(se.se_diskblock + k, B_TOFREE, 0);
+			}
 		}
-		else {
-			if (sfi->sfi_direct[block] != 0) {
-				badcount++;
-				bitmap_mark(sfi->sfi_direct[block],
-					    B_TOFREE, 0);
-			}			
+		if (keep < se.se_nblocks) {
+			changed = 1;
+		}
+		if (keep == 0) {
+			continue;
 		}
-	}
 
-#ifdef SFS_NIDIRECT
-	for (i=0; i<SFS_NIDIRECT; i++) {
-		check_indirect_block(ino, &sfi->sfi_indirect[i], 
-				     &block, nblocks, &badcount, isdir, 1);
+		se.se_nblocks = keep;
+		nextfree = se.se_fileblock + se.se_nblocks;
+		if (i != j) {
+			changed = 1;
+		}
+		sfi->sfi_extents[j++] = se;
 	}
-#else
-	check_indirect_block(ino, &sfi->sfi_indirect, 
-			     &block, nblocks, &badcount, isdir, 1);
-#endif
 
-#ifdef SFS_NDIDIRECT
-	for (i=0; i<SFS_NDIDIRECT; i++) {
-		check_indirect_block(ino, &sfi->sfi_dindirect[i], 
-				     &block, nblocks, &badcount, isdir, 2);
+	if (changed) {
+		for (i=j; i<SFS_NEXTENTS; i++) {
+			bzero(&sfi->sfi_extents[i], sizeof(sfi->sfi_extents[i]));
+		}
+		sfi->sfi_nextents = j;
 	}
-#else
-#ifdef HAS_DIDIRECT
-	check_indirect_block(ino, &sfi->sfi_dindirect, 
-			     &block, nblocks, &badcount, isdir, 2);
-#endif
-#endif
+	return changed;
+}
 
-#ifdef SFS_NTIDIRECT
-	for (i=0; i<SFS_NTIDIRECT; i++) {
-		check_indirect_block(ino, &sfi->sfi_tindirect[i], 
-				     &block, nblocks, &badcount, isdir, 3);
-	}
-#else
-#ifdef HAS_TIDIRECT
-	check_indirect_block(ino, &sfi->sfi_tindirect, 
-			     &block, nblocks, &badcount, isdir, 3);
-#endif
-#endif
+/* returns nonzero if inode modified */
+static
+int
+check_inode_blocks(uint32_t ino, struct sfs_inode *sfi, int isdir)
+{
+	uint32_t size, fileblocks, badcount, dupcount;
+	int changed;
+
+	badcount = 0;
+	dupcount = 0;
 
+	size = SFS_ROUNDUP(sfi->sfi_size, SFS_BLOCKSIZE);
+	fileblocks = size/SFS_BLOCKSIZE;
+
+	changed = check_extents(ino, sfi, fileblocks, &badcount, isdir);
+
+	check_indirect_block(ino, sfi, &sfi->sfi_indirect,
+			     0, 1,
+			     fileblocks, &badcount, &dupcount, isdir);
+	check_indirect_block(ino, sfi, &sfi->sfi_dindirect,
+			     SFS_DIDBASE, SFS_DBPERIDB,
+			     fileblocks, &badcount, &dupcount, isdir);
+	check_indirect_block(ino, sfi, &sfi->sfi_tindirect,
+			     SFS_TIDBASE, SFS_DBPERIDB*SFS_DBPERIDB,
+			     fileblocks, &badcount, &dupcount, isdir);
+
+	if (dupcount > 0) {
+		warnx("Inode %lu: %lu blocks mapped by both an extent and "
+		      "an indirect block (indirect entries removed)",
+		      (unsigned long) ino, (unsigned long) dupcount);
+		setbadness(EXIT_RECOV);
+		changed = 1;
+	}
 	if (badcount > 0) {
 		warnx("Inode %lu: %lu blocks after EOF (freed)", 
 		     (unsigned long) ino, (unsigned long) badcount);
 		setbadness(EXIT_RECOV);
-		return 1;
+		changed = 1;
 	}
 
-	return 0;
+	return changed;
 }
 
 ////////////////////////////////////////////////////////////
@@ -729,76 +803,27 @@ ibmap(uint32_t iblock, uint32_t offset, uint32_t entrysize)
 	}
 }
 
-#define BMAP_ND   		SFS_NDIRECT
-#define BMAP_D(sfi, x)		((sfi)->sfi_direct[(x)])
-
-#ifdef SFS_NIDIRECT
-#define BMAP_NI			SFS_NIDIRECT
-#define BMAP_I(sfi, x)		((sfi)->sfi_indirect[(x)])
-#else
-#define BMAP_NI			1
-#define BMAP_I(sfi, x)		((void)(x), (sfi)->sfi_indirect)
-#endif
-
-#ifdef SFS_NDIDIRECT
-#define BMAP_NII		SFS_NDIDIRECT
-#define BMAP_II(sfi, x)		((sfi)->sfi_dindirect[(x)])
-#else
-#ifdef HAS_DIDIRECT
-#define BMAP_NII		1
-#define BMAP_II(sfi, x)		((void)(x), (sfi)->sfi_dindirect)
-#else
-#define BMAP_NII		0
-#define BMAP_II(sfi, x)		((void)(x), (void)(sfi), 0)
-#endif
-#endif
-
-#ifdef SFS_NTIDIRECT
-#define BMAP_NIII		SFS_NTIDIRECT
-#define BMAP_III(sfi, x)	((sfi)->sfi_tindirect[(x)])
-#else
-#ifdef HAS_TIDIRECT
-#define BMAP_NIII		1
-#define BMAP_III(sfi, x)	((void)(x), (sfi)->sfi_tindirect)
-#else
-#define BMAP_NIII		0
-#define BMAP_III(sfi, x)	((void)(x), (void)(sfi), 0)
-#endif
-#endif
-
-#define BMAP_DMAX   BMAP_ND
-#define BMAP_IMAX   (BMAP_DMAX+SFS_DBPERIDB*BMAP_NI)
-#define BMAP_IIMAX  (BMAP_IMAX+SFS_DBPERIDB*BMAP_NII)
-#define BMAP_IIIMAX (BMAP_IIMAX+SFS_DBPERIDB*BMAP_NIII)
-
-#define BMAP_DSIZE	1
-#define BMAP_ISIZE	(BMAP_DSIZE*SFS_DBPERIDB)
-#define BMAP_IISIZE	(BMAP_ISIZE*SFS_DBPERIDB)
-#define BMAP_IIISIZE	(BMAP_IISIZE*SFS_DBPERIDB)
-
 static
 uint32_t
 dobmap(const struct sfs_inode *sfi, uint32_t fileblock)
 {
-	uint32_t iblock, offset;
+	uint32_t block;
 
-	if (fileblock < BMAP_DMAX) {
-		return BMAP_D(sfi, fileblock);
+	block = extent_bmap(sfi, fileblock);
+	if (block != 0) {
+		return block;
 	}
-	else if (fileblock < BMAP_IMAX) {
-		iblock = (fileblock - BMAP_DMAX)/BMAP_ISIZE;
-		offset = (fileblock - BMAP_DMAX)%BMAP_ISIZE;
-		return ibmap(BMAP_I(sfi, iblock), offset, BMAP_DSIZE);
+
+	if (fileblock < SFS_DIDBASE) {
+		return ibmap(sfi->sfi_indirect, fileblock, 1);
 	}
-	else if (fileblock < BMAP_IIMAX) {
-		iblock = (fileblock - BMAP_IMAX)/BMAP_IISIZE;
-		offset = (fileblock - BMAP_IMAX)%BMAP_IISIZE;
-		return ibmap(BMAP_II(sfi, iblock), offset, BMAP_ISIZE);
+	else if (fileblock < SFS_TIDBASE) {
+		return ibmap(sfi->sfi_dindirect, fileblock - SFS_DIDBASE,
+			     SFS_DBPERIDB);
 	}
-	else if (fileblock < BMAP_IIIMAX) {
-		iblock = (fileblock - BMAP_IIMAX)/BMAP_IIISIZE;
-		offset = (fileblock - BMAP_IIMAX)%BMAP_IIISIZE;
-		return ibmap(BMAP_III(sfi, iblock), offset, BMAP_IISIZE);
+	else if (fileblock < SFS_MAXFILEBLOCKS) {
+		return ibmap(sfi->sfi_tindirect, fileblock - SFS_TIDBASE,
+			     SFS_DBPERIDB*SFS_DBPERIDB);
 	}
 	return 0;
 }
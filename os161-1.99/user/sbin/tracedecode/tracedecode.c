@@ -0,0 +1,565 @@
+/*
+ * tracedecode - print the kernel trace written by the "trdump" menu
+ * command as a timeline, or summarize it.
+ *
+ * Usage: tracedecode [-s] tracefile
+ *        tracedecode -l [-s] sys161-output
+ *
+ * With -s, instead of the timeline print per-event counts and the
+ * latencies of system calls and disk requests, matched up by thread
+ * (for system calls) and by sector (for the disk).
+ *
+ * With -l, read the output of System/161 captured while the kernel
+ * was tracing with "tron -l", which has each record as three ltrace
+ * debug codes, instead of a trace file. Those records have no times
+ * or threads, so only the order of events can be shown.
+ *
+ * The file format and event codes are in <kern/trace.h>. Trace files
+ * are in the kernel's (big-endian) byte order.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#include "kern/trace.h"
+
+#ifdef HOST
+
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#include "hostcompat.h"
+#define SWAPL(x) ntohl(x)
+#define SWAPS(x) ntohs(x)
+
+#else
+
+#define SWAPL(x) (x)
+#define SWAPS(x) (x)
+
+#endif
+
+/* From the kernel's <vm.h> and <thread.h> */
+static const char *const faulttypes[] = { "read", "write", "readonly" };
+static const char *const threadstates[] = {
+	"run", "ready", "sleep", "zombie"
+};
+
+static const char *const eventnames[TP_NEVENTS] = {
+	"?", "syscall", "sysret", "fault", "switch", "lock",
+	"disk", "diskdone",
+};
+
+/* System calls the kernel implements, by number (<kern/syscall.h>) */
+static const struct {
+	unsigned num;
+	const char *name;
+} syscalls[] = {
+	{ 0, "fork" }, { 1, "vfork" }, { 2, "execv" }, { 3, "_exit" },
+	{ 4, "waitpid" }, { 5, "getpid" }, { 45, "open" }, { 48, "dup2" },
+	{ 49, "close" }, { 50, "read" }, { 51, "pread" }, { 52, "readv" },
+	{ 55, "write" }, { 56, "pwrite" }, { 57, "writev" }, { 59, "lseek" },
+	{ 113, "__time" }, { 119, "reboot" },
+};
+#define NSYSCALLS (sizeof(syscalls) / sizeof(syscalls[0]))
+
+static
+const char *
+syscallname(unsigned num)
+{
+	static char buf[16];
+	unsigned i;
+
+	for (i=0; i<NSYSCALLS; i++) {
+		if (syscalls[i].num == num) {
+			return syscalls[i].name;
+		}
+	}
+	snprintf(buf, sizeof(buf), "#%u", num);
+	return buf;
+}
+
+////////////////////////////////////////////////////////////
+// reading
+
+static struct trace_record *records;
+static unsigned nrecords;
+static int timed;	/* records have times and threads */
+
+static
+void
+addrecord(const struct trace_record *tr)
+{
+	static unsigned maxrecords;
+	struct trace_record *newrecords;
+
+	if (nrecords == maxrecords) {
+		maxrecords = maxrecords ? maxrecords * 2 : 1024;
+		newrecords = malloc(maxrecords * sizeof(*records));
+		if (newrecords == NULL) {
+			err(1, "malloc");
+		}
+		if (records != NULL) {
+			memcpy(newrecords, records, nrecords * sizeof(*records));
+			free(records);
+		}
+		records = newrecords;
+	}
+	records[nrecords++] = *tr;
+}
+
+static
+void
+doread(int fd, void *buf, size_t len, const char *file)
+{
+	ssize_t r;
+
+	r = read(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s: read", file);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: short file", file);
+	}
+}
+
+static
+void
+readtrace(const char *file)
+{
+	struct trace_header th;
+	struct trace_record tr;
+	uint32_t i, n;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+	doread(fd, &th, sizeof(th), file);
+	if (SWAPL(th.th_magic) != TRACE_MAGIC) {
+		errx(1, "%s: not a kernel trace", file);
+	}
+	n = SWAPL(th.th_nrecords);
+	if (SWAPL(th.th_lost) > 0) {
+		printf("(%u earlier records were overwritten)\n",
+		       SWAPL(th.th_lost));
+	}
+	for (i=0; i<n; i++) {
+		doread(fd, &tr, sizeof(tr), file);
+		tr.tr_secs = SWAPL(tr.tr_secs);
+		tr.tr_nsecs = SWAPL(tr.tr_nsecs);
+		tr.tr_thread = SWAPL(tr.tr_thread);
+		tr.tr_event = SWAPS(tr.tr_event);
+		tr.tr_cpu = SWAPS(tr.tr_cpu);
+		tr.tr_arg0 = SWAPL(tr.tr_arg0);
+		tr.tr_arg1 = SWAPL(tr.tr_arg1);
+		addrecord(&tr);
+	}
+	close(fd);
+	timed = 1;
+}
+
+/* Does S begin with PREFIX? */
+static
+int
+startswith(const char *s, const char *prefix)
+{
+	while (*prefix) {
+		if (*s++ != *prefix++) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Find the debug code on a line of System/161 output ("... code N
+ * ..."). Returns 0 if there isn't one.
+ */
+static
+int
+getcode(const char *line, uint32_t *ret)
+{
+	const char *s;
+	uint32_t val;
+
+	for (s = line; *s; s++) {
+		if (startswith(s, "code ") && s[5] >= '0' && s[5] <= '9') {
+			val = 0;
+			for (s += 5; *s >= '0' && *s <= '9'; s++) {
+				val = val*10 + (*s - '0');
+			}
+			*ret = val;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static
+void
+readlog(const char *file)
+{
+	struct trace_record tr;
+	char buf[4096], line[256];
+	size_t linelen = 0;
+	ssize_t len, i;
+	uint32_t code;
+	int fd, have = 0;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+	memset(&tr, 0, sizeof(tr));
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (i=0; i<len; i++) {
+			if (buf[i] != '\n') {
+				if (linelen < sizeof(line) - 1) {
+					line[linelen++] = buf[i];
+				}
+				continue;
+			}
+			line[linelen] = 0;
+			linelen = 0;
+			if (!getcode(line, &code)) {
+				continue;
+			}
+
+			/* Each record: tag word, then two arguments. */
+			if ((code & 0xff000000) == TRACE_LTRACE_TAG &&
+			    have == 0) {
+				tr.tr_event = (code >> 8) & 0xffff;
+				tr.tr_cpu = code & 0xff;
+				have = 1;
+			}
+			else if (have == 1) {
+				tr.tr_arg0 = code;
+				have = 2;
+			}
+			else if (have == 2) {
+				tr.tr_arg1 = code;
+				addrecord(&tr);
+				have = 0;
+			}
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", file);
+	}
+	close(fd);
+	timed = 0;
+}
+
+////////////////////////////////////////////////////////////
+// timeline
+
+/*
+ * Microseconds since the first record. (Kept to 32 bits, which covers
+ * over an hour of trace, so as not to need 64-bit division.)
+ */
+static
+uint32_t
+reltime(const struct trace_record *tr)
+{
+	return (tr->tr_secs - records[0].tr_secs) * 1000000
+		+ tr->tr_nsecs / 1000 - records[0].tr_nsecs / 1000;
+}
+
+static
+void
+describe(const struct trace_record *tr, char *buf, size_t len)
+{
+	unsigned n;
+
+	switch (tr->tr_event) {
+	    case TP_SYSCALL_ENTER:
+		snprintf(buf, len, "%s(0x%x)", syscallname(tr->tr_arg0),
+			 tr->tr_arg1);
+		break;
+	    case TP_SYSCALL_EXIT:
+		if (tr->tr_arg1 == 0) {
+			snprintf(buf, len, "%s ok", syscallname(tr->tr_arg0));
+		}
+		else {
+			snprintf(buf, len, "%s error %u",
+				 syscallname(tr->tr_arg0), tr->tr_arg1);
+		}
+		break;
+	    case TP_VM_FAULT:
+		snprintf(buf, len, "%s 0x%08x",
+			 tr->tr_arg0 < 3 ? faulttypes[tr->tr_arg0] : "?",
+			 tr->tr_arg1);
+		break;
+	    case TP_THREAD_SWITCH:
+		snprintf(buf, len, "to 0x%08x, old thread %s", tr->tr_arg0,
+			 tr->tr_arg1 < 4 ? threadstates[tr->tr_arg1] : "?");
+		break;
+	    case TP_LOCK_ACQUIRE:
+		snprintf(buf, len, "0x%08x%s", tr->tr_arg0,
+			 tr->tr_arg1 ? " (waited)" : "");
+		break;
+	    case TP_DISK_START:
+		n = tr->tr_arg1 & ~TRACE_DISK_WRITE;
+		snprintf(buf, len, "%s %u sector%s at %u",
+			 (tr->tr_arg1 & TRACE_DISK_WRITE) ? "write" : "read",
+			 n, n == 1 ? "" : "s", tr->tr_arg0);
+		break;
+	    case TP_DISK_DONE:
+		if (tr->tr_arg1 == 0) {
+			snprintf(buf, len, "at %u ok", tr->tr_arg0);
+		}
+		else {
+			snprintf(buf, len, "at %u error %u", tr->tr_arg0,
+				 tr->tr_arg1);
+		}
+		break;
+	    default:
+		snprintf(buf, len, "0x%x 0x%x", tr->tr_arg0, tr->tr_arg1);
+		break;
+	}
+}
+
+static
+void
+timeline(void)
+{
+	const struct trace_record *tr;
+	char desc[128];
+	uint32_t t;
+	unsigned i;
+
+	for (i=0; i<nrecords; i++) {
+		tr = &records[i];
+		describe(tr, desc, sizeof(desc));
+		if (timed) {
+			t = reltime(tr);
+			printf("%4u.%06u cpu%u 0x%08x %-8s %s\n",
+			       t / 1000000, t % 1000000,
+			       tr->tr_cpu, tr->tr_thread,
+			       tr->tr_event < TP_NEVENTS ?
+			       eventnames[tr->tr_event] : "?",
+			       desc);
+		}
+		else {
+			printf("%6u cpu%u %-8s %s\n", i, tr->tr_cpu,
+			       tr->tr_event < TP_NEVENTS ?
+			       eventnames[tr->tr_event] : "?",
+			       desc);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// summary
+
+/* Latency accumulator */
+struct lat {
+	unsigned count;
+	uint32_t total;		/* us */
+	uint32_t max;
+};
+
+static
+void
+addlat(struct lat *l, uint32_t us)
+{
+	l->count++;
+	l->total += us;
+	if (us > l->max) {
+		l->max = us;
+	}
+}
+
+static
+void
+printlat(const char *what, const struct lat *l)
+{
+	if (l->count == 0) {
+		return;
+	}
+	printf("  %-10s %8u  avg %8u us  max %8u us\n", what, l->count,
+	       l->total / l->count, l->max);
+}
+
+/* Latencies per system call, indexed like syscalls[] (+1 for others) */
+static struct lat syslat[NSYSCALLS + 1];
+
+static
+struct lat *
+syscalllat(unsigned num)
+{
+	unsigned i;
+
+	for (i=0; i<NSYSCALLS; i++) {
+		if (syscalls[i].num == num) {
+			return &syslat[i];
+		}
+	}
+	return &syslat[NSYSCALLS];
+}
+
+/* Records still waiting for their match */
+#define MAXPENDING 256
+static const struct trace_record *pending[MAXPENDING];
+
+static
+const struct trace_record *
+takepending(unsigned event, uint32_t key)
+{
+	const struct trace_record *tr;
+	unsigned i;
+	uint32_t k;
+
+	for (i=0; i<MAXPENDING; i++) {
+		tr = pending[i];
+		if (tr == NULL || tr->tr_event != event) {
+			continue;
+		}
+		k = event == TP_DISK_START ? tr->tr_arg0 : tr->tr_thread;
+		if (k == key) {
+			pending[i] = NULL;
+			return tr;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+putpending(const struct trace_record *tr)
+{
+	unsigned i;
+
+	for (i=0; i<MAXPENDING; i++) {
+		if (pending[i] == NULL) {
+			pending[i] = tr;
+			return;
+		}
+	}
+	/* Too many; forget this one. */
+}
+
+static
+void
+summary(void)
+{
+	unsigned counts[TP_NEVENTS];
+	const struct trace_record *tr, *start;
+	struct lat disklat;
+	unsigned i, waits = 0;
+
+	memset(counts, 0, sizeof(counts));
+	memset(&disklat, 0, sizeof(disklat));
+
+	for (i=0; i<nrecords; i++) {
+		tr = &records[i];
+		if (tr->tr_event < TP_NEVENTS) {
+			counts[tr->tr_event]++;
+		}
+		switch (tr->tr_event) {
+		    case TP_SYSCALL_ENTER:
+			/* A thread has one call at a time. */
+			takepending(TP_SYSCALL_ENTER, tr->tr_thread);
+			putpending(tr);
+			break;
+		    case TP_SYSCALL_EXIT:
+			start = takepending(TP_SYSCALL_ENTER, tr->tr_thread);
+			if (start != NULL && timed) {
+				addlat(syscalllat(tr->tr_arg0),
+				       reltime(tr) - reltime(start));
+			}
+			break;
+		    case TP_LOCK_ACQUIRE:
+			if (tr->tr_arg1) {
+				waits++;
+			}
+			break;
+		    case TP_DISK_START:
+			putpending(tr);
+			break;
+		    case TP_DISK_DONE:
+			start = takepending(TP_DISK_START, tr->tr_arg0);
+			if (start != NULL && timed) {
+				addlat(&disklat, reltime(tr) - reltime(start));
+			}
+			break;
+		}
+	}
+
+	printf("%u records", nrecords);
+	if (timed && nrecords > 0) {
+		printf(" over %u us", reltime(&records[nrecords-1]));
+	}
+	printf("\n");
+	for (i=1; i<TP_NEVENTS; i++) {
+		printf("  %-10s %8u\n", eventnames[i], counts[i]);
+	}
+	if (counts[TP_LOCK_ACQUIRE] > 0) {
+		printf("  lock acquisitions that waited: %u (%u%%)\n", waits,
+		       waits * 100 / counts[TP_LOCK_ACQUIRE]);
+	}
+
+	if (!timed) {
+		return;
+	}
+	printf("System call latency:\n");
+	for (i=0; i<NSYSCALLS; i++) {
+		printlat(syscalls[i].name, &syslat[i]);
+	}
+	printlat("other", &syslat[NSYSCALLS]);
+	printf("Disk request latency:\n");
+	printlat("disk", &disklat);
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, dosummary = 0, dolog = 0;
+	const char *file = NULL;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-s")) {
+			dosummary = 1;
+		}
+		else if (!strcmp(argv[i], "-l")) {
+			dolog = 1;
+		}
+		else if (file == NULL && argv[i][0] != '-') {
+			file = argv[i];
+		}
+		else {
+			file = NULL;
+			break;
+		}
+	}
+	if (file == NULL) {
+		errx(1, "Usage: tracedecode [-l] [-s] file");
+	}
+
+	if (dolog) {
+		readlog(file);
+	}
+	else {
+		readtrace(file);
+	}
+
+	if (dosummary) {
+		summary();
+	}
+	else {
+		timeline();
+	}
+	return 0;
+}
@@ -83,6 +83,7 @@ a canal - Panama!
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 char palindrome[8000] = 
 "amanaplanacaretabanamyriadasumalacaliarahoopapintacatalpaagasanoil"
@@ -170,29 +171,61 @@ char palindrome[8000] =
 "warastayagamayapacamarayanaxatagawaxapawacatavalleyadribaliona"
 "sagaaplatacatnipapooharailacalamusadairymanabateracanalpanama";
 
+/*
+ * Bytes written to the console so far, and when we started. Nearly all
+ * of the run is console output, so bytes per second at the end is a
+ * rough measure of how fast the console path is.
+ */
+static unsigned long nbytes;
+static time_t before_s;
+static unsigned long before_ns;
+
+static
+void
+report(void)
+{
+	time_t after_s;
+	unsigned long after_ns, ms;
+
+	__time(&after_s, &after_ns);
+	ms = (after_s - before_s) * 1000;
+	ms = ms + after_ns / 1000000;
+	ms = ms - before_ns / 1000000;
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("palin: %lu bytes in %lu.%03lu s: %lu bytes/sec\n",
+	       nbytes, ms / 1000, ms % 1000, nbytes * 1000 / ms);
+}
+
 int
 main()
 {
 	char *start, *end;
-	
-	printf("Welcome to the palindrome tester!\n");
-	printf("I will take a large palindrome and test it.\n");
-	printf("Here it is:\n");
-	printf("%s\n", palindrome);
 
-	printf("Testing...");
+	__time(&before_s, &before_ns);
+
+	nbytes += printf("Welcome to the palindrome tester!\n");
+	nbytes += printf("I will take a large palindrome and test it.\n");
+	nbytes += printf("Here it is:\n");
+	nbytes += printf("%s\n", palindrome);
+
+	nbytes += printf("Testing...");
 	/* skip to end */
 	end = palindrome+strlen(palindrome);
 	end--;
 
 	for (start = palindrome; start <= end; start++, end--) {
 		putchar('.');
+		nbytes++;
 		if (*start != *end) {
-			printf("NOT a palindrome\n");
+			nbytes += printf("NOT a palindrome\n");
+			report();
 			return 0;
 		}
 	}
 	
-	printf("IS a palindrome\n");
+	nbytes += printf("IS a palindrome\n");
+	report();
 	return 0;
 }
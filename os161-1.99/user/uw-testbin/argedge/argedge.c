@@ -0,0 +1,120 @@
+/*
+ * argedge - pass execv arguments that just fill, or just overflow,
+ * the kernel's argument buffer.
+ *
+ *  usage: argedge
+ *
+ *  relies on fork, execv, _exit and waitpid
+ *
+ *  The kernel packs the argument strings and the argv pointer array
+ *  into one buffer that starts at a page and doubles when full. For
+ *  each of a range of string lengths around the first two buffer
+ *  sizes, execs itself with "-c", the length and a string of that
+ *  length; the child checks that the string arrived intact and exits.
+ *  Some lengths make the strings and pointers fill the buffer
+ *  exactly, which must neither fail nor crash the kernel.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#define SELF   "/uw-testbin/argedge"
+#define BELOW  64	/* lengths tried below each buffer size */
+#define ABOVE  8	/* and above it */
+
+static const unsigned sizes[] = { 4096, 8192 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static char str[8192 + ABOVE + 1];
+
+static
+char
+pattern(unsigned i)
+{
+  return 'a' + i % 26;
+}
+
+static
+int
+check(const char *lenstr, const char *s)
+{
+  unsigned len = atoi(lenstr);
+  unsigned i;
+
+  if (strlen(s) != len) {
+    warnx("got %u bytes, expected %u", (unsigned)strlen(s), len);
+    return 1;
+  }
+  for (i = 0; i < len; i++) {
+    if (s[i] != pattern(i)) {
+      warnx("length %u: wrong byte at %u", len, i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static
+void
+tryexec(unsigned len)
+{
+  char lenstr[16];
+  char *args[5];
+  unsigned i;
+  int status;
+  pid_t pid;
+
+  for (i = 0; i < len; i++) {
+    str[i] = pattern(i);
+  }
+  str[len] = 0;
+  snprintf(lenstr, sizeof(lenstr), "%u", len);
+
+  args[0] = (char *)SELF;
+  args[1] = (char *)"-c";
+  args[2] = lenstr;
+  args[3] = str;
+  args[4] = NULL;
+
+  pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  }
+  if (pid == 0) {
+    execv(SELF, args);
+    err(1, "%s (argument length %u)", SELF, len);
+  }
+  if (waitpid(pid, &status, 0) < 0) {
+    err(1, "waitpid");
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    errx(1, "argument length %u: child exited with status %d",
+         len, status);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned i, len;
+
+  if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+    return check(argv[2], argv[3]);
+  }
+  if (argc != 1) {
+    errx(1, "usage: argedge");
+  }
+
+  for (i = 0; i < NSIZES; i++) {
+    for (len = sizes[i] - BELOW; len <= sizes[i] + ABOVE; len++) {
+      tryexec(len);
+    }
+    printf("argedge: lengths %u to %u passed\n",
+           sizes[i] - BELOW, sizes[i] + ABOVE);
+  }
+  printf("argedge: done\n");
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * conc-read - concurrent readers benchmark.
+ *
+ *  usage: conc-read [procs [kbytes-per-file]]
+ *
+ *  relies on fork, waitpid, open, read, write, close, remove and __time
+ *
+ *  Like conc-io, but for reads and timed. The parent writes one file
+ *  per reader (default 4 readers, 32k per file), one after the other,
+ *  so each file sits in its own area of the disk. Then all the readers
+ *  run at once, each reading its own file from start to end and
+ *  checking what it reads. With everyone's requests arriving at the
+ *  disk together, the order they are served in decides how much of the
+ *  time goes to seeking; compare the total time and throughput across
+ *  kernels (or disk settings). Run it on an SFS volume (e.g. cd to
+ *  lhd0: first), with a cold buffer cache, or the disk isn't involved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_PROCS  4
+#define MAX_PROCS      16
+#define DEFAULT_KBYTES 32
+#define BUF_SIZE       512
+
+static char const *letters = "ABCDEFGHIJKLMNOP";
+
+static
+void
+filename(int i, char *buf, size_t len)
+{
+  snprintf(buf, len, "CONCREAD%d", i);
+}
+
+static
+void
+make_file(int i, int nbytes)
+{
+  char name[32];
+  char buffer[BUF_SIZE];
+  int fd, done, rval;
+
+  filename(i, name, sizeof(name));
+  memset(buffer, letters[i], BUF_SIZE);
+
+  fd = open(name, O_WRONLY | O_CREAT | O_TRUNC);
+  if (fd < 0) {
+    err(1, "%s: create", name);
+  }
+  for (done = 0; done < nbytes; done += rval) {
+    rval = write(fd, buffer, BUF_SIZE);
+    if (rval != BUF_SIZE) {
+      err(1, "%s: write", name);
+    }
+  }
+  close(fd);
+}
+
+static
+void
+do_reads(int i)
+{
+  char name[32];
+  char buffer[BUF_SIZE];
+  int fd, rval, k;
+
+  filename(i, name, sizeof(name));
+  fd = open(name, O_RDONLY);
+  if (fd < 0) {
+    err(1, "%s: open", name);
+  }
+  while ((rval = read(fd, buffer, BUF_SIZE)) > 0) {
+    for (k = 0; k < rval; k++) {
+      if (buffer[k] != letters[i]) {
+        errx(1, "### TEST FAILED: %s has %c where %c belongs",
+             name, buffer[k], letters[i]);
+      }
+    }
+  }
+  if (rval < 0) {
+    err(1, "%s: read", name);
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int procs = DEFAULT_PROCS;
+  int kbytes = DEFAULT_KBYTES;
+  pid_t pid[MAX_PROCS];
+  char name[32];
+  time_t before_s, after_s;
+  unsigned long before_ns, after_ns;
+  unsigned long ms, total;
+  int i, status, failed = 0;
+
+  if (argc > 1) {
+    procs = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    kbytes = atoi(argv[2]);
+  }
+  if (procs < 1 || procs > MAX_PROCS || kbytes < 1) {
+    errx(1, "usage: conc-read [procs (1-%d) [kbytes-per-file]]", MAX_PROCS);
+  }
+
+  for (i = 0; i < procs; i++) {
+    make_file(i, kbytes * 1024);
+  }
+  /* push the files out, so the readers mostly have to go to the disk */
+  sync();
+
+  __time(&before_s, &before_ns);
+
+  for (i = 0; i < procs; i++) {
+    pid[i] = fork();
+    if (pid[i] < 0) {
+      err(1, "fork");
+    }
+    if (pid[i] == 0) {
+      do_reads(i);
+      _exit(0);
+    }
+  }
+  for (i = 0; i < procs; i++) {
+    if (waitpid(pid[i], &status, 0) != pid[i]) {
+      err(1, "waitpid");
+    }
+    if (status != 0) {
+      failed = 1;
+    }
+  }
+
+  __time(&after_s, &after_ns);
+
+  for (i = 0; i < procs; i++) {
+    filename(i, name, sizeof(name));
+    remove(name);
+  }
+  if (failed) {
+    printf("### TEST FAILED\n");
+    return 1;
+  }
+
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  total = (unsigned long)procs * kbytes * 1024;
+  printf("conc-read: %d readers, %lu bytes in %lu.%03lu s: %lu KB/s\n",
+         procs, total, ms / 1000, ms % 1000, total / ms);
+  printf("PASSED\n");
+  return 0;
+}
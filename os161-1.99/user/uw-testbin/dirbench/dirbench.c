@@ -0,0 +1,100 @@
+/*
+ * dirbench - measure name lookup cost in a big directory.
+ *
+ *  usage: dirbench [nfiles]
+ *
+ *  relies on open, close, remove and __time
+ *
+ *  Creates "nfiles" (default 500) empty files in the current
+ *  directory, opens each of them again by name, then removes them,
+ *  and reports how many of each operation per second it managed.
+ *  Every one of those has to look the name up in the directory, so
+ *  with a directory searched slot by slot, the rates fall off as the
+ *  directory grows. Run it on an SFS volume (e.g. cd to lhd0: first).
+ *  SFS directories can't hold more than about 1100 entries.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_NFILES 500
+
+static time_t before_s;
+static unsigned long before_ns;
+
+static
+void
+start(void)
+{
+  __time(&before_s, &before_ns);
+}
+
+static
+void
+report(const char *what, int n)
+{
+  time_t after_s;
+  unsigned long after_ns, ms;
+
+  __time(&after_s, &after_ns);
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  printf("dirbench: %d %s in %lu.%03lu s: %lu per second\n",
+         n, what, ms / 1000, ms % 1000, (unsigned long)n * 1000 / ms);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfiles = DEFAULT_NFILES;
+  char name[32];
+  int i, fd;
+
+  if (argc > 1) {
+    nfiles = atoi(argv[1]);
+  }
+  if (nfiles < 1) {
+    errx(1, "usage: dirbench [nfiles]");
+  }
+
+  start();
+  for (i = 0; i < nfiles; i++) {
+    snprintf(name, sizeof(name), "DIRBENCH%d", i);
+    fd = open(name, O_WRONLY | O_CREAT | O_EXCL);
+    if (fd < 0) {
+      err(1, "%s: create", name);
+    }
+    close(fd);
+  }
+  report("creates", nfiles);
+
+  start();
+  for (i = 0; i < nfiles; i++) {
+    snprintf(name, sizeof(name), "DIRBENCH%d", i);
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+      err(1, "%s: open", name);
+    }
+    close(fd);
+  }
+  report("lookups", nfiles);
+
+  start();
+  for (i = 0; i < nfiles; i++) {
+    snprintf(name, sizeof(name), "DIRBENCH%d", i);
+    if (remove(name) < 0) {
+      err(1, "%s: remove", name);
+    }
+  }
+  report("removes", nfiles);
+
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * execbench - measure how many times per second a program can be exec'd.
+ *
+ *  usage: execbench [program [count]]
+ *
+ *  relies on fork, execv, _exit, waitpid and __time
+ *
+ *  Forks "count" (default 50) children one at a time; each execs
+ *  "program" (default /bin/true) and the parent waits for it before
+ *  forking the next. Reports execs/second.
+ *
+ *  The first exec reads the program from its filesystem; the rest
+ *  should be served from the kernel's exec page cache, whose counters
+ *  (including the bytes it served) are printed by the "pcs" menu
+ *  command.
+ *
+ *  Note: with dumbvm, memory is never returned to the system, so keep
+ *  the count modest.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define DEFAULT_PROGRAM "/bin/true"
+#define DEFAULT_COUNT   50
+
+int
+main(int argc, char *argv[])
+{
+  char *program = DEFAULT_PROGRAM;
+  int count = DEFAULT_COUNT;
+  char *args[2];
+  time_t before_s, after_s;
+  unsigned long before_ns, after_ns;
+  unsigned long ms;
+  int i, status;
+  pid_t pid;
+
+  if (argc > 1) {
+    program = argv[1];
+  }
+  if (argc > 2) {
+    count = atoi(argv[2]);
+  }
+  if (count < 1) {
+    errx(1, "usage: execbench [program [count]]");
+  }
+
+  args[0] = program;
+  args[1] = NULL;
+
+  __time(&before_s, &before_ns);
+
+  for (i = 0; i < count; i++) {
+    pid = fork();
+    if (pid < 0) {
+      err(1, "fork");
+    }
+    if (pid == 0) {
+      execv(program, args);
+      err(1, "%s", program);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+      err(1, "waitpid");
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      errx(1, "%s: exited with status %d", program, status);
+    }
+  }
+
+  __time(&after_s, &after_ns);
+
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  printf("execbench: %d execs of %s in %lu.%03lu s: %lu per second\n",
+         count, program, ms / 1000, ms % 1000,
+         (unsigned long)count * 1000 / ms);
+  return 0;
+}
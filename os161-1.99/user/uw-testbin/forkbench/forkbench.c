@@ -0,0 +1,105 @@
+/*
+ * forkbench - measure how many forks per second the kernel can do.
+ *
+ *  usage: forkbench [forks-per-worker [workers]]
+ *
+ *  relies on fork, _exit, waitpid, console write and __time
+ *
+ *  The parent forks "workers" worker processes (default 1). Each worker
+ *  forks "forks-per-worker" children (default 50), one at a time; each
+ *  child exits immediately and the worker waits for it before forking
+ *  the next one. The parent reports the total forks/second.
+ *
+ *  Run it with 1 to 4 workers on a sys161 configured with 1 to 4 CPUs
+ *  (the "cpus" setting in sys161.conf) to see how fork scales. The
+ *  kernel's own view of fork latency is printed by the "pst" menu command.
+ *
+ *  Note: with dumbvm, memory is never returned to the system, so keep
+ *  the total number of forks modest.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define DEFAULT_FORKS   50
+#define DEFAULT_WORKERS 1
+#define MAX_WORKERS     16
+
+static
+void
+forkloop(int nforks)
+{
+  int i, status;
+  pid_t pid;
+
+  for (i = 0; i < nforks; i++) {
+    pid = fork();
+    if (pid < 0) {
+      err(1, "fork");
+    }
+    if (pid == 0) {
+      /* child */
+      _exit(0);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+      err(1, "waitpid");
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nforks = DEFAULT_FORKS;
+  int nworkers = DEFAULT_WORKERS;
+  pid_t workers[MAX_WORKERS];
+  time_t before_s, after_s;
+  unsigned long before_ns, after_ns;
+  unsigned long ms, total;
+  int i, status;
+
+  if (argc > 1) {
+    nforks = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    nworkers = atoi(argv[2]);
+  }
+  if (nforks < 1 || nworkers < 1 || nworkers > MAX_WORKERS) {
+    errx(1, "usage: forkbench [forks-per-worker [workers (1-%d)]]",
+         MAX_WORKERS);
+  }
+
+  __time(&before_s, &before_ns);
+
+  for (i = 0; i < nworkers; i++) {
+    workers[i] = fork();
+    if (workers[i] < 0) {
+      err(1, "fork");
+    }
+    if (workers[i] == 0) {
+      forkloop(nforks);
+      _exit(0);
+    }
+  }
+  for (i = 0; i < nworkers; i++) {
+    if (waitpid(workers[i], &status, 0) < 0) {
+      err(1, "waitpid");
+    }
+  }
+
+  __time(&after_s, &after_ns);
+
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  total = (unsigned long)nforks * nworkers;
+
+  printf("forkbench: %lu forks by %d worker(s) in %lu.%03lu s: %lu forks/sec\n",
+         total, nworkers, ms / 1000, ms % 1000, total * 1000 / ms);
+  return 0;
+}
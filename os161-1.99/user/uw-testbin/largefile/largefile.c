@@ -0,0 +1,181 @@
+/*
+ * largefile - write and check a file of several megabytes.
+ *
+ *  usage: largefile <filename> [kbytes]
+ *
+ *  relies on open, write, read, lseek, close and __time
+ *
+ *  Writes "kbytes" (default 4096) KB to the file in order, in 4 KB
+ *  writes, then reads it all back and checks every word, and reports
+ *  the rate of each. Then it writes one more block a few megabytes
+ *  past the end and checks that the hole in between reads as zeros.
+ *
+ *  With the old SFS inode a file couldn't get past about 71 KB. Now
+ *  a file written in order onto free space should need only a few
+ *  extents however big it is; dumpsfs shows how many it got, and
+ *  sfsck checks them. Run it on an SFS volume (e.g. cd to lhd0:
+ *  first) with room for the file. The file is left behind.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_KBYTES 4096
+#define CHUNK          4096
+#define WORDS          (CHUNK / sizeof(unsigned))
+#define HOLE           (4 * 1024 * 1024)
+
+static unsigned buf[WORDS];
+
+/* What word I of the chunk at byte OFFSET should hold */
+static
+unsigned
+pattern(unsigned long offset, unsigned i)
+{
+  return (offset / sizeof(unsigned) + i) ^ 0x5a5a5a5a;
+}
+
+static
+void
+fill(unsigned long offset)
+{
+  unsigned i;
+
+  for (i = 0; i < WORDS; i++) {
+    buf[i] = pattern(offset, i);
+  }
+}
+
+/* Milliseconds since BEFORE */
+static
+unsigned long
+elapsed(time_t before_s, unsigned long before_ns)
+{
+  time_t after_s;
+  unsigned long after_ns, ms;
+
+  __time(&after_s, &after_ns);
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  return ms == 0 ? 1 : ms;
+}
+
+static
+void
+report(const char *what, unsigned long bytes, unsigned long ms)
+{
+  /* bytes per ms is (roughly) KB per second */
+  unsigned long kbps = bytes / ms;
+
+  printf("largefile: %s %lu bytes in %lu.%03lu s: %lu.%03lu MB/s\n",
+         what, bytes, ms / 1000, ms % 1000, kbps / 1000, kbps % 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *filename;
+  int kbytes = DEFAULT_KBYTES;
+  unsigned long size, offset;
+  time_t before_s;
+  unsigned long before_ns;
+  unsigned i;
+  int fd, r;
+
+  if (argc < 2) {
+    errx(1, "usage: largefile <filename> [kbytes]");
+  }
+  filename = argv[1];
+  if (argc > 2) {
+    kbytes = atoi(argv[2]);
+  }
+  if (kbytes < 4) {
+    errx(1, "usage: largefile <filename> [kbytes (at least 4)]");
+  }
+  size = (unsigned long)kbytes / 4 * CHUNK;
+
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+  if (fd < 0) {
+    err(1, "%s", filename);
+  }
+  __time(&before_s, &before_ns);
+  for (offset = 0; offset < size; offset += CHUNK) {
+    fill(offset);
+    r = write(fd, buf, CHUNK);
+    if (r < 0) {
+      err(1, "%s: write at %lu", filename, offset);
+    }
+    if (r != CHUNK) {
+      errx(1, "%s: short write at %lu", filename, offset);
+    }
+  }
+  close(fd);
+  report("wrote", size, elapsed(before_s, before_ns));
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    err(1, "%s", filename);
+  }
+  __time(&before_s, &before_ns);
+  for (offset = 0; offset < size; offset += CHUNK) {
+    r = read(fd, buf, CHUNK);
+    if (r < 0) {
+      err(1, "%s: read at %lu", filename, offset);
+    }
+    if (r != CHUNK) {
+      errx(1, "%s: short read at %lu", filename, offset);
+    }
+    for (i = 0; i < WORDS; i++) {
+      if (buf[i] != pattern(offset, i)) {
+        errx(1, "%s: wrong data at %lu", filename,
+             offset + i * sizeof(unsigned));
+      }
+    }
+  }
+  report("read", size, elapsed(before_s, before_ns));
+  close(fd);
+
+  /* One more chunk, with a hole before it */
+  fd = open(filename, O_RDWR);
+  if (fd < 0) {
+    err(1, "%s", filename);
+  }
+  offset = size + HOLE;
+  if (lseek(fd, offset, SEEK_SET) < 0) {
+    err(1, "%s: lseek", filename);
+  }
+  fill(offset);
+  if (write(fd, buf, CHUNK) != CHUNK) {
+    err(1, "%s: write past the hole", filename);
+  }
+  if (lseek(fd, size + HOLE / 2, SEEK_SET) < 0) {
+    err(1, "%s: lseek", filename);
+  }
+  if (read(fd, buf, CHUNK) != CHUNK) {
+    err(1, "%s: read in the hole", filename);
+  }
+  for (i = 0; i < WORDS; i++) {
+    if (buf[i] != 0) {
+      errx(1, "%s: hole does not read as zeros", filename);
+    }
+  }
+  if (lseek(fd, offset, SEEK_SET) < 0) {
+    err(1, "%s: lseek", filename);
+  }
+  if (read(fd, buf, CHUNK) != CHUNK) {
+    err(1, "%s: read past the hole", filename);
+  }
+  for (i = 0; i < WORDS; i++) {
+    if (buf[i] != pattern(offset, i)) {
+      errx(1, "%s: wrong data past the hole", filename);
+    }
+  }
+  close(fd);
+
+  printf("largefile: passed\n");
+  return 0;
+}
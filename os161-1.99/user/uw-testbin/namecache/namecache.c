@@ -0,0 +1,132 @@
+/*
+ * namecache - check and time the kernel's name lookup cache.
+ *
+ *  usage: namecache [path] [count]
+ *
+ *  relies on open, close, remove and __time
+ *
+ *  First checks that the cache notices names coming and going: a
+ *  name that was looked up and not found must be found once it has
+ *  been created, and not found again once it has been removed.
+ *
+ *  Then opens "path" (default /bin/sh) "count" (default 2000) times,
+ *  and tries to open a name that doesn't exist as many times, and
+ *  reports how many of each it managed per second. With the cache
+ *  both should be well clear of what the filesystem alone manages;
+ *  the kernel menu's "dst" command shows the hit counts.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_PATH "/bin/sh"
+#define DEFAULT_COUNT 2000
+#define TESTNAME "NAMECACHE.TMP"
+#define NONAME "NAMECACHE.NONE"
+
+static time_t before_s;
+static unsigned long before_ns;
+
+static
+void
+start(void)
+{
+  __time(&before_s, &before_ns);
+}
+
+static
+void
+report(const char *what, int n)
+{
+  time_t after_s;
+  unsigned long after_ns, ms;
+
+  __time(&after_s, &after_ns);
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  printf("namecache: %d %s in %lu.%03lu s: %lu per second\n",
+         n, what, ms / 1000, ms % 1000, (unsigned long)n * 1000 / ms);
+}
+
+/* Open NAME read-only and expect it to succeed or fail with ENOENT. */
+static
+void
+expect(const char *name, int exists)
+{
+  int fd;
+
+  fd = open(name, O_RDONLY);
+  if (exists) {
+    if (fd < 0) {
+      err(1, "%s: open", name);
+    }
+    close(fd);
+  }
+  else {
+    if (fd >= 0) {
+      errx(1, "%s: open succeeded on a name that shouldn't exist", name);
+    }
+    if (errno != ENOENT) {
+      err(1, "%s: open: wrong error", name);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *path = DEFAULT_PATH;
+  int count = DEFAULT_COUNT;
+  int i, fd;
+
+  if (argc > 1) {
+    path = argv[1];
+  }
+  if (argc > 2) {
+    count = atoi(argv[2]);
+  }
+  if (count < 1) {
+    errx(1, "usage: namecache [path] [count]");
+  }
+
+  /* Negative entries must go away when the name is created... */
+  remove(TESTNAME);
+  expect(TESTNAME, 0);
+  expect(TESTNAME, 0);
+  fd = open(TESTNAME, O_WRONLY | O_CREAT | O_EXCL);
+  if (fd < 0) {
+    err(1, "%s: create", TESTNAME);
+  }
+  close(fd);
+  expect(TESTNAME, 1);
+  expect(TESTNAME, 1);
+
+  /* ...and positive ones when it's removed. */
+  if (remove(TESTNAME) < 0) {
+    err(1, "%s: remove", TESTNAME);
+  }
+  expect(TESTNAME, 0);
+  printf("namecache: create/remove invalidation ok\n");
+
+  start();
+  for (i = 0; i < count; i++) {
+    expect(path, 1);
+  }
+  report("opens", count);
+
+  start();
+  for (i = 0; i < count; i++) {
+    expect(NONAME, 0);
+  }
+  report("failed opens", count);
+
+  return 0;
+}
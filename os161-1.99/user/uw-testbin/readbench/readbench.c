@@ -0,0 +1,94 @@
+/*
+ * readbench - measure sequential read throughput.
+ *
+ *  usage: readbench <filename> [iosize [passes]]
+ *
+ *  relies on open, read, close and __time
+ *
+ *  Reads the whole file from start to end "passes" times (default 2),
+ *  "iosize" bytes per read (default 512), and reports the throughput of
+ *  each pass. Make the file with /testbin/bigfile first, e.g.
+ *
+ *      p /testbin/bigfile lhd0:big 65536
+ *      p /uw-testbin/readbench lhd0:big
+ *
+ *  The first pass shows what the disk and readahead can do (unmount
+ *  and remount, or reboot, first, to start with a cold buffer cache);
+ *  later passes are mostly served from the buffer cache. The kernel's
+ *  cache counters are printed by the "bst" menu command.
+ *
+ *  It works on emufs files too (e.g. readbench /bin/sh 100), where
+ *  small reads are served from the emufs driver's read cache.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_IOSIZE 512
+#define DEFAULT_PASSES 2
+#define MAX_IOSIZE     8192
+
+static char buf[MAX_IOSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  const char *filename;
+  int iosize = DEFAULT_IOSIZE;
+  int passes = DEFAULT_PASSES;
+  time_t before_s, after_s;
+  unsigned long before_ns, after_ns;
+  unsigned long ms, total, kbps;
+  int fd, pass, r;
+
+  if (argc < 2) {
+    errx(1, "usage: readbench <filename> [iosize [passes]]");
+  }
+  filename = argv[1];
+  if (argc > 2) {
+    iosize = atoi(argv[2]);
+  }
+  if (argc > 3) {
+    passes = atoi(argv[3]);
+  }
+  if (iosize < 1 || iosize > MAX_IOSIZE || passes < 1) {
+    errx(1, "usage: readbench <filename> [iosize (1-%d) [passes]]",
+         MAX_IOSIZE);
+  }
+
+  for (pass = 1; pass <= passes; pass++) {
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+      err(1, "%s", filename);
+    }
+
+    total = 0;
+    __time(&before_s, &before_ns);
+    while ((r = read(fd, buf, iosize)) > 0) {
+      total += r;
+    }
+    __time(&after_s, &after_ns);
+    if (r < 0) {
+      err(1, "%s: read", filename);
+    }
+    close(fd);
+
+    ms = (after_s - before_s) * 1000;
+    ms = ms + after_ns / 1000000;
+    ms = ms - before_ns / 1000000;
+    if (ms == 0) {
+      ms = 1;
+    }
+    /* bytes per ms is (roughly) KB per second */
+    kbps = total / ms;
+
+    printf("readbench: pass %d: %lu bytes in %lu.%03lu s: "
+           "%lu.%03lu MB/s\n",
+           pass, total, ms / 1000, ms % 1000,
+           kbps / 1000, kbps % 1000);
+  }
+  return 0;
+}
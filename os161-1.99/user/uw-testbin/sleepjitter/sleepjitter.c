@@ -0,0 +1,98 @@
+/*
+ * sleepjitter - measure how precisely nanosleep wakes up.
+ *
+ *  usage: sleepjitter [count]
+ *
+ *  relies on clock_gettime and nanosleep
+ *
+ *  First times "count" (default 20) x 100 calls to clock_gettime with
+ *  CLOCK_MONOTONIC and reports what one call costs. Then, for each of
+ *  a range of sleep lengths from 100 microseconds to 20 milliseconds,
+ *  sleeps "count" times and reports how late nanosleep returned
+ *  (least, average and most, in microseconds) compared with what was
+ *  asked for. nanosleep should never return early.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define DEFAULT_COUNT 20
+
+static const unsigned long lengths[] = {
+  100, 500, 1000, 5000, 20000,		/* microseconds */
+};
+#define NLENGTHS (sizeof(lengths) / sizeof(lengths[0]))
+
+static
+void
+now(struct timespec *ts)
+{
+  if (clock_gettime(CLOCK_MONOTONIC, ts)) {
+    err(1, "clock_gettime");
+  }
+}
+
+/* Microseconds from A to B; they are never far apart here. */
+static
+long
+usecs(const struct timespec *a, const struct timespec *b)
+{
+  return (long)(b->tv_sec - a->tv_sec) * 1000000L
+    + (b->tv_nsec - a->tv_nsec) / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int count = DEFAULT_COUNT;
+  struct timespec before, after, req;
+  long late, least, most, total;
+  unsigned i;
+  int j;
+
+  if (argc > 1) {
+    count = atoi(argv[1]);
+  }
+  if (count < 1) {
+    errx(1, "usage: sleepjitter [count]");
+  }
+
+  now(&before);
+  for (j = 0; j < count * 100; j++) {
+    now(&after);
+  }
+  printf("clock_gettime: %ld ns per call\n",
+         usecs(&before, &after) * 1000 / (count * 100));
+
+  for (i = 0; i < NLENGTHS; i++) {
+    req.tv_sec = 0;
+    req.tv_nsec = lengths[i] * 1000;
+    least = 0;
+    most = 0;
+    total = 0;
+    for (j = 0; j < count; j++) {
+      now(&before);
+      if (nanosleep(&req, NULL)) {
+        err(1, "nanosleep");
+      }
+      now(&after);
+      late = usecs(&before, &after) - (long)lengths[i];
+      if (late < 0) {
+        warnx("nanosleep of %lu us returned %ld us early",
+              lengths[i], -late);
+      }
+      if (j == 0 || late < least) {
+        least = late;
+      }
+      if (j == 0 || late > most) {
+        most = late;
+      }
+      total += late;
+    }
+    printf("sleep %5lu us: late by min %ld avg %ld max %ld us\n",
+           lengths[i], least, total / count, most);
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * vnodestress - measure open cost with many files in memory.
+ *
+ *  usage: vnodestress [procs [files-per-proc [rounds]]]
+ *
+ *  relies on fork, waitpid, open, close, remove and __time
+ *
+ *  Each of "procs" processes (default 8) creates "files-per-proc"
+ *  files (default 100; a process can't have more than 128 open) and
+ *  keeps them all open, so the kernel has that many vnodes loaded at
+ *  once. Once they all have, each reopens and closes each of its
+ *  files "rounds" times (default 5) and reports how many opens per
+ *  second it got. Every open has to find the file's vnode among the
+ *  loaded ones, so this shows how that search scales: try it with
+ *  one process and with many. Run it on an SFS volume (e.g. cd to
+ *  lhd0: first); SFS directories can't hold more than about 1100
+ *  entries, so keep procs * files-per-proc below that.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_PROCS  8
+#define DEFAULT_FILES  100
+#define DEFAULT_ROUNDS 5
+#define MAX_PROCS      32
+#define MAX_FILES      120
+
+#define READYFILE "VSREADY"
+#define MAX_TRIES 100000
+
+static
+void
+filename(int p, int i, char *buf, size_t len)
+{
+  snprintf(buf, len, "VS%d.%d", p, i);
+}
+
+static
+void
+child(int p, int nprocs, int nfiles, int rounds)
+{
+  int fds[MAX_FILES];
+  char name[32];
+  time_t before_s, after_s;
+  unsigned long before_ns, after_ns, ms;
+  int i, r, fd, tries;
+
+  for (i = 0; i < nfiles; i++) {
+    filename(p, i, name, sizeof(name));
+    fds[i] = open(name, O_RDWR | O_CREAT | O_TRUNC);
+    if (fds[i] < 0) {
+      err(1, "%s: create", name);
+    }
+  }
+
+  /*
+   * Say we're ready by creating our flag file, then wait for
+   * everyone else's, so all the vnodes are loaded before timing.
+   */
+  snprintf(name, sizeof(name), "%s%d", READYFILE, p);
+  fd = open(name, O_WRONLY | O_CREAT);
+  if (fd < 0) {
+    err(1, "%s: create", name);
+  }
+  close(fd);
+  for (i = 0; i < nprocs; i++) {
+    snprintf(name, sizeof(name), "%s%d", READYFILE, i);
+    for (tries = 0; (fd = open(name, O_RDONLY)) < 0; tries++) {
+      if (tries > MAX_TRIES) {
+        errx(1, "gave up waiting for process %d", i);
+      }
+    }
+    close(fd);
+  }
+
+  __time(&before_s, &before_ns);
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < nfiles; i++) {
+      filename(p, i, name, sizeof(name));
+      fd = open(name, O_RDONLY);
+      if (fd < 0) {
+        err(1, "%s: open", name);
+      }
+      close(fd);
+    }
+  }
+  __time(&after_s, &after_ns);
+
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  if (ms == 0) {
+    ms = 1;
+  }
+  printf("vnodestress: process %d: %d opens in %lu.%03lu s: %lu per second\n",
+         p, rounds * nfiles, ms / 1000, ms % 1000,
+         (unsigned long)rounds * nfiles * 1000 / ms);
+
+  for (i = 0; i < nfiles; i++) {
+    close(fds[i]);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nprocs = DEFAULT_PROCS;
+  int nfiles = DEFAULT_FILES;
+  int rounds = DEFAULT_ROUNDS;
+  pid_t pids[MAX_PROCS];
+  char name[32];
+  int p, i, status, failed = 0;
+
+  if (argc > 1) {
+    nprocs = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    nfiles = atoi(argv[2]);
+  }
+  if (argc > 3) {
+    rounds = atoi(argv[3]);
+  }
+  if (nprocs < 1 || nprocs > MAX_PROCS || nfiles < 1 || nfiles > MAX_FILES
+      || rounds < 1) {
+    errx(1, "usage: vnodestress [procs (1-%d) [files-per-proc (1-%d) "
+         "[rounds]]]", MAX_PROCS, MAX_FILES);
+  }
+
+  for (p = 0; p < nprocs; p++) {
+    pids[p] = fork();
+    if (pids[p] < 0) {
+      err(1, "fork");
+    }
+    if (pids[p] == 0) {
+      child(p, nprocs, nfiles, rounds);
+      _exit(0);
+    }
+  }
+  for (p = 0; p < nprocs; p++) {
+    if (waitpid(pids[p], &status, 0) != pids[p]) {
+      err(1, "waitpid");
+    }
+    if (status != 0) {
+      failed = 1;
+    }
+  }
+
+  for (p = 0; p < nprocs; p++) {
+    snprintf(name, sizeof(name), "%s%d", READYFILE, p);
+    remove(name);
+    for (i = 0; i < nfiles; i++) {
+      filename(p, i, name, sizeof(name));
+      remove(name);
+    }
+  }
+
+  if (failed) {
+    printf("### TEST FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * writevbench - compare small write() calls against one writev() per
+ *  record, then check the file with pread().
+ *
+ *  usage: writevbench [records]
+ *
+ *  relies on open, write, writev, pread, close, remove and __time
+ *
+ *  Each record is made of NFIELDS short fields. The first pass writes
+ *  every field with its own write() call; the second pass gathers each
+ *  record's fields into a single writev() call, so it makes NFIELDS times
+ *  fewer system calls for the same bytes. Both passes produce the same
+ *  file contents, which are then read back record-by-record with pread()
+ *  (in reverse order, to exercise the explicit offset) and checked.
+ */
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_RECORDS 200
+#define NFIELDS         8
+#define FIELDLEN        4
+#define RECLEN          (NFIELDS * FIELDLEN)
+
+static const char *fname = "writevbench.dat";
+
+/* fill in the fields of record number "rec" */
+static
+void
+makerecord(int rec, char fields[NFIELDS][FIELDLEN])
+{
+  int i, j;
+
+  for (i = 0; i < NFIELDS; i++) {
+    for (j = 0; j < FIELDLEN; j++) {
+      fields[i][j] = 'a' + (rec + i + j) % 26;
+    }
+  }
+}
+
+static
+unsigned long
+elapsed_ms(time_t before_s, unsigned long before_ns)
+{
+  time_t after_s;
+  unsigned long after_ns, ms;
+
+  __time(&after_s, &after_ns);
+  ms = (after_s - before_s) * 1000;
+  ms = ms + after_ns / 1000000;
+  ms = ms - before_ns / 1000000;
+  return ms == 0 ? 1 : ms;
+}
+
+/* write the whole file, either one field per write() or one record per writev() */
+static
+unsigned long
+writefile(int nrecs, int usev)
+{
+  char fields[NFIELDS][FIELDLEN];
+  struct iovec iov[NFIELDS];
+  time_t before_s;
+  unsigned long before_ns;
+  int fd, rec, i, r;
+
+  fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC);
+  if (fd < 0) {
+    err(1, "%s: open for write", fname);
+  }
+
+  __time(&before_s, &before_ns);
+  for (rec = 0; rec < nrecs; rec++) {
+    makerecord(rec, fields);
+    if (usev) {
+      for (i = 0; i < NFIELDS; i++) {
+        iov[i].iov_base = fields[i];
+        iov[i].iov_len = FIELDLEN;
+      }
+      r = writev(fd, iov, NFIELDS);
+      if (r != RECLEN) {
+        err(1, "%s: writev returned %d", fname, r);
+      }
+    }
+    else {
+      for (i = 0; i < NFIELDS; i++) {
+        r = write(fd, fields[i], FIELDLEN);
+        if (r != FIELDLEN) {
+          err(1, "%s: write returned %d", fname, r);
+        }
+      }
+    }
+  }
+  close(fd);
+  return elapsed_ms(before_s, before_ns);
+}
+
+/* read every record back with pread, last record first */
+static
+void
+checkfile(int nrecs)
+{
+  char fields[NFIELDS][FIELDLEN];
+  char buf[RECLEN];
+  int fd, rec, r;
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    err(1, "%s: open for read", fname);
+  }
+  for (rec = nrecs - 1; rec >= 0; rec--) {
+    makerecord(rec, fields);
+    r = pread(fd, buf, RECLEN, (off_t)rec * RECLEN);
+    if (r != RECLEN) {
+      err(1, "%s: pread of record %d returned %d", fname, rec, r);
+    }
+    if (memcmp(buf, fields, RECLEN) != 0) {
+      errx(1, "%s: record %d has the wrong contents", fname, rec);
+    }
+  }
+  /* pread must not have moved the seek pointer */
+  r = read(fd, buf, RECLEN);
+  if (r != RECLEN || memcmp(buf, "abcd", FIELDLEN) != 0) {
+    errx(1, "%s: pread moved the seek pointer", fname);
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nrecs = DEFAULT_RECORDS;
+  unsigned long ms_write, ms_writev;
+
+  if (argc > 1) {
+    nrecs = atoi(argv[1]);
+  }
+  if (nrecs < 1) {
+    errx(1, "usage: writevbench [records]");
+  }
+
+  ms_write = writefile(nrecs, 0);
+  checkfile(nrecs);
+  ms_writev = writefile(nrecs, 1);
+  checkfile(nrecs);
+  remove(fname);
+
+  printf("writevbench: %d records of %d bytes\n", nrecs, RECLEN);
+  printf("  write:  %d calls in %lu ms\n", nrecs * NFIELDS, ms_write);
+  printf("  writev: %d calls in %lu ms\n", nrecs, ms_writev);
+  printf("writevbench: passed\n");
+  return 0;
+}